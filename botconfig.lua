@@ -0,0 +1,9 @@
+Bots = {
+	Count = 16,
+	InputChangeInterval = 1, -- bots pick new random inputs every second
+	ReportInterval = 5
+}
+ServerSettings = {
+	Address = "localhost",
+	Port = 14768
+}
@@ -5,7 +5,13 @@ Assets = {
 Debug = {
 	SendServerState = false,
 	ShowConnectionData = "ping", -- ping|download|upload|usage
-	ShowServerGhosts = false
+	ShowServerGhosts = false,
+	-- Network conditions simulated between the client and its local server (latency and jitter in milliseconds, others are probabilities between 0 and 1)
+	SimulatedDuplication = 0,
+	SimulatedJitter = 0,
+	SimulatedLatency = 0,
+	SimulatedLoss = 0,
+	SimulatedReorder = 0
 }
 GameSettings = {
 	TickRate = 33,
@@ -8,6 +8,7 @@
 #define BURGWAR_CLIENTLIB_DOWNLOADMANAGER_HPP
 
 #include <ClientLib/ClientSession.hpp>
+#include <CoreLib/Utility/ByteView.hpp>
 #include <filesystem>
 #include <vector>
 
@@ -24,7 +25,7 @@ namespace bw
 			void Start();
 
 			NazaraSignal(OnDownloadRequest, ClientScriptDownloadManager* /*downloadManager*/, const Packets::DownloadClientScriptRequest& /*request*/);
-			NazaraSignal(OnFileChecked, ClientScriptDownloadManager* /*downloadManager*/, const std::string& /*downloadPath*/, const std::vector<Nz::UInt8>& /*content*/);
+			NazaraSignal(OnFileChecked, ClientScriptDownloadManager* /*downloadManager*/, const std::string& /*downloadPath*/, const ByteView& /*content*/);
 			NazaraSignal(OnFinished, ClientScriptDownloadManager* /*downloadManager*/);
 
 		private:
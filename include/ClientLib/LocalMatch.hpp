@@ -33,6 +33,7 @@
 #include <NDK/EntityOwner.hpp>
 #include <Thirdparty/tsl/hopscotch_map.h>
 #include <Thirdparty/tsl/hopscotch_set.h>
+#include <array>
 #include <memory>
 #include <optional>
 #include <variant>
@@ -107,6 +108,9 @@ namespace bw
 			LocalMatch& operator=(LocalMatch&&) = delete;
 
 		private:
+			static constexpr float CameraRectUpdateThreshold = 64.f;
+			static constexpr Nz::UInt16 FullInputInterval = 30;
+
 			struct ServerEntity;
 
 			struct Debug
@@ -127,6 +131,7 @@ namespace bw
 				Packets::EntityPhysics,
 				Packets::EntityWeapon,
 				Packets::HealthUpdate,
+				Packets::LayerActivated,
 				Packets::MatchState,
 				Packets::PlayerLayer,
 				Packets::PlayerWeapons
@@ -135,6 +140,7 @@ namespace bw
 			void BindEscapeMenu();
 			void BindPackets();
 			void BindSignals(ClientEditorApp& burgApp, Nz::RenderWindow* window, Ndk::Canvas* canvas);
+			void DiscardReceivedStates(Nz::UInt16 removalTick, LayerIndex layerIndex, std::optional<Nz::UInt32> entityId = std::nullopt);
 			void HandleChatMessage(const Packets::ChatMessage& packet);
 			void HandleConsoleAnswer(const Packets::ConsoleAnswer& packet);
 			void HandlePlayerJoined(const Packets::PlayerJoined& packet);
@@ -155,6 +161,7 @@ namespace bw
 			void HandleTickPacket(Packets::EntityPhysics&& packet);
 			void HandleTickPacket(Packets::EntityWeapon&& packet);
 			void HandleTickPacket(Packets::HealthUpdate&& packet);
+			void HandleTickPacket(Packets::LayerActivated&& packet);
 			void HandleTickPacket(Packets::MatchState&& packet);
 			void HandleTickPacket(Packets::PlayerLayer&& packet);
 			void HandleTickPacket(Packets::PlayerWeapons&& packet);
@@ -163,6 +170,8 @@ namespace bw
 			void InitializeScoreboard();
 			void OnTick(bool lastTick) override;
 			void PushTickPacket(Nz::UInt16 tick, const TickPacketContent& packet);
+			bool ResolveMatchState(Packets::MatchState& matchState);
+			void SendCameraRect();
 			bool SendInputs(Nz::UInt16 serverTick, bool force);
 
 			struct LocalPlayerData
@@ -233,6 +242,13 @@ namespace bw
 				Nz::Int32 tickError;
 			};
 
+			struct ReceivedMatchState
+			{
+				tsl::hopscotch_map<Nz::UInt64 /*layerIndex|entityId*/, Packets::MatchState::Entity> entities;
+				Nz::UInt16 stateTick;
+				bool isValid = false;
+			};
+
 			struct TickPacket
 			{
 				Nz::UInt16 serverTick;
@@ -257,6 +273,8 @@ namespace bw
 			std::optional<Debug> m_debug;
 			std::optional<LocalConsole> m_localConsole;
 			std::optional<ParticleRegistry> m_particleRegistry;
+			std::optional<Nz::Rectf> m_lastSentCameraRect;
+			std::array<ReceivedMatchState, Packets::MatchState::MaxBaselineAge + 1> m_receivedMatchStates;
 			std::shared_ptr<ClientGamemode> m_gamemode;
 			std::shared_ptr<ScriptingContext> m_scriptingContext;
 			std::string m_gamemodeName;
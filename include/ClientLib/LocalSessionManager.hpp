@@ -7,9 +7,12 @@
 #ifndef BURGWAR_CLIENTLIB_LOCALSESSIONMANAGER_HPP
 #define BURGWAR_CLIENTLIB_LOCALSESSIONMANAGER_HPP
 
+#include <CoreLib/Config.hpp>
 #include <CoreLib/SessionManager.hpp>
 #include <Nazara/Core/MemoryPool.hpp>
+#include <array>
 #include <optional>
+#include <random>
 #include <vector>
 
 namespace bw
@@ -23,31 +26,77 @@ namespace bw
 		friend LocalSessionBridge;
 
 		public:
-			using SessionManager::SessionManager;
+			struct NetworkConditions;
+
+			LocalSessionManager(MatchSessions* owner);
 			~LocalSessionManager();
 
 			std::shared_ptr<LocalSessionBridge> CreateSession();
 
+			inline const NetworkConditions& GetNetworkConditions(Nz::UInt8 channelId) const;
+
 			void Poll() override;
 
+			void SetNetworkConditions(const NetworkConditions& conditions);
+			void SetNetworkConditions(Nz::UInt8 channelId, const NetworkConditions& conditions);
+
+			// Simulated network conditions, applied to both directions (reliable packets are never lost, duplicated nor reordered but are delayed by resends)
+			struct NetworkConditions
+			{
+				Nz::UInt32 latency = 0; //< one-way, milliseconds
+				Nz::UInt32 jitter = 0;  //< maximum random latency added to each packet, milliseconds
+				float duplicationRate = 0.f;
+				float lossRate = 0.f;
+				float reorderRate = 0.f;
+			};
+
 		private:
+			struct Link;
+			struct PendingPacket;
+
 			void DisconnectPeer(std::size_t peerId);
-			void SendPacket(std::size_t peerId, Nz::NetPacket&& packet, bool isServer);
+			void PollLink(Link& link, LocalSessionBridge& bridge, bool isServerLink);
+			void SendPacket(std::size_t peerId, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet, bool isServer);
+
+			// Reordered packets are held back for this long (plus jitter) to be overtaken by following packets
+			static constexpr Nz::UInt32 ReorderDelay = 20; //< milliseconds
+
+			struct PendingPacket
+			{
+				Nz::NetPacket packet;
+				Nz::UInt64 deliveryTime;
+				Nz::UInt64 sequenceId;
+				Nz::UInt8 channelId;
+				bool isSequenced; //< unreliable packets older than the last delivered one are dropped, as ENet does
+			};
+
+			// One direction of a peer connection
+			struct Link
+			{
+				std::array<Nz::UInt64, NetworkChannelCount> lastDeliveredSequence = {};
+				std::array<Nz::UInt64, NetworkChannelCount> lastReliableDeliveryTime = {};
+				std::vector<PendingPacket> pendingPackets;
+				Nz::UInt64 nextSequenceId = 1;
+			};
 
 			struct Peer
 			{
 				std::shared_ptr<LocalSessionBridge> clientBridge;
 				std::shared_ptr<LocalSessionBridge> serverBridge;
-				std::vector<Nz::NetPacket> clientPackets;
-				std::vector<Nz::NetPacket> serverPackets;
+				Link clientLink; //< server to client
+				Link serverLink; //< client to server
 				MatchClientSession* session;
 				bool disconnectionRequested = false;
 			};
 
+			std::array<NetworkConditions, NetworkChannelCount> m_networkConditions;
+			std::mt19937 m_randomGenerator;
+			std::vector<PendingPacket> m_deliveredPackets;
 			std::vector<std::optional<Peer>> m_peers;
+			bool m_simulateNetworkConditions;
 	};
 }
 
-#include <CoreLib/NetworkSessionManager.inl>
+#include <ClientLib/LocalSessionManager.inl>
 
 #endif
@@ -2,4 +2,14 @@
 // This file is part of the "Burgwar" project
 // For conditions of distribution and use, see copyright notice in LICENSE
 
-#include <CoreLib/LocalSessionManager.hpp>
+#include <ClientLib/LocalSessionManager.hpp>
+#include <cassert>
+
+namespace bw
+{
+	inline auto LocalSessionManager::GetNetworkConditions(Nz::UInt8 channelId) const -> const NetworkConditions&
+	{
+		assert(channelId < m_networkConditions.size());
+		return m_networkConditions[channelId];
+	}
+}
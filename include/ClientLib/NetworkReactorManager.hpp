@@ -19,7 +19,7 @@ namespace bw
 	class NetworkReactorManager
 	{
 		public:
-			inline NetworkReactorManager(const Logger& logger);
+			inline NetworkReactorManager(const Logger& logger, std::size_t reactorPeerCount = 1);
 			~NetworkReactorManager() = default;
 
 			inline std::size_t AddReactor(std::unique_ptr<NetworkReactor> reactor);
@@ -40,6 +40,7 @@ namespace bw
 			std::vector<std::unique_ptr<NetworkReactor>> m_reactors;
 			std::vector<std::shared_ptr<NetworkSessionBridge>> m_connections;
 			const Logger& m_logger;
+			std::size_t m_reactorPeerCount;
 	};
 }
 
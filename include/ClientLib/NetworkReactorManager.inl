@@ -7,9 +7,11 @@
 
 namespace bw
 {
-	inline NetworkReactorManager::NetworkReactorManager(const Logger& logger) :
-	m_logger(logger)
+	inline NetworkReactorManager::NetworkReactorManager(const Logger& logger, std::size_t reactorPeerCount) :
+	m_logger(logger),
+	m_reactorPeerCount(reactorPeerCount)
 	{
+		assert(m_reactorPeerCount > 0);
 	}
 
 	inline std::size_t NetworkReactorManager::AddReactor(std::unique_ptr<NetworkReactor> reactor)
@@ -34,14 +34,17 @@ namespace bw
 
 			template<typename T>
 			void SerializePacket(Nz::NetPacket& packet, const T& data) const;
+			template<typename T>
+			void SerializePacketHeader(Nz::NetPacket& packet, const T& data) const;
 
 			bool UnserializePacket(PeerRef peer, Nz::NetPacket& packet) const;
 
-			using UnserializeFunction = std::function<void(PeerRef peer, Nz::NetPacket& packet)>;
+			using UnserializeFunction = std::function<bool(PeerRef peer, Nz::NetPacket& packet)>;
 
 			struct IncomingCommand
 			{
 				bool enabled = false;
+				bool isFrame = false;
 				UnserializeFunction unserialize;
 				const char* name;
 			};
@@ -56,9 +59,12 @@ namespace bw
 
 		protected:
 			template<typename T, typename CB> void RegisterIncomingCommand(const char* name, CB&& callback);
+			template<typename T> void RegisterIncomingFrameCommand(const char* name);
 			template<typename T> void RegisterOutgoingCommand(const char* name, Nz::ENetPacketFlags flags, Nz::UInt8 channelId);
 
 		private:
+			const IncomingCommand* ReadIncomingCommand(Nz::NetPacket& packet) const;
+
 			using HandleFunction = std::function<void(Nz::NetPacket& packet)>;
 
 			std::vector<IncomingCommand> m_incomingCommands;
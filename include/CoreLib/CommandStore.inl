@@ -73,6 +73,22 @@ namespace bw
 		newCommand.name = name;
 	}
 
+	template<typename Peer>
+	template<typename T>
+	void CommandStore<Peer>::RegisterIncomingFrameCommand(const char* name)
+	{
+		std::size_t packetId = static_cast<std::size_t>(T::Type);
+
+		if (m_incomingCommands.size() <= packetId)
+			m_incomingCommands.resize(packetId + 1);
+
+		// Frames are unpacked by the command store itself, see UnserializePacket
+		IncomingCommand& newCommand = m_incomingCommands[packetId];
+		newCommand.enabled = true;
+		newCommand.isFrame = true;
+		newCommand.name = name;
+	}
+
 	template<typename Peer>
 	template<typename T>
 	void CommandStore<Peer>::RegisterOutgoingCommand(const char* name, Nz::ENetPacketFlags flags, Nz::UInt8 channelId)
@@ -105,8 +121,55 @@ namespace bw
 		packet.FlushBits();
 	}
 
+	template<typename Peer>
+	template<typename T>
+	void CommandStore<Peer>::SerializePacketHeader(Nz::NetPacket& packet, const T& data) const
+	{
+		packet << static_cast<Nz::UInt8>(T::Type);
+
+		T& dataRef = const_cast<T&>(data);
+
+		// Only serialize the packet header, entity records are expected to be appended by the caller
+		PacketSerializer serializer(packet, true);
+		Packets::SerializeHeader(serializer, dataRef);
+	}
+
 	template<typename Peer>
 	bool CommandStore<Peer>::UnserializePacket(PeerRef peer, Nz::NetPacket& packet) const
+	{
+		const IncomingCommand* command = ReadIncomingCommand(packet);
+		if (!command)
+			return false;
+
+		if (!command->isFrame)
+		{
+			command->unserialize(peer, packet);
+			return true;
+		}
+
+		Nz::Stream* stream = packet.GetStream();
+		while (stream->GetCursorPos() < stream->GetSize())
+		{
+			const IncomingCommand* frameCommand = ReadIncomingCommand(packet);
+			if (!frameCommand)
+				return false;
+
+			if (frameCommand->isFrame)
+			{
+				bwLog(m_logger, LogLevel::Error, "Frame packets cannot be nested");
+				return false;
+			}
+
+			// Packets are not size-prefixed, next packet position is unknown if one fails
+			if (!frameCommand->unserialize(peer, packet))
+				return false;
+		}
+
+		return true;
+	}
+
+	template<typename Peer>
+	auto CommandStore<Peer>::ReadIncomingCommand(Nz::NetPacket& packet) const -> const IncomingCommand*
 	{
 		Nz::UInt8 opcode;
 		try
@@ -116,16 +179,15 @@ namespace bw
 		catch (const std::exception&)
 		{
 			bwLog(m_logger, LogLevel::Error, "Failed to unserialize opcode");
-			return false;
+			return nullptr;
 		}
 
 		if (m_incomingCommands.size() <= opcode || !m_incomingCommands[opcode].enabled)
 		{
 			bwLog(m_logger, LogLevel::Error, "Client :derp: sent invalid or disabled opcode: {}", +opcode);
-			return false;
+			return nullptr;
 		}
 
-		m_incomingCommands[opcode].unserialize(peer, packet);
-		return true;
+		return &m_incomingCommands[opcode];
 	}
 }
@@ -21,10 +21,14 @@ namespace bw
 
 			inline const std::string& GetEntityClass() const;
 			inline const Ndk::EntityHandle& GetParent() const;
+			inline Nz::UInt8 GetPriority() const;
 
 			inline void Invalidate();
 
 			inline void UpdateParent(const Ndk::EntityHandle& parent);
+			inline void UpdatePriority(Nz::UInt8 priority);
+
+			static constexpr Nz::UInt8 DefaultPriority = 1;
 
 			static Ndk::ComponentIndex componentIndex;
 
@@ -33,6 +37,7 @@ namespace bw
 		private:
 			Ndk::EntityHandle m_parent;
 			std::string m_entityClass;
+			Nz::UInt8 m_priority;
 	};
 }
 
@@ -8,7 +8,8 @@ namespace bw
 {
 	inline NetworkSyncComponent::NetworkSyncComponent(std::string entityClass, const Ndk::EntityHandle& parent) :
 	m_parent(parent),
-	m_entityClass(entityClass)
+	m_entityClass(entityClass),
+	m_priority(DefaultPriority)
 	{
 	}
 
@@ -22,6 +23,11 @@ namespace bw
 		return m_parent;
 	}
 
+	inline Nz::UInt8 NetworkSyncComponent::GetPriority() const
+	{
+		return m_priority;
+	}
+
 	inline void NetworkSyncComponent::Invalidate()
 	{
 		OnInvalidated(this);
@@ -32,4 +38,9 @@ namespace bw
 		m_parent = parent;
 		//TODO: network event
 	}
+
+	inline void NetworkSyncComponent::UpdatePriority(Nz::UInt8 priority)
+	{
+		m_priority = priority;
+	}
 }
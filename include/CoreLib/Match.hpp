@@ -14,6 +14,7 @@
 #include <CoreLib/AssetStore.hpp>
 #include <CoreLib/Map.hpp>
 #include <CoreLib/MatchSessions.hpp>
+#include <CoreLib/NetPacketPool.hpp>
 #include <CoreLib/Player.hpp>
 #include <CoreLib/SharedMatch.hpp>
 #include <CoreLib/TerrainLayer.hpp>
@@ -34,6 +35,7 @@ namespace bw
 	class ServerGamemode;
 	class ServerScriptingLibrary;
 	class Terrain;
+	class WorkerPool;
 
 	enum class DisconnectionReason
 	{
@@ -82,6 +84,7 @@ namespace bw
 			inline sol::state& GetLuaState();
 			inline const Packets::MatchData& GetMatchData() const;
 			const NetworkStringStore& GetNetworkStringStore() const override;
+			inline NetPacketPool& GetPacketPool();
 			inline MatchSessions& GetSessions();
 			inline const MatchSessions& GetSessions() const;
 			inline const std::shared_ptr<ServerScriptingLibrary>& GetScriptingLibrary() const;
@@ -131,6 +134,7 @@ namespace bw
 				std::string name;
 				Map map;
 				float tickDuration;
+				std::size_t sessionThreadCount = 1;
 			};
 
 			struct GamemodeSettings
@@ -143,6 +147,7 @@ namespace bw
 			void BuildMatchData();
 			void OnPlayerReady(Player* player);
 			void OnTick(bool lastTick) override;
+			void SendDebugPacket(const Nz::NetPacket& debugPacket);
 			void SendPingUpdate();
 
 			struct Debug
@@ -151,6 +156,9 @@ namespace bw
 
 				Nz::UdpSocket socket;
 				Nz::UInt64 lastBroadcastTime = 0;
+				Nz::UInt64 lastNetworkStatsTime = 0;
+				Nz::UInt64 tickCount = 0;
+				Nz::UInt64 tickTime = 0; //< microseconds spent in OnTick since the last stats
 			};
 
 			struct Entity
@@ -170,7 +178,9 @@ namespace bw
 			std::shared_ptr<ServerScriptingLibrary> m_scriptingLibrary;
 			std::string m_name;
 			std::unique_ptr<Terrain> m_terrain;
+			std::unique_ptr<WorkerPool> m_sessionWorkerPool;
 			std::vector<std::unique_ptr<Player>> m_players;
+			std::vector<MatchClientSession*> m_concurrentSessions;
 			mutable Packets::MatchData m_matchData;
 			tsl::hopscotch_map<std::string, Asset> m_assets;
 			tsl::hopscotch_map<std::string, ClientScript> m_clientScripts;
@@ -181,6 +191,7 @@ namespace bw
 			BurgApp& m_app;
 			GamemodeSettings m_gamemodeSettings;
 			Map m_map;
+			NetPacketPool m_packetPool; //< must outlive sessions
 			MatchSessions m_sessions;
 			NetworkStringStore m_networkStringStore;
 			bool m_disableWhenEmpty;
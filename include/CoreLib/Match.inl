@@ -15,10 +15,17 @@ namespace bw
 	template<typename T>
 	void Match::BroadcastPacket(const T& packet, bool onlyReady)
 	{
-		ForEachPlayer([&packet, onlyReady](Player* player)
+		m_sessions.BroadcastPacket(packet, [onlyReady](MatchClientSession* session)
 		{
-			if (!onlyReady || player->IsReady())
-				player->SendPacket(packet);
+			// Sessions are only concerned once one of their players joined (and is ready, if required)
+			bool isConcerned = false;
+			session->ForEachPlayer([&](Player* player)
+			{
+				if (!onlyReady || player->IsReady())
+					isConcerned = true;
+			});
+
+			return isConcerned;
 		});
 	}
 
@@ -95,6 +102,11 @@ namespace bw
 		return m_matchData;
 	}
 
+	inline NetPacketPool& Match::GetPacketPool()
+	{
+		return m_packetPool;
+	}
+
 	inline MatchSessions& Match::GetSessions()
 	{
 		return m_sessions;
@@ -9,11 +9,13 @@
 
 #include <Nazara/Core/HandledObject.hpp>
 #include <Nazara/Core/ObjectHandle.hpp>
+#include <CoreLib/NetPacketPool.hpp>
 #include <CoreLib/PlayerCommandStore.hpp>
 #include <CoreLib/SessionBridge.hpp>
 #include <CoreLib/Protocol/Packets.hpp>
 #include <CoreLib/Utility/CircularBuffer.hpp>
 #include <memory>
+#include <optional>
 #include <vector>
 
 namespace bw
@@ -37,6 +39,8 @@ namespace bw
 			MatchClientSession(MatchClientSession&&) = delete;
 			~MatchClientSession();
 
+			void BeginPacketBatch();
+
 			void Disconnect();
 
 			template<typename F> void ForEachPlayer(F&& func);
@@ -53,6 +57,10 @@ namespace bw
 			void OnTick(float elapsedTime);
 
 			template<typename T> void SendPacket(const T& packet);
+			template<typename T, typename F> void SendPacket(const T& packetHeader, F&& writeRecords);
+			void SendPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet);
+
+			void SubmitPacketBatch();
 
 			void Update(float elapsedTime);
 
@@ -60,6 +68,19 @@ namespace bw
 			MatchClientSession& operator=(MatchClientSession&&) = delete;
 
 		private:
+			static constexpr float InputJitterMargin = 2.f;
+			static constexpr Nz::UInt16 MaxInputDelay = 8;
+			static constexpr Nz::UInt16 MinInputDelay = 1;
+
+			struct Input
+			{
+				std::vector<std::optional<PlayerInputData>> inputs;
+				Nz::UInt16 inputTick;
+			};
+
+			void ApplyInput(const Input& input);
+			void FlushFramePacket();
+			Nz::NetPacket* GetFramePacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags);
 			void HandleIncomingPacket(const Packets::Auth& packet);
 			void HandleIncomingPacket(const Packets::DownloadClientScriptRequest& packet);
 			void HandleIncomingPacket(Packets::PlayerChat&& packet);
@@ -68,25 +89,31 @@ namespace bw
 			void HandleIncomingPacket(const Packets::PlayerSelectWeapon& packet);
 			void HandleIncomingPacket(const Packets::Ready& packet);
 			void HandleIncomingPacket(const Packets::ScriptPacket& packet);
+			void HandleIncomingPacket(const Packets::UpdateCameraRect& packet);
 			void HandleIncomingPacket(Packets::UpdatePlayerName&& packet);
+			void QueueInput(const std::vector<std::optional<PlayerInputData>>& inputs, Nz::UInt16 inputTick);
+			void UpdateInputJitter(Nz::UInt16 inputTick);
 			void UpdatePeerInfo(const SessionBridge::SessionInfo& sessionInfo);
 
-			struct Input
-			{
-				std::vector<std::optional<PlayerInputData>> inputs;
-				Nz::UInt16 inputTick;
-			};
-
 			CircularBuffer<Input> m_queuedInputs;
 			Match& m_match;
+			NetPacketPool& m_packetPool;
 			PlayerCommandStore& m_commandStore;
 			std::size_t m_sessionId;
 			std::shared_ptr<SessionBridge> m_bridge;
 			std::unique_ptr<MatchClientVisibility> m_visibility;
 			std::vector<PlayerHandle> m_players;
+			std::optional<Nz::NetPacket> m_framePacket;
+			std::vector<SessionBridge::OutgoingPacket> m_packetBatch;
+			std::optional<Nz::UInt16> m_lastReceivedInputTick;
+			std::optional<Nz::UInt64> m_lastInputArrivalTime;
+			Nz::UInt16 m_lastArrivalInputTick;
 			Nz::UInt16 m_lastInputTick;
+			Nz::UInt16 m_targetInputDelay; //< in ticks, adapted to the session input jitter
 			Nz::UInt32 m_ping;
+			float m_inputJitter; //< in seconds
 			float m_peerInfoUpdateCounter;
+			bool m_isBatchingPackets;
 	};
 }
 
@@ -50,10 +50,38 @@ namespace bw
 	template<typename T>
 	void MatchClientSession::SendPacket(const T& packet)
 	{
-		Nz::NetPacket data;
+		const auto& command = m_commandStore.GetOutgoingCommand<T>();
+
+		if (Nz::NetPacket* framePacket = GetFramePacket(command.channelId, command.flags))
+		{
+			m_commandStore.SerializePacket(*framePacket, packet);
+			return;
+		}
+
+		Nz::NetPacket data = m_packetPool.Acquire();
 		m_commandStore.SerializePacket(data, packet);
 
+		SendPacket(command.channelId, command.flags, std::move(data));
+	}
+
+	template<typename T, typename F>
+	void MatchClientSession::SendPacket(const T& packetHeader, F&& writeRecords)
+	{
 		const auto& command = m_commandStore.GetOutgoingCommand<T>();
-		m_bridge->SendPacket(command.channelId, command.flags, std::move(data));
+
+		if (Nz::NetPacket* framePacket = GetFramePacket(command.channelId, command.flags))
+		{
+			m_commandStore.SerializePacketHeader(*framePacket, packetHeader);
+			writeRecords(*framePacket);
+			framePacket->FlushBits();
+			return;
+		}
+
+		Nz::NetPacket data = m_packetPool.Acquire();
+		m_commandStore.SerializePacketHeader(data, packetHeader);
+		writeRecords(data);
+		data.FlushBits();
+
+		SendPacket(command.channelId, command.flags, std::move(data));
 	}
 }
@@ -8,8 +8,9 @@
 #define BURGWAR_SERVER_CLIENTVISIBILITY_HPP
 
 #include <Nazara/Core/Bitset.hpp>
+#include <Nazara/Core/ByteArray.hpp>
 #include <Nazara/Core/Flags.hpp>
-#include <Nazara/Core/Signal.hpp>
+#include <Nazara/Math/Rect.hpp>
 #include <NDK/EntityList.hpp>
 #include <CoreLib/LayerIndex.hpp>
 #include <CoreLib/Match.hpp>
@@ -17,9 +18,12 @@
 #include <CoreLib/Protocol/Packets.hpp>
 #include <CoreLib/Components/HealthComponent.hpp>
 #include <CoreLib/Systems/NetworkSyncSystem.hpp>
+#include <CoreLib/Utility/DenseEntityMap.hpp>
 #include <Thirdparty/tsl/hopscotch_map.h>
 #include <Thirdparty/tsl/hopscotch_set.h>
+#include <array>
 #include <limits>
+#include <optional>
 #include <vector>
 
 namespace bw
@@ -59,6 +63,8 @@ namespace bw
 			inline MatchClientVisibility(Match& match, MatchClientSession& session);
 			~MatchClientVisibility() = default;
 
+			void AcknowledgeMatchState(Nz::UInt16 stateTick, Nz::UInt32 previousStateBits);
+
 			inline void ClearLayers();
 
 			inline void HideLayer(LayerIndex layerIndex);
@@ -70,28 +76,76 @@ namespace bw
 			inline void PushLayerUpdate(Nz::UInt8 localPlayerIndex, LayerIndex layerIndex);
 
 			inline void SetEntityControlledStatus(LayerIndex layerIndex, Nz::UInt32 entityId, bool isControlled);
+			inline void SetInterestArea(const Nz::Rectf& area);
 
 			void ShowLayer(LayerIndex layerIndex);
 
 			void Update();
 
 		private:
+			struct EntityBaseline
+			{
+				Packets::MatchState::EntityState state;
+				Nz::UInt16 stateTick;
+			};
+
 			struct PriorityMovementData
 			{
-				Nz::UInt8 priorityAccumulator;
+				float priorityAccumulator;
 				LayerIndex layerIndex;
 				NetworkSyncSystem::EntityMovement movementData;
 				bool staticEntity;
 			};
 
 			void BuildMovementPacket(Packets::MatchState::Entity& packetData, const NetworkSyncSystem::EntityMovement& eventData);
-			void FillEntityData(const NetworkSyncSystem::EntityCreation& creationEvent, Packets::Helper::EntityData& entityData);
-			void HandleEntityCreation(LayerIndex layerIndex, const NetworkSyncSystem::EntityCreation& eventData);
+			float ComputePriority(LayerIndex layerIndex, const NetworkSyncSystem::EntityMovement& eventData) const;
+			void DeltaEncodeEntity(Nz::UInt64 entityKey, Packets::MatchState::Entity& packetData);
+			void HandleEntityCreation(LayerIndex layerIndex, Ndk::EntityId entityId);
 			void HandleEntityRemove(LayerIndex layerIndex, Ndk::EntityId entityId, bool deathEvent);
 			void SendMatchState();
 
 			using EntityPacketSendFunction = std::function<void()>;
-			using PendingCreationEventMap = tsl::hopscotch_map<Nz::UInt32 /*entityId*/, std::optional<NetworkSyncSystem::EntityCreation>>;
+			using EntityRecordMap = DenseEntityMap<std::size_t /*recordIndex*/>;
+
+			struct Layer;
+			struct SentMatchState;
+			void AcknowledgeSentState(Nz::UInt16 stateTick);
+			void ActivateRoot(Layer& layer, Ndk::EntityId rootId);
+			void AddVisibleEntity(Layer& layer, Ndk::EntityId entityId);
+			template<typename F> void FlushCreationEvents(Layer& layer, F&& callback);
+			inline Nz::Rectf GetInterestArea(float margin) const;
+			void HandleLostMatchState(SentMatchState& sentState);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityCreation& entityCreation);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityDeath& entityDeath);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityDestruction& entityDestruction);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityMovement& entityMovement);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityPlayAnimation& entityPlayAnimation);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityHealth* events, std::size_t entityCount);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityInputs* events, std::size_t entityCount);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityPhysics* events, std::size_t entityCount);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityScale* events, std::size_t entityCount);
+			void HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityWeapon* events, std::size_t entityCount);
+			bool IsInInterestArea(LayerIndex layerIndex, const Layer& layer, Ndk::EntityId rootId, float margin) const;
+			void PrepareLayerActivation(LayerIndex layerIndex, Layer& layer);
+			template<typename T> void SendEntityRecords(T& packet, EntityRecordMap Layer::* layerRecords, const EntityRecordBlock& (NetworkSyncSystem::* syncRecords)() const);
+			std::size_t StreamLayerActivation(LayerIndex layerIndex, Layer& layer, std::size_t& budget);
+			void UpdateInterest(LayerIndex layerIndex, Layer& layer);
+			void WriteActivationRecords(Nz::ByteStream& stream) const;
+
+			// Entities enter the interest area a bit before being on screen and leave it once far enough from it
+			static constexpr float InterestEnterMargin = 256.f;
+			static constexpr float InterestLeaveMargin = 768.f;
+
+			// Entities of a newly visible layer are streamed over several ticks, sending them at once would stall the reliable channel
+			static constexpr std::size_t LayerActivationBudget = 4096; //< bytes of entity records per tick
+
+			// Entity priority is weighted by its distance to the closest controlled entity and by its velocity
+			static constexpr float PriorityDistanceFalloff = 2048.f;
+			static constexpr float PriorityMaxDistanceWeight = 4.f;
+			static constexpr float PriorityMinDistanceWeight = 0.25f;
+			static constexpr float PriorityMaxVelocityWeight = 2.f;
+			static constexpr float PriorityVelocityReference = 1024.f;
+			static constexpr float StaticEntityPriorityFactor = 3.f;
 
 			struct PendingLayerUpdate
 			{
@@ -99,6 +153,23 @@ namespace bw
 				LayerIndex layerIndex;
 			};
 
+			struct SentEntity
+			{
+				Nz::UInt64 entityKey; //< layerId|entityId
+				Packets::MatchState::EntityState state;
+				std::optional<NetworkSyncSystem::EntityMovement> staticMovement;
+				float priority;
+			};
+
+			struct SentMatchState
+			{
+				std::vector<SentEntity> entities;
+				Nz::UInt16 stateTick;
+				bool isAcknowledged = false;
+				bool isLost = false;
+				bool isValid = false;
+			};
+
 			struct PendingMultipleEntities
 			{
 				LayerIndex layerIndex;
@@ -110,47 +181,56 @@ namespace bw
 			{
 				struct VisibleEntityData
 				{
-					Nz::UInt8 priorityAccumulator = 0;
+					std::optional<Nz::UInt16> lastSentStateTick;
+					float priorityAccumulator = 0.f;
+					Nz::UInt16 visibilityTick; //< states sent before this tick belong to a previous entity
 				};
 
 				std::size_t visibilityCounter = 1;
 
-				PendingCreationEventMap creationEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityInputs> inputUpdateEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityHealth> healthUpdateEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityMovement> staticMovementUpdateEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityPlayAnimation> playAnimationEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityPhysics> physicsEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityScale> scaleEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, NetworkSyncSystem::EntityWeapon> weaponEvents;
-				tsl::hopscotch_map<Nz::UInt32 /*entityId*/, VisibleEntityData> visibleEntities;
-				tsl::hopscotch_set<Nz::UInt32 /*entityId*/> deathEvents;
-				tsl::hopscotch_set<Nz::UInt32 /*entityId*/> destructionEvents;
-
-				NazaraSlot(NetworkSyncSystem, OnEntityCreated,         onEntityCreatedSlot);
-				NazaraSlot(NetworkSyncSystem, OnEntityDeath,           onEntityDeath);
-				NazaraSlot(NetworkSyncSystem, OnEntityDeleted,         onEntityDeletedSlot);
-				NazaraSlot(NetworkSyncSystem, OnEntityInvalidated,     onEntityInvalidated);
-				NazaraSlot(NetworkSyncSystem, OnEntityPlayAnimation,   onEntityPlayAnimation);
-				NazaraSlot(NetworkSyncSystem, OnEntitiesHealthUpdate,  onEntitiesHealthUpdate);
-				NazaraSlot(NetworkSyncSystem, OnEntitiesInputUpdate,   onEntitiesInputUpdate);
-				NazaraSlot(NetworkSyncSystem, OnEntitiesPhysicsUpdate, onEntitiesPhysicsUpdate);
-				NazaraSlot(NetworkSyncSystem, OnEntitiesScaleUpdate,   onEntitiesScaleUpdate);
-				NazaraSlot(NetworkSyncSystem, OnEntitiesWeaponUpdate,  onEntitiesWeaponUpdate);
+				std::vector<Ndk::EntityId> activationQueue; //< roots to send while the layer is activated, farthest first
+				Nz::Bitset<Nz::UInt64> activationRoots; //< queued roots which weren't sent yet
+
+				// Everything is indexed by entity id, events are registered without hashing nor allocating once the entity is visible
+				EntityRecordMap inputUpdateEvents;
+				EntityRecordMap healthUpdateEvents;
+				DenseEntityMap<NetworkSyncSystem::EntityMovement> staticMovementUpdateEvents;
+				DenseEntityMap<NetworkSyncSystem::EntityPlayAnimation> playAnimationEvents;
+				EntityRecordMap physicsEvents;
+				EntityRecordMap scaleEvents;
+				DenseEntityMap<NetworkSyncSystem::EntityWeapon> weaponEvents;
+				DenseEntityMap<VisibleEntityData> visibleEntities;
+				Nz::Bitset<Nz::UInt64> creationEvents;
+				Nz::Bitset<Nz::UInt64> deathEvents;
+				Nz::Bitset<Nz::UInt64> destructionEvents;
+				Nz::Bitset<Nz::UInt64> interestRoots; //< visible root entities, their children share their visibility
+				NetworkSyncSystem* syncSystem = nullptr;
+				std::size_t journalCursor = 0;
 			};
 
+			Nz::Bitset<Nz::UInt64> m_activatingLayers;
 			Nz::Bitset<Nz::UInt64> m_newlyHiddenLayers;
 			Nz::Bitset<Nz::UInt64> m_newlyVisibleLayers;
 			Nz::Bitset<Nz::UInt64> m_clientVisibleLayers;
 			Nz::Flags<VisibilityEventType> m_pendingEvents;
+			std::optional<Nz::Rectf> m_interestArea;
+			std::array<SentMatchState, Packets::MatchState::MaxBaselineAge + 1> m_sentMatchStates;
+			tsl::hopscotch_map<Nz::UInt64 /*layerId|entityId*/, EntityBaseline> m_entityBaselines;
 			tsl::hopscotch_map<LayerIndex /*layerId*/, std::unique_ptr<Layer>> m_layers;
 			tsl::hopscotch_map<Nz::UInt64 /*layerId|entityId*/, std::vector<EntityPacketSendFunction>> m_pendingEntitiesEvent;
 			tsl::hopscotch_set<Nz::UInt64 /*layerId|entityId*/> m_controlledEntities;
+			std::vector<Ndk::EntityId> m_enteringEntities;
+			std::vector<Ndk::EntityId> m_leavingRoots;
 			std::vector<PendingLayerUpdate> m_pendingLayerUpdates;
 			std::vector<PendingMultipleEntities> m_multiplePendingEntitiesEvent;
+			std::vector<std::pair<const EntityRecordBlock*, std::size_t /*recordIndex*/>> m_entityRecords;
+			std::vector<std::pair<const NetworkSyncSystem*, Ndk::EntityId>> m_createdEntities;
+			std::vector<std::pair<float /*squaredDistance*/, Ndk::EntityId>> m_activationOrder;
 			std::vector<PriorityMovementData> m_priorityMovementData;
+			std::vector<std::pair<LayerIndex, Nz::Vector2f>> m_viewerPositions;
 			Match& m_match;
 			MatchClientSession& m_session;
+			Nz::ByteArray m_activationRecords;
 
 			Packets::CreateEntities    m_createEntitiesPacket;
 			Packets::DeleteEntities    m_deleteEntitiesPacket;
@@ -41,6 +41,7 @@ namespace bw
 		}
 
 		m_layers.clear();
+		m_entityBaselines.clear();
 	}
 
 	inline void MatchClientVisibility::HideLayer(LayerIndex layerIndex)
@@ -57,6 +58,14 @@ namespace bw
 			m_newlyHiddenLayers.UnboundedSet(layerIndex);
 
 		m_layers.erase(it);
+
+		for (auto baselineIt = m_entityBaselines.begin(); baselineIt != m_entityBaselines.end();)
+		{
+			if ((baselineIt->first >> 32) == layerIndex)
+				baselineIt = m_entityBaselines.erase(baselineIt);
+			else
+				++baselineIt;
+		}
 	}
 
 	inline bool MatchClientVisibility::IsLayerVisible(LayerIndex layerIndex) const
@@ -78,6 +87,71 @@ namespace bw
 			m_controlledEntities.erase(entityKey);
 	}
 
+	inline void MatchClientVisibility::SetInterestArea(const Nz::Rectf& area)
+	{
+		m_interestArea = area;
+	}
+
+	inline Nz::Rectf MatchClientVisibility::GetInterestArea(float margin) const
+	{
+		assert(m_interestArea);
+		return Nz::Rectf(m_interestArea->x - margin, m_interestArea->y - margin, m_interestArea->width + 2.f * margin, m_interestArea->height + 2.f * margin);
+	}
+
+	template<typename F>
+	void MatchClientVisibility::FlushCreationEvents(Layer& layer, F&& callback)
+	{
+		auto& creationEvents = layer.creationEvents;
+
+		std::function<void(Nz::UInt32 entityId)> PushEntity;
+		PushEntity = [&](Nz::UInt32 entityId)
+		{
+			if (!creationEvents.UnboundedTest(entityId))
+				return;
+
+			// Erase before handling dependencies so that circular dependencies cannot recurse indefinitely
+			creationEvents.Reset(entityId);
+
+			const NetworkSyncSystem::EntityCreation& eventData = layer.syncSystem->GetEntitySnapshot(entityId).creation;
+
+			if (eventData.parent)
+				PushEntity(static_cast<Nz::UInt32>(eventData.parent.value()));
+
+			if (eventData.weapon)
+			{
+				NetworkSyncSystem::EntityWeapon weaponEvent;
+				weaponEvent.entityId = eventData.entityId;
+				weaponEvent.weaponId = eventData.weapon.value();
+
+				layer.weaponEvents.Insert(entityId, weaponEvent);
+				m_pendingEvents.Set(VisibilityEventType::WeaponUpdate);
+			}
+
+			for (auto&& [layerIndex, dependentId] : eventData.dependentIds)
+			{
+				// Dependencies may still be waiting for the layer activation, they have to be sent beforehand
+				Ndk::EntityId dependentRootId = layer.syncSystem->GetRootEntity(dependentId);
+				if (layer.activationRoots.UnboundedTest(dependentRootId))
+					ActivateRoot(layer, dependentRootId);
+
+				PushEntity(static_cast<Nz::UInt32>(dependentId));
+			}
+
+			callback(entityId);
+		};
+
+		// Activated roots may add entities before the current one, look for them again once the end is reached
+		std::size_t entityId = creationEvents.FindFirst();
+		while (entityId != creationEvents.npos)
+		{
+			PushEntity(static_cast<Nz::UInt32>(entityId));
+
+			entityId = creationEvents.FindNext(entityId);
+			if (entityId == creationEvents.npos)
+				entityId = creationEvents.FindFirst();
+		}
+	}
+
 	template<typename T>
 	void MatchClientVisibility::PushEntityPacket(LayerIndex layerIndex, Nz::UInt32 entityId, T&& packet)
 	{
@@ -133,4 +207,38 @@ namespace bw
 			});
 		}
 	}
-}
\ No newline at end of file
+
+	template<typename T>
+	void MatchClientVisibility::SendEntityRecords(T& packet, EntityRecordMap Layer::* layerRecords, const EntityRecordBlock& (NetworkSyncSystem::* syncRecords)() const)
+	{
+		packet.layers.clear();
+		m_entityRecords.clear();
+
+		for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
+		{
+			auto& layer = *it.value();
+			auto& records = layer.*layerRecords;
+			if (records.IsEmpty())
+				continue;
+
+			auto& layerData = packet.layers.emplace_back();
+			layerData.layerIndex = it.key();
+			layerData.entityCount = static_cast<Nz::UInt32>(records.GetSize());
+
+			const EntityRecordBlock& recordBlock = (layer.syncSystem->*syncRecords)();
+			records.ForEach([&](Nz::UInt32 /*entityId*/, std::size_t recordIndex)
+			{
+				m_entityRecords.emplace_back(&recordBlock, recordIndex);
+			});
+
+			records.Clear();
+		}
+
+		// Entity records were encoded by the NetworkSyncSystem of their layer, only copy them after the packet header
+		m_session.SendPacket(packet, [&](Nz::ByteStream& stream)
+		{
+			for (auto&& [recordBlock, recordIndex] : m_entityRecords)
+				recordBlock->WriteRecord(stream, recordIndex);
+		});
+	}
+}
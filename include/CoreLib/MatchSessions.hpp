@@ -7,6 +7,7 @@
 #ifndef BURGWAR_SERVER_SESSIONMANAGER_HPP
 #define BURGWAR_SERVER_SESSIONMANAGER_HPP
 
+#include <CoreLib/NetPacketPool.hpp>
 #include <CoreLib/NetworkReactor.hpp>
 #include <CoreLib/PlayerCommandStore.hpp>
 #include <CoreLib/SessionBridge.hpp>
@@ -27,12 +28,15 @@ namespace bw
 			MatchSessions(Match& match);
 			~MatchSessions();
 
+			template<typename T, typename F> void BroadcastPacket(const T& packet, F&& sessionFilter);
+
 			void Clear();
 
-			MatchClientSession* CreateSession(std::shared_ptr<SessionBridge> bridge);
+			MatchClientSession* CreateSession(SessionManager* manager, std::shared_ptr<SessionBridge> bridge);
 			template<typename T, typename... Args> T* CreateSessionManager(Args&&... args);
 			void DeleteSession(MatchClientSession* session);
 
+			template<typename F> void ForEachNetworkReactor(F&& cb) const;
 			template<typename F> void ForEachSession(F&& cb);
 
 			inline Match& GetMatch();
@@ -40,12 +44,23 @@ namespace bw
 			void Poll();
 
 		private:
+			struct SessionData
+			{
+				MatchClientSession* session;
+				SessionManager* manager;
+			};
+
+			void BroadcastPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet);
+
 			std::size_t m_nextSessionId;
+			std::vector<MatchClientSession*> m_broadcastManagerSessions;
+			std::vector<SessionData> m_broadcastSessions;
 			std::vector<std::unique_ptr<SessionManager>> m_managers;
 			Match& m_match;
+			NetPacketPool& m_packetPool;
 			PlayerCommandStore m_commandStore;
 			Nz::MemoryPool m_sessionPool;
-			tsl::hopscotch_map<std::size_t /*sessionId*/, MatchClientSession* /*session*/> m_sessionIdToSession;
+			tsl::hopscotch_map<std::size_t /*sessionId*/, SessionData> m_sessionIdToSession;
 	};
 }
 
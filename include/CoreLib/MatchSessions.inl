@@ -6,6 +6,28 @@
 
 namespace bw
 {
+	template<typename T, typename F>
+	void MatchSessions::BroadcastPacket(const T& packet, F&& sessionFilter)
+	{
+		m_broadcastSessions.clear();
+		for (const auto& pair : m_sessionIdToSession)
+		{
+			if (sessionFilter(pair.second.session))
+				m_broadcastSessions.push_back(pair.second);
+		}
+
+		if (m_broadcastSessions.empty())
+			return;
+
+		// Packet is serialized once for all sessions
+		const auto& command = m_commandStore.GetOutgoingCommand<T>();
+
+		Nz::NetPacket data = m_packetPool.Acquire();
+		m_commandStore.SerializePacket(data, packet);
+
+		BroadcastPacket(command.channelId, command.flags, std::move(data));
+	}
+
 	template<typename T, typename ...Args>
 	T* MatchSessions::CreateSessionManager(Args&&... args)
 	{
@@ -13,11 +35,21 @@ namespace bw
 		return static_cast<T*>(m_managers.back().get());
 	}
 
+	template<typename F>
+	void MatchSessions::ForEachNetworkReactor(F&& cb) const
+	{
+		for (const auto& manager : m_managers)
+		{
+			if (const NetworkReactor* reactor = manager->GetNetworkReactor())
+				cb(*reactor);
+		}
+	}
+
 	template<typename F>
 	void MatchSessions::ForEachSession(F&& cb)
 	{
 		for (const auto& pair : m_sessionIdToSession)
-			cb(pair.second);
+			cb(pair.second.session);
 	}
 
 	inline Match& MatchSessions::GetMatch()
@@ -0,0 +1,48 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_NETPACKETPOOL_HPP
+#define BURGWAR_CORELIB_NETPACKETPOOL_HPP
+
+#include <Nazara/Network/NetPacket.hpp>
+#include <Thirdparty/concurrentqueue/concurrentqueue.h>
+#include <atomic>
+
+namespace bw
+{
+	// Recycles outgoing packets (and their buffer), packets can be released from any thread
+	class NetPacketPool
+	{
+		public:
+			NetPacketPool(std::size_t maxPooledPacketCount = 4096);
+			NetPacketPool(const NetPacketPool&) = delete;
+			NetPacketPool(NetPacketPool&&) = delete;
+			~NetPacketPool() = default;
+
+			Nz::NetPacket Acquire(Nz::UInt16 netCode = 0);
+
+			// Allocation count shouldn't increase anymore once the steady state is reached
+			inline std::size_t GetAllocationCount() const;
+			inline std::size_t GetLivePacketCount() const;
+			inline std::size_t GetPooledPacketCount() const;
+
+			void Release(Nz::NetPacket&& packet);
+
+			NetPacketPool& operator=(const NetPacketPool&) = delete;
+			NetPacketPool& operator=(NetPacketPool&&) = delete;
+
+		private:
+			moodycamel::ConcurrentQueue<Nz::NetPacket> m_pooledPackets;
+			std::atomic_size_t m_allocationCount;
+			std::atomic_size_t m_livePacketCount;
+			std::atomic_size_t m_pooledPacketCount;
+			std::size_t m_maxPooledPacketCount;
+	};
+}
+
+#include <CoreLib/NetPacketPool.inl>
+
+#endif
@@ -0,0 +1,23 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/NetPacketPool.hpp>
+
+namespace bw
+{
+	inline std::size_t NetPacketPool::GetAllocationCount() const
+	{
+		return m_allocationCount.load(std::memory_order_relaxed);
+	}
+
+	inline std::size_t NetPacketPool::GetLivePacketCount() const
+	{
+		return m_livePacketCount.load(std::memory_order_relaxed);
+	}
+
+	inline std::size_t NetPacketPool::GetPooledPacketCount() const
+	{
+		return m_pooledPacketCount.load(std::memory_order_relaxed);
+	}
+}
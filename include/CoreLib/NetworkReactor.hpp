@@ -7,11 +7,20 @@
 #ifndef BURGWAR_CORELIB_NETWORK_REACTOR_HPP
 #define BURGWAR_CORELIB_NETWORK_REACTOR_HPP
 
+#include <Nazara/Core/Bitset.hpp>
 #include <Nazara/Core/Thread.hpp>
 #include <Nazara/Network/ENetHost.hpp>
+#include <CoreLib/Config.hpp>
 #include <Thirdparty/concurrentqueue/concurrentqueue.h>
+#include <Thirdparty/tsl/hopscotch_map.h>
+#include <array>
 #include <atomic>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <variant>
 #include <vector>
 
@@ -24,17 +33,34 @@ namespace bw
 		Normal  // Disconnect
 	};
 
+	class NetPacketPool;
+
 	class NetworkReactor
 	{
 		public:
+			struct OutgoingPacket;
 			struct PeerInfo;
+			struct SendLatency;
+			struct Stats;
 			using PeerInfoCallback = std::function<void(PeerInfo& peerInfo)>;
 
-			NetworkReactor(std::size_t firstId, Nz::NetProtocol protocol, Nz::UInt16 port, std::size_t maxClient);
+			// Unreliable packets are always realtime, reliable packets get the priority of their channel
+			enum class SendPriority
+			{
+				Realtime, // never deferred
+				Normal,
+				Bulk      // deferred first when running out of bandwidth
+			};
+
+			// With multiple threads, each one listens on its own port: from port to port + threadCount - 1
+			// maxClient is shared by every thread
+			NetworkReactor(std::size_t firstId, Nz::NetProtocol protocol, Nz::UInt16 port, std::size_t maxClient, std::size_t threadCount = 1, NetPacketPool* packetPool = nullptr);
 			NetworkReactor(const NetworkReactor&) = delete;
 			NetworkReactor(NetworkReactor&&) = delete;
 			~NetworkReactor();
 
+			void BroadcastData(const std::size_t* peerIds, std::size_t peerCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet);
+
 			std::size_t ConnectTo(Nz::IpAddress address, Nz::UInt32 data = 0);
 			void DisconnectPeer(std::size_t peerId, Nz::UInt32 data = 0, DisconnectionType type = DisconnectionType::Normal);
 
@@ -42,14 +68,29 @@ namespace bw
 			void Poll(ConnectCB&& onConnection, DisconnectCB&& onDisconnection, DataCB&& onData);
 
 			inline Nz::NetProtocol GetProtocol() const;
+			SendLatency GetSendLatency() const;
+			Stats GetStats() const;
+			inline std::size_t GetThreadCount() const;
 
 			void QueryInfo(std::size_t peerId, PeerInfoCallback callback);
 
 			void SendData(std::size_t peerId, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet);
+			void SendDataBatch(OutgoingPacket* packets, std::size_t packetCount);
+
+			void SetChannelPriority(Nz::UInt8 channelId, SendPriority priority);
+			void SetPeerBandwidthBudget(Nz::UInt32 bytesPerSecond);
 
 			NetworkReactor& operator=(const NetworkReactor&) = delete;
 			NetworkReactor& operator=(NetworkReactor&&) = delete;
 
+			struct OutgoingPacket
+			{
+				std::size_t peerId;
+				Nz::ENetPacketFlags flags;
+				Nz::UInt8 channelId;
+				Nz::NetPacket packet;
+			};
+
 			struct PeerInfo
 			{
 				Nz::UInt32 ping;
@@ -61,14 +102,104 @@ namespace bw
 				Nz::UInt64 totalByteSent;
 			};
 
+			// Time between SendData and the packet being handed to the socket, in microseconds, over the last completed one second window
+			struct SendLatency
+			{
+				Nz::UInt64 averageTime;
+				Nz::UInt64 maxTime;
+				Nz::UInt64 packetCount;
+			};
+
+			// Upper bounds of the round-trip time histogram buckets (in milliseconds), the last bucket holds everything above
+			static constexpr std::array<Nz::UInt32, 5> RoundTripTimeBounds = { 25, 50, 100, 200, 400 };
+
+			// Counters are cumulative since the reactor creation (except sendLatency), read without locking (values may be slightly out of sync)
+			struct Stats
+			{
+				struct ChannelStats
+				{
+					Nz::UInt64 byteCount;
+					Nz::UInt64 packetCount;
+				};
+
+				std::array<ChannelStats, NetworkChannelCount> channels;
+				std::array<std::size_t, RoundTripTimeBounds.size() + 1> roundTripTimes; //< peer count per bucket
+				std::size_t backlogSize;
+				std::size_t incomingQueueSize;
+				std::size_t outgoingQueueSize;
+				std::size_t peerCount;
+				Nz::UInt64 sendTime;    //< microseconds spent sending packets
+				Nz::UInt64 serviceTime; //< microseconds spent servicing ENet and handling its events, waiting for activity excluded
+				SendLatency sendLatency;
+			};
+
 			static constexpr std::size_t InvalidPeerId = std::numeric_limits<std::size_t>::max();
 	
 		private:
-			void EnsureProperDisconnection(const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token);
-			void HandleConnectionRequests(moodycamel::ConsumerToken& token);
-			void ReceivePackets(const moodycamel::ProducerToken& producterToken);
-			void SendPackets(const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token);
-			void WorkerThread();
+			struct BroadcastPayload;
+			struct Shard;
+
+			std::size_t AllocatePeerId(Shard& shard, Nz::ENetPeer* peer);
+			void EnsureProperDisconnection(Shard& shard, const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token);
+			moodycamel::ProducerToken& GetProducerToken(Shard& shard);
+			inline Shard& GetShard(std::size_t peerId, std::size_t* localPeerId);
+			void ClearBacklog(Shard& shard, std::size_t peerId);
+			void ReleaseBroadcastPayload(BroadcastPayload* payload, bool isPacketMoved);
+			bool ConnectWakeupPeer(Shard& shard);
+			void HandleConnectionRequests(Shard& shard, moodycamel::ConsumerToken& token);
+			void RecyclePackets(Shard& shard, bool force);
+			void SampleRoundTripTimes(Shard& shard);
+			bool HandleIncomingConnection(Shard& shard, Nz::ENetPeer* peer, Nz::UInt32 data);
+			bool HandleOutgoingDisconnection(Shard& shard, std::size_t peerId, Nz::UInt32 data);
+			void ReceivePackets(Shard& shard, const moodycamel::ProducerToken& producterToken, Nz::ENetEvent& event);
+			void ReportConnection(Shard& shard, const moodycamel::ProducerToken& producterToken, std::size_t peerId, bool outgoingConnection, Nz::UInt32 data);
+			std::size_t ReleasePeerId(Shard& shard, Nz::ENetPeer* peer);
+			void SendPackets(Shard& shard, const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token);
+			void ServiceWakeupHost(Shard& shard);
+			bool WaitForActivity(Shard& shard, Nz::ENetEvent* event, Nz::UInt32 timeout);
+			void WakeUp(Shard& shard);
+			void WorkerThread(Shard& shard);
+
+			// A peer may send up to this much of its bandwidth budget in one go
+			static constexpr Nz::UInt64 BandwidthBurstTime = 100'000; //< microseconds
+			static constexpr std::size_t SendPriorityCount = static_cast<std::size_t>(SendPriority::Bulk) + 1;
+
+			// Events are moved in and out of the queues by blocks of this size
+			static constexpr std::size_t BulkDequeueSize = 64;
+
+			// Maximum time the reactor blocks in ENet without being woken up, resends and pings are only handled when ENet returns
+			static constexpr Nz::UInt32 IdleServiceTime = 10; //< milliseconds
+
+			// Peers with deferred packets or pending connections have to be checked more often
+			static constexpr Nz::UInt32 BusyServiceTime = 1; //< milliseconds
+
+			// Peers round-trip times are only sampled from time to time for stats
+			static constexpr Nz::UInt64 RoundTripTimeSampleInterval = 1'000'000; //< microseconds
+
+			// Wakeup host has to acknowledge host pings even when the reactor never blocks
+			static constexpr Nz::UInt64 WakeupHostServiceInterval = 100'000; //< microseconds
+
+			// Send latency is published (and reset) once per window so that maximums don't stick forever
+			static constexpr Nz::UInt64 SendLatencyWindow = 1'000'000; //< microseconds
+
+			// Unreliable packets are never deferred, they use their own ENet channels so they can't be sequenced before deferred reliable packets
+			static constexpr Nz::UInt8 RealtimeChannelOffset = NetworkChannelCount;
+
+			// Sharding handshake, see HandleIncomingConnection
+			static constexpr Nz::UInt8 ControlChannelId = 2 * NetworkChannelCount;
+			static constexpr std::size_t ReactorChannelCount = 2 * NetworkChannelCount + 1;
+			// Peers without any of the connection flags don't share our channel layout and are refused
+			static constexpr Nz::UInt32 RedirectionFlag = 0x80000000;          //< disconnection data
+			static constexpr Nz::UInt32 ShardingSupportFlag = 0x40000000;      //< connection data
+			static constexpr Nz::UInt32 RedirectedConnectionFlag = 0x20000000; //< connection data
+
+			// Shared by every shard a broadcast is sent to, recycled by the last of them
+			struct BroadcastPayload
+			{
+				std::atomic_size_t shardCount;
+				std::vector<std::size_t> peerIds; //< local peer ids, grouped by shard
+				Nz::NetPacket packet;
+			};
 
 			struct ConnectionRequest
 			{
@@ -109,6 +240,17 @@ namespace bw
 
 			struct OutgoingEvent
 			{
+				// Same packet sent to multiple peers of a shard, serialized only once
+				struct BroadcastEvent
+				{
+					BroadcastPayload* payload;
+					std::size_t firstPeerIndex;
+					std::size_t peerCount;
+					Nz::ENetPacketFlags flags;
+					Nz::UInt8 channelId;
+					Nz::UInt64 enqueueTime;
+				};
+
 				struct DisconnectEvent
 				{
 					DisconnectionType type;
@@ -120,6 +262,8 @@ namespace bw
 					Nz::ENetPacketFlags flags;
 					Nz::UInt8 channelId;
 					Nz::NetPacket packet;
+					Nz::ENetPacketRef sharedPacket; //< used instead of packet for broadcasts
+					Nz::UInt64 enqueueTime;
 				};
 
 				struct QueryPeerInfo 
@@ -128,18 +272,84 @@ namespace bw
 				};
 
 				std::size_t peerId = InvalidPeerId;
-				std::variant<DisconnectEvent, PacketEvent, QueryPeerInfo> data;
+				std::variant<BroadcastEvent, DisconnectEvent, PacketEvent, QueryPeerInfo> data;
+			};
+
+			struct PeerSendState
+			{
+				std::array<std::deque<OutgoingEvent::PacketEvent>, SendPriorityCount> backlogs;
+				Nz::Int64 availableBytes = 0;
+				Nz::UInt64 lastRefillTime = 0;
+			};
+
+			struct PendingConnection
+			{
+				Nz::IpAddress remoteAddress;
+				Nz::UInt32 data;
+			};
+
+			struct Shard
+			{
+				Shard() :
+				pollToken(incomingQueue)
+				{
+				}
+
+				std::array<std::atomic_uint64_t, NetworkChannelCount> channelByteCount;
+				std::array<std::atomic_uint64_t, NetworkChannelCount> channelPacketCount;
+				std::array<std::atomic_size_t, RoundTripTimeBounds.size() + 1> roundTripTimes;
+				std::atomic_bool wakeupPending;
+				std::atomic_size_t backlogSize;
+				std::atomic_size_t peerCount;
+				std::atomic_uint64_t sendLatencyMax;
+				std::atomic_uint64_t sendLatencySum;
+				std::atomic_uint64_t sendTime;
+				std::atomic_uint64_t sentPacketCount;
+				std::atomic_uint64_t serviceTime;
+				std::mutex producerTokenMutex;
+				std::mutex wakeupMutex; //< protects wakeupHost and wakeupHostPeer
+				std::size_t firstId;
+				std::size_t shardIndex;
+				Nz::UInt64 lastRoundTripTimeSample = 0;
+				Nz::UInt64 lastWakeupHostService = 0;
+				Nz::UInt64 windowLatencyMax = 0;
+				Nz::UInt64 windowLatencySum = 0;
+				Nz::UInt64 windowPacketCount = 0;
+				Nz::UInt64 windowStartTime = 0;
+				std::vector<ConnectionRequest> connectionRequestBuffer;
+				std::vector<Nz::ENetPeer*> clients;
+				std::vector<std::size_t> localPeerIds; //< indexed by ENet peer id, a redirected peer keeps its local id on a different ENet peer
+				std::vector<OutgoingEvent> outgoingEventBuffer;
+				std::vector<std::optional<PendingConnection>> pendingConnections;
+				std::vector<PeerSendState> peerSendStates;
+				moodycamel::ConcurrentQueue<ConnectionRequest> connectionRequests;
+				moodycamel::ConcurrentQueue<IncomingEvent> incomingQueue;
+				moodycamel::ConcurrentQueue<OutgoingEvent> outgoingQueue;
+				moodycamel::ConsumerToken pollToken;
+				tsl::hopscotch_map<std::thread::id, std::unique_ptr<moodycamel::ProducerToken>> producerTokens; //< must be destroyed before the queues
+				Nz::Bitset<Nz::UInt64> backloggedPeers;
+				Nz::Bitset<Nz::UInt64> refusedPeers; //< redirected or refused, never reported
+				Nz::ENetHost host;
+				Nz::ENetHost wakeupHost; //< producers send a loopback packet to host through it to wake the reactor up
+				Nz::ENetPeer* wakeupHostPeer = nullptr; //< wakeupHost side of the loopback connection
+				Nz::ENetPeer* wakeupPeer = nullptr;     //< host side of the loopback connection
+				Nz::Thread thread;
+				std::vector<Nz::ENetPacketRef> inflightPackets; //< packets to give back to the pool once ENet is done with them, must be destroyed before the host
 			};
 
+			std::array<std::atomic<SendPriority>, NetworkChannelCount> m_channelPriorities;
 			std::atomic_bool m_running;
+			std::atomic_size_t m_peerCount; //< every shard included, incoming peers are counted once accepted
+			std::atomic_uint32_t m_peerBandwidthBudget;
 			std::size_t m_firstId;
-			std::vector<Nz::ENetPeer*> m_clients;
-			moodycamel::ConcurrentQueue<ConnectionRequest> m_connectionRequests;
-			moodycamel::ConcurrentQueue<IncomingEvent> m_incomingQueue;
-			moodycamel::ConcurrentQueue<OutgoingEvent> m_outgoingQueue;
-			Nz::ENetHost m_host;
+			std::size_t m_maxPeerCount;
+			std::size_t m_shardCapacity;
+			std::vector<IncomingEvent> m_incomingEventBuffer;
+			std::vector<std::unique_ptr<Shard>> m_shards;
+			moodycamel::ConcurrentQueue<std::unique_ptr<BroadcastPayload>> m_broadcastPayloads; //< unused payloads
+			NetPacketPool* m_packetPool;
+			Nz::UInt64 m_reactorId;
 			Nz::NetProtocol m_protocol;
-			Nz::Thread m_thread;
 	};
 }
 
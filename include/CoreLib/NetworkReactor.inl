@@ -4,37 +4,48 @@
 
 #include <CoreLib/NetworkReactor.hpp>
 #include <CoreLib/Utils.hpp>
+#include <cassert>
 
 namespace bw
 {
 	template<typename ConnectCB, typename DisconnectCB, typename DataCB>
 	void NetworkReactor::Poll(ConnectCB&& onConnection, DisconnectCB&& onDisconnection, DataCB&& onData)
 	{
-		IncomingEvent inEvent;
-		while (m_incomingQueue.try_dequeue(inEvent))
+		for (auto& shardPtr : m_shards)
 		{
-			std::visit([&](auto&& arg) {
-				using T = std::decay_t<decltype(arg)>;
-				if constexpr (std::is_same_v<T, IncomingEvent::ConnectEvent>)
-				{
-					onConnection(arg.outgoingConnection, inEvent.peerId, arg.data);
-				}
-				else if constexpr (std::is_same_v<T, IncomingEvent::DisconnectEvent>)
-				{
-					onDisconnection(inEvent.peerId, arg.data);
-				}
-				else if constexpr (std::is_same_v<T, IncomingEvent::PacketEvent>)
-				{
-					onData(inEvent.peerId, std::move(arg.packet));
-				}
-				else if constexpr (std::is_same_v<T, IncomingEvent::PeerInfoResponse>)
+			Shard& shard = *shardPtr;
+
+			std::size_t eventCount;
+			while ((eventCount = shard.incomingQueue.try_dequeue_bulk(shard.pollToken, m_incomingEventBuffer.begin(), m_incomingEventBuffer.size())) > 0)
+			{
+				for (std::size_t i = 0; i < eventCount; ++i)
 				{
-					arg.callback(arg.peerInfo);
-				}
-				else
-					static_assert(AlwaysFalse<T>::value, "non-exhaustive visitor");
+					IncomingEvent& inEvent = m_incomingEventBuffer[i];
+
+					std::visit([&](auto&& arg) {
+						using T = std::decay_t<decltype(arg)>;
+						if constexpr (std::is_same_v<T, IncomingEvent::ConnectEvent>)
+						{
+							onConnection(arg.outgoingConnection, inEvent.peerId, arg.data);
+						}
+						else if constexpr (std::is_same_v<T, IncomingEvent::DisconnectEvent>)
+						{
+							onDisconnection(inEvent.peerId, arg.data);
+						}
+						else if constexpr (std::is_same_v<T, IncomingEvent::PacketEvent>)
+						{
+							onData(inEvent.peerId, std::move(arg.packet));
+						}
+						else if constexpr (std::is_same_v<T, IncomingEvent::PeerInfoResponse>)
+						{
+							arg.callback(arg.peerInfo);
+						}
+						else
+							static_assert(AlwaysFalse<T>::value, "non-exhaustive visitor");
 
-			}, inEvent.data);
+					}, inEvent.data);
+				}
+			}
 		}
 	}
 
@@ -42,4 +53,21 @@ namespace bw
 	{
 		return m_protocol;
 	}
+
+	inline std::size_t NetworkReactor::GetThreadCount() const
+	{
+		return m_shards.size();
+	}
+
+	inline auto NetworkReactor::GetShard(std::size_t peerId, std::size_t* localPeerId) -> Shard&
+	{
+		assert(peerId >= m_firstId);
+
+		std::size_t shardPeerId = peerId - m_firstId;
+		std::size_t shardIndex = shardPeerId / m_shardCapacity;
+		assert(shardIndex < m_shards.size());
+
+		*localPeerId = shardPeerId % m_shardCapacity;
+		return *m_shards[shardIndex];
+	}
 }
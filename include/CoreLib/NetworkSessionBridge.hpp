@@ -28,6 +28,7 @@ namespace bw
 			void QueryInfo(std::function<void(const SessionInfo& info)> callback) const override;
 
 			void SendPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet) override;
+			void SendPacketBatch(OutgoingPacket* packets, std::size_t packetCount) override;
 
 		private:
 			std::size_t m_peerId;
@@ -20,9 +20,14 @@ namespace bw
 	class NetworkSessionManager : public SessionManager
 	{
 		public:
-			NetworkSessionManager(MatchSessions* owner, Nz::UInt16 port, std::size_t maxClient);
+			NetworkSessionManager(MatchSessions* owner, Nz::UInt16 port, std::size_t maxClient, std::size_t threadCount = 1);
 			~NetworkSessionManager();
 
+			void BroadcastPacket(MatchClientSession* const* sessions, std::size_t sessionCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet) override;
+
+			const NetworkReactor* GetNetworkReactor() const override;
+			inline NetworkReactor& GetReactor();
+
 			void Poll() override;
 
 		private:
@@ -31,6 +36,7 @@ namespace bw
 			void HandlePeerPacket(std::size_t peerId, Nz::NetPacket&& packet);
 
 			std::vector<MatchClientSession*> m_peerIdToSession;
+			std::vector<std::size_t> m_broadcastPeerIds;
 			NetworkReactor m_reactor;
 	};
 }
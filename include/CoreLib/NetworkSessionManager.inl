@@ -3,3 +3,11 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/NetworkSessionManager.hpp>
+
+namespace bw
+{
+	inline NetworkReactor& NetworkSessionManager::GetReactor()
+	{
+		return m_reactor;
+	}
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_NETWORK_ENTITYRECORDBLOCK_HPP
+#define BURGWAR_CORELIB_NETWORK_ENTITYRECORDBLOCK_HPP
+
+#include <Nazara/Core/ByteArray.hpp>
+#include <Nazara/Core/ByteStream.hpp>
+#include <CoreLib/Protocol/PacketSerializer.hpp>
+#include <vector>
+
+namespace bw
+{
+	// Entity records serialized once and copied as-is into every packet requiring them
+	class EntityRecordBlock
+	{
+		public:
+			EntityRecordBlock() = default;
+			~EntityRecordBlock() = default;
+
+			inline void Clear();
+
+			template<typename F> void Encode(std::size_t recordCount, F&& serializeRecord);
+
+			inline std::size_t GetRecordCount() const;
+			inline const Nz::UInt8* GetRecordData(std::size_t recordIndex) const;
+			inline std::size_t GetRecordSize(std::size_t recordIndex) const;
+
+			inline void WriteRecord(Nz::ByteStream& stream, std::size_t recordIndex) const;
+
+		private:
+			std::vector<std::size_t> m_recordOffsets;
+			Nz::ByteArray m_data;
+	};
+}
+
+#include <CoreLib/Protocol/EntityRecordBlock.inl>
+
+#endif
@@ -0,0 +1,62 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Protocol/EntityRecordBlock.hpp>
+#include <cassert>
+#include <stdexcept>
+
+namespace bw
+{
+	inline void EntityRecordBlock::Clear()
+	{
+		m_data.Clear();
+		m_recordOffsets.clear();
+	}
+
+	template<typename F>
+	void EntityRecordBlock::Encode(std::size_t recordCount, F&& serializeRecord)
+	{
+		Clear();
+
+		m_recordOffsets.reserve(recordCount + 1);
+		m_recordOffsets.push_back(0);
+
+		Nz::ByteStream stream(&m_data, Nz::OpenMode_WriteOnly);
+		for (std::size_t i = 0; i < recordCount; ++i)
+		{
+			PacketSerializer serializer(stream, true);
+			serializeRecord(serializer, i);
+			serializer.FlushBits();
+
+			// Each record ends on a byte boundary so records can be concatenated in any order
+			stream.FlushBits();
+
+			m_recordOffsets.push_back(m_data.GetSize());
+		}
+	}
+
+	inline std::size_t EntityRecordBlock::GetRecordCount() const
+	{
+		return (!m_recordOffsets.empty()) ? m_recordOffsets.size() - 1 : 0;
+	}
+
+	inline const Nz::UInt8* EntityRecordBlock::GetRecordData(std::size_t recordIndex) const
+	{
+		assert(recordIndex < GetRecordCount());
+		return m_data.GetConstBuffer() + m_recordOffsets[recordIndex];
+	}
+
+	inline std::size_t EntityRecordBlock::GetRecordSize(std::size_t recordIndex) const
+	{
+		assert(recordIndex < GetRecordCount());
+		return m_recordOffsets[recordIndex + 1] - m_recordOffsets[recordIndex];
+	}
+
+	inline void EntityRecordBlock::WriteRecord(Nz::ByteStream& stream, std::size_t recordIndex) const
+	{
+		std::size_t recordSize = GetRecordSize(recordIndex);
+		if (stream.Write(GetRecordData(recordIndex), recordSize) != recordSize)
+			throw std::runtime_error("failed to write");
+	}
+}
@@ -0,0 +1,32 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_NETWORK_FIXEDPOINTQUANTIZATION_HPP
+#define BURGWAR_CORELIB_NETWORK_FIXEDPOINTQUANTIZATION_HPP
+
+#include <Nazara/Prerequisites.hpp>
+#include <cstddef>
+
+namespace bw
+{
+	// Encodes a float in [minValue, maxValue] as an unsigned integer of bitCount bits, with the given precision (values out of range are clamped)
+	struct FixedPointQuantization
+	{
+		constexpr FixedPointQuantization(float minimum, float maximum, float step);
+
+		inline Nz::UInt32 Quantize(float value) const;
+		inline float Unquantize(Nz::UInt32 value) const;
+
+		float minValue;
+		float maxValue;
+		float precision;
+		std::size_t bitCount;
+	};
+}
+
+#include <CoreLib/Protocol/FixedPointQuantization.inl>
+
+#endif
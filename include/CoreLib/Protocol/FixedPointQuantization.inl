@@ -0,0 +1,37 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Protocol/FixedPointQuantization.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace bw
+{
+	constexpr FixedPointQuantization::FixedPointQuantization(float minimum, float maximum, float step) :
+	minValue(minimum),
+	maxValue(maximum),
+	precision(step),
+	bitCount(0)
+	{
+		double stepCount = (double(maxValue) - double(minValue)) / double(precision);
+		while (bitCount < 32 && double((Nz::UInt64(1) << bitCount) - 1) < stepCount)
+			bitCount++;
+	}
+
+	inline Nz::UInt32 FixedPointQuantization::Quantize(float value) const
+	{
+		Nz::UInt32 maxQuantizedValue = static_cast<Nz::UInt32>((Nz::UInt64(1) << bitCount) - 1);
+
+		float clampedValue = (value > minValue) ? std::min(value, maxValue) : minValue; //< also handles NaN
+		double quantizedValue = std::round((double(clampedValue) - minValue) / precision);
+
+		return std::min(static_cast<Nz::UInt32>(quantizedValue), maxQuantizedValue);
+	}
+
+	inline float FixedPointQuantization::Unquantize(Nz::UInt32 value) const
+	{
+		return std::min(static_cast<float>(minValue + double(value) * precision), maxValue);
+	}
+}
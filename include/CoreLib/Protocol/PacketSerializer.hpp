@@ -7,7 +7,17 @@
 #ifndef BURGWAR_CORELIB_NETWORK_PACKETSERIALIZER_HPP
 #define BURGWAR_CORELIB_NETWORK_PACKETSERIALIZER_HPP
 
+#include <CoreLib/Protocol/CompressedInteger.hpp>
+#include <CoreLib/Protocol/FixedPointQuantization.hpp>
+#include <CoreLib/Utility/ByteView.hpp>
 #include <Nazara/Core/ByteStream.hpp>
+#include <Nazara/Core/Color.hpp>
+#include <Nazara/Math/Angle.hpp>
+#include <Nazara/Math/Vector2.hpp>
+#include <Nazara/Math/Vector3.hpp>
+#include <Nazara/Math/Vector4.hpp>
+#include <Nazara/Network/NetPacket.hpp>
+#include <string>
 #include <vector>
 
 namespace bw
@@ -15,31 +25,71 @@ namespace bw
 	class PacketSerializer
 	{
 		public:
+			inline PacketSerializer();
 			inline PacketSerializer(Nz::ByteStream& packetBuffer, bool isWriting);
-			~PacketSerializer() = default;
+			inline PacketSerializer(Nz::NetPacket& packet, bool isWriting);
+			~PacketSerializer();
+
+			inline void CheckArraySize(std::size_t elementCount) const;
+
+			inline void FlushBits();
+
+			inline std::size_t GetComputedSize() const;
 
 			inline void Read(void* ptr, std::size_t size);
 
+			inline bool IsComputingSize() const;
 			inline bool IsWriting() const;
 
 			inline void Write(const void* ptr, std::size_t size);
 
 			template<typename DataType> void Serialize(DataType& data);
+			inline void Serialize(ByteView& view);
 			template<typename DataType> void Serialize(std::vector<DataType>& dataVec);
-			template<typename DataType> void Serialize(const DataType& data) const;
+			template<typename DataType> void Serialize(const DataType& data);
 			template<typename PacketType, typename DataType> void Serialize(DataType& data);
-			template<typename PacketType, typename DataType> void Serialize(const DataType& data) const;
+			template<typename PacketType, typename DataType> void Serialize(const DataType& data);
 
 			template<typename T> void SerializeArraySize(T& array);
 			template<typename T> void SerializeArraySize(const T& array);
 
+			// Bit-packed values must be followed by a FlushBits call before serializing anything else
+			template<typename T> void SerializeBits(T& value, std::size_t bitCount);
+			inline void SerializeQuantized(float& value, const FixedPointQuantization& quantization);
+
 			template<typename DataType> void operator&=(DataType& data);
-			template<typename DataType> void operator&=(const DataType& data) const;
+			template<typename DataType> void operator&=(const DataType& data);
 
 		private:
-			Nz::ByteStream& m_buffer;
+			inline void AddSize(bool value);
+			template<typename T> void AddSize(const T& value);
+			inline void FlushComputedBools();
+			inline std::size_t GetRemainingSize() const;
+			template<typename T> void ReadValue(T& value);
+			inline void ReadValue(bool& value);
+			inline void ReadValue(std::string& value);
+			inline void ReadView(ByteView& view, std::size_t size);
+
+			Nz::ByteStream* m_buffer;
+			Nz::NetPacket* m_packet;
+			Nz::UInt64 m_bitBuffer;
+			std::size_t m_bitCount;
+			std::size_t m_computedBoolCount;
+			std::size_t m_computedSize;
+			std::size_t m_remainingBoolCount; //< booleans left to read in the last fetched byte
 			bool m_isWriting;
 	};
+
+	// Size of values as serialized by Nazara's ByteStream, unsupported types are rejected at compile-time
+	template<typename T> constexpr std::enable_if_t<std::is_arithmetic_v<T>, std::size_t> SerializedSize(T value);
+	template<typename T> std::size_t SerializedSize(CompressedSigned<T> value);
+	template<typename T> std::size_t SerializedSize(CompressedUnsigned<T> value);
+	template<Nz::AngleUnit Unit, typename T> constexpr std::size_t SerializedSize(const Nz::Angle<Unit, T>& angle);
+	template<typename T> constexpr std::size_t SerializedSize(const Nz::Vector2<T>& vec);
+	template<typename T> constexpr std::size_t SerializedSize(const Nz::Vector3<T>& vec);
+	template<typename T> constexpr std::size_t SerializedSize(const Nz::Vector4<T>& vec);
+	constexpr std::size_t SerializedSize(const Nz::Color& color);
+	inline std::size_t SerializedSize(const std::string& str);
 }
 
 #include <CoreLib/Protocol/PacketSerializer.inl>
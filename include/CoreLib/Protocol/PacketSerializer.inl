@@ -3,24 +3,95 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/Protocol/PacketSerializer.hpp>
-#include <CoreLib/Protocol/CompressedInteger.hpp>
 #include <cassert>
+#include <climits>
 #include <stdexcept>
+#include <type_traits>
 
 namespace bw
 {
+	inline PacketSerializer::PacketSerializer() :
+	m_buffer(nullptr),
+	m_packet(nullptr),
+	m_bitBuffer(0),
+	m_bitCount(0),
+	m_computedBoolCount(0),
+	m_computedSize(0),
+	m_remainingBoolCount(0),
+	m_isWriting(true)
+	{
+	}
+
 	inline PacketSerializer::PacketSerializer(Nz::ByteStream& packetBuffer, bool isWriting) :
-	m_buffer(packetBuffer),
+	m_buffer(&packetBuffer),
+	m_packet(nullptr),
+	m_bitBuffer(0),
+	m_bitCount(0),
+	m_computedBoolCount(0),
+	m_computedSize(0),
+	m_remainingBoolCount(0),
 	m_isWriting(isWriting)
 	{
 	}
 
+	inline PacketSerializer::PacketSerializer(Nz::NetPacket& packet, bool isWriting) :
+	PacketSerializer(static_cast<Nz::ByteStream&>(packet), isWriting)
+	{
+		m_packet = &packet;
+	}
+
+	inline PacketSerializer::~PacketSerializer()
+	{
+		assert(!m_isWriting || m_bitCount == 0); //< FlushBits wasn't called
+	}
+
+	inline void PacketSerializer::CheckArraySize(std::size_t elementCount) const
+	{
+		if (IsWriting())
+			return;
+
+		// Every element takes at least one bit, prevents huge allocations from malformed packets
+		if (elementCount > GetRemainingSize() * CHAR_BIT)
+			throw std::runtime_error("array size exceeds packet size");
+	}
+
+	inline void PacketSerializer::FlushBits()
+	{
+		if (IsWriting() && m_bitCount > 0)
+		{
+			Nz::UInt8 byte = static_cast<Nz::UInt8>(m_bitBuffer);
+			Write(&byte, sizeof(byte));
+		}
+
+		// Remaining bits are padding
+		m_bitBuffer = 0;
+		m_bitCount = 0;
+	}
+
+	inline std::size_t PacketSerializer::GetComputedSize() const
+	{
+		assert(IsComputingSize());
+		assert(m_bitCount == 0); //< FlushBits wasn't called
+
+		// Pending booleans are flushed as a whole byte
+		return m_computedSize + ((m_computedBoolCount > 0) ? 1 : 0);
+	}
+
 	inline void PacketSerializer::Read(void* ptr, std::size_t size)
 	{
-		if (m_buffer.Read(ptr, size) != size)
+		assert(m_buffer);
+
+		// Any non-boolean read makes the next boolean fetch a new byte
+		m_remainingBoolCount = 0;
+		if (m_buffer->Read(ptr, size) != size)
 			throw std::runtime_error("failed to read");
 	}
 
+	inline bool PacketSerializer::IsComputingSize() const
+	{
+		return m_buffer == nullptr;
+	}
+
 	inline bool PacketSerializer::IsWriting() const
 	{
 		return m_isWriting;
@@ -28,7 +99,14 @@ namespace bw
 
 	inline void PacketSerializer::Write(const void* ptr, std::size_t size)
 	{
-		if (m_buffer.Write(ptr, size) != size)
+		if (IsComputingSize())
+		{
+			FlushComputedBools();
+			m_computedSize += size;
+			return;
+		}
+
+		if (m_buffer->Write(ptr, size) != size)
 			throw std::runtime_error("failed to write");
 	}
 
@@ -36,9 +114,25 @@ namespace bw
 	void PacketSerializer::Serialize(DataType& data)
 	{
 		if (!IsWriting())
-			m_buffer >> data;
+			ReadValue(data);
+		else if (IsComputingSize())
+			AddSize(data);
 		else
-			m_buffer << data;
+			*m_buffer << data;
+	}
+
+	inline void PacketSerializer::Serialize(ByteView& view)
+	{
+		CompressedUnsigned<Nz::UInt32> viewSize;
+		if (IsWriting())
+			viewSize = Nz::UInt32(view.size());
+
+		Serialize(viewSize);
+
+		if (IsWriting())
+			Write(view.data(), view.size());
+		else
+			ReadView(view, viewSize);
 	}
 
 	template<typename DataType>
@@ -50,11 +144,14 @@ namespace bw
 	}
 
 	template<typename DataType>
-	void PacketSerializer::Serialize(const DataType& data) const
+	void PacketSerializer::Serialize(const DataType& data)
 	{
 		assert(IsWriting());
 
-		m_buffer << data;
+		if (IsComputingSize())
+			AddSize(data);
+		else
+			*m_buffer << data;
 	}
 
 	template<typename PacketType, typename DataType>
@@ -63,20 +160,20 @@ namespace bw
 		if (!IsWriting())
 		{
 			PacketType packetData;
-			m_buffer >> packetData;
+			ReadValue(packetData);
 
 			data = static_cast<DataType>(packetData);
 		}
 		else
-			m_buffer << static_cast<PacketType>(data);
+			Serialize(static_cast<PacketType>(data));
 	}
 
 	template<typename PacketType, typename DataType>
-	void PacketSerializer::Serialize(const DataType& data) const
+	void PacketSerializer::Serialize(const DataType& data)
 	{
 		assert(IsWriting());
 
-		m_buffer << static_cast<PacketType>(data);
+		Serialize(static_cast<PacketType>(data));
 	}
 
 	template<typename T>
@@ -89,7 +186,10 @@ namespace bw
 		Serialize(arraySize);
 
 		if (!IsWriting())
+		{
+			CheckArraySize(arraySize);
 			array.resize(arraySize);
+		}
 	}
 
 	template<typename T>
@@ -101,6 +201,58 @@ namespace bw
 		Serialize(arraySize);
 	}
 
+	template<typename T>
+	void PacketSerializer::SerializeBits(T& value, std::size_t bitCount)
+	{
+		static_assert(std::is_integral_v<T> && std::is_unsigned_v<T>);
+		assert(bitCount > 0 && bitCount <= 32 && bitCount <= sizeof(T) * 8);
+
+		Nz::UInt64 mask = (Nz::UInt64(1) << bitCount) - 1;
+
+		if (IsWriting())
+		{
+			m_bitBuffer |= (static_cast<Nz::UInt64>(value) & mask) << m_bitCount;
+			m_bitCount += bitCount;
+
+			while (m_bitCount >= 8)
+			{
+				Nz::UInt8 byte = static_cast<Nz::UInt8>(m_bitBuffer);
+				Write(&byte, sizeof(byte));
+
+				m_bitBuffer >>= 8;
+				m_bitCount -= 8;
+			}
+		}
+		else
+		{
+			while (m_bitCount < bitCount)
+			{
+				Nz::UInt8 byte;
+				Read(&byte, sizeof(byte));
+
+				m_bitBuffer |= Nz::UInt64(byte) << m_bitCount;
+				m_bitCount += 8;
+			}
+
+			value = static_cast<T>(m_bitBuffer & mask);
+
+			m_bitBuffer >>= bitCount;
+			m_bitCount -= bitCount;
+		}
+	}
+
+	inline void PacketSerializer::SerializeQuantized(float& value, const FixedPointQuantization& quantization)
+	{
+		Nz::UInt32 quantizedValue;
+		if (IsWriting())
+			quantizedValue = quantization.Quantize(value);
+
+		SerializeBits(quantizedValue, quantization.bitCount);
+
+		if (!IsWriting())
+			value = quantization.Unquantize(quantizedValue);
+	}
+
 	template<typename DataType>
 	void PacketSerializer::operator&=(DataType& data)
 	{
@@ -108,8 +260,162 @@ namespace bw
 	}
 
 	template<typename DataType>
-	void PacketSerializer::operator&=(const DataType& data) const
+	void PacketSerializer::operator&=(const DataType& data)
 	{
 		return Serialize(data);
 	}
+
+	inline void PacketSerializer::AddSize(bool /*value*/)
+	{
+		// Booleans are packed by eight by Nz::ByteStream
+		if (++m_computedBoolCount == CHAR_BIT)
+		{
+			m_computedSize++;
+			m_computedBoolCount = 0;
+		}
+	}
+
+	template<typename T>
+	void PacketSerializer::AddSize(const T& value)
+	{
+		FlushComputedBools();
+		m_computedSize += SerializedSize(value);
+	}
+
+	inline void PacketSerializer::FlushComputedBools()
+	{
+		// Any non-boolean write flushes pending booleans
+		if (m_computedBoolCount > 0)
+		{
+			m_computedSize++;
+			m_computedBoolCount = 0;
+		}
+	}
+
+	inline std::size_t PacketSerializer::GetRemainingSize() const
+	{
+		assert(m_buffer);
+		return static_cast<std::size_t>(m_buffer->GetSize() - m_buffer->GetStream()->GetCursorPos());
+	}
+
+	template<typename T>
+	void PacketSerializer::ReadValue(T& value)
+	{
+		// Compressed integers are at least one byte long
+		if (GetRemainingSize() < SerializedSize(T{}))
+			throw std::runtime_error("failed to read");
+
+		m_remainingBoolCount = 0;
+		*m_buffer >> value;
+	}
+
+	inline void PacketSerializer::ReadValue(bool& value)
+	{
+		// Booleans are packed by eight, only the first one of a byte has to fetch it
+		if (m_remainingBoolCount == 0)
+		{
+			if (GetRemainingSize() == 0)
+				throw std::runtime_error("failed to read");
+
+			m_remainingBoolCount = 8;
+		}
+
+		*m_buffer >> value;
+		m_remainingBoolCount--;
+	}
+
+	inline void PacketSerializer::ReadValue(std::string& value)
+	{
+		Nz::UInt32 size;
+		ReadValue(size);
+
+		if (size > GetRemainingSize())
+			throw std::runtime_error("string size exceeds packet size");
+
+		value.resize(size);
+		if (size > 0)
+			Read(value.data(), size);
+	}
+
+	inline void PacketSerializer::ReadView(ByteView& view, std::size_t size)
+	{
+		if (size > GetRemainingSize())
+			throw std::runtime_error("byte array size exceeds packet size");
+
+		// Views point directly into the packet buffer and are only valid as long as the packet is
+		if (!m_packet)
+			throw std::runtime_error("byte views can only be read from network packets");
+
+		Nz::Stream* stream = m_buffer->GetStream();
+		Nz::UInt64 cursorPos = stream->GetCursorPos();
+
+		view = ByteView(m_packet->GetConstData() + cursorPos, size);
+		stream->SetCursorPos(cursorPos + size);
+	}
+
+
+	template<typename T>
+	constexpr std::enable_if_t<std::is_arithmetic_v<T>, std::size_t> SerializedSize(T /*value*/)
+	{
+		return sizeof(T);
+	}
+
+	template<typename T>
+	std::size_t SerializedSize(CompressedSigned<T> value)
+	{
+		using UnsignedT = std::make_unsigned_t<T>;
+
+		// ZigZag encoding (see CompressedInteger.inl)
+		T signedValue = value;
+		UnsignedT unsignedValue = (signedValue << 1) ^ (signedValue >> (CHAR_BIT * sizeof(UnsignedT) - 1));
+
+		return SerializedSize(CompressedUnsigned<UnsignedT>(unsignedValue));
+	}
+
+	template<typename T>
+	std::size_t SerializedSize(CompressedUnsigned<T> value)
+	{
+		// Seven bits per byte, at least one byte
+		T integerValue = value;
+
+		std::size_t size = 1;
+		while (integerValue >>= 7)
+			size++;
+
+		return size;
+	}
+
+	template<Nz::AngleUnit Unit, typename T>
+	constexpr std::size_t SerializedSize(const Nz::Angle<Unit, T>& angle)
+	{
+		return SerializedSize(angle.value);
+	}
+
+	template<typename T>
+	constexpr std::size_t SerializedSize(const Nz::Vector2<T>& vec)
+	{
+		return SerializedSize(vec.x) * 2;
+	}
+
+	template<typename T>
+	constexpr std::size_t SerializedSize(const Nz::Vector3<T>& vec)
+	{
+		return SerializedSize(vec.x) * 3;
+	}
+
+	template<typename T>
+	constexpr std::size_t SerializedSize(const Nz::Vector4<T>& vec)
+	{
+		return SerializedSize(vec.x) * 4;
+	}
+
+	constexpr std::size_t SerializedSize(const Nz::Color& color)
+	{
+		return SerializedSize(color.r) * 4;
+	}
+
+	inline std::size_t SerializedSize(const std::string& str)
+	{
+		return sizeof(Nz::UInt32) + str.size();
+	}
 }
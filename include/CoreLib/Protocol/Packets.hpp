@@ -11,7 +11,9 @@
 #include <CoreLib/PlayerInputData.hpp>
 #include <CoreLib/PropertyValues.hpp>
 #include <CoreLib/Protocol/CompressedInteger.hpp>
+#include <CoreLib/Protocol/FixedPointQuantization.hpp>
 #include <CoreLib/Protocol/PacketSerializer.hpp>
+#include <CoreLib/Utility/ByteView.hpp>
 #include <Nazara/Prerequisites.hpp>
 #include <Nazara/Core/Color.hpp>
 #include <Nazara/Core/String.hpp>
@@ -51,9 +53,11 @@ namespace bw
 		EntityWeapon,
 		InputTimingCorrection,
 		HealthUpdate,
+		LayerActivated,
 		MatchData,
 		MatchState,
 		NetworkStrings,
+		PacketFrame,
 		PlayerChat,
 		PlayerConsoleCommand,
 		PlayerJoined,
@@ -66,6 +70,7 @@ namespace bw
 		PlayerWeapons,
 		Ready,
 		ScriptPacket,
+		UpdateCameraRect,
 		UpdatePlayerName
 	};
 
@@ -251,7 +256,7 @@ namespace bw
 
 		DeclarePacket(DownloadClientScriptResponse)
 		{
-			std::vector<Nz::UInt8> fileContent;
+			ByteView fileContent;
 		};
 
 		DeclarePacket(EnableLayer)
@@ -264,6 +269,7 @@ namespace bw
 
 			Nz::UInt16 stateTick;
 			CompressedUnsigned<LayerIndex> layerIndex;
+			CompressedUnsigned<Nz::UInt32> entityCount;
 			std::vector<Entity> layerEntities;
 		};
 
@@ -393,6 +399,12 @@ namespace bw
 			CompressedSigned<Nz::Int32> tickError;
 		};
 
+		DeclarePacket(LayerActivated)
+		{
+			Nz::UInt16 stateTick;
+			CompressedUnsigned<LayerIndex> layerIndex;
+		};
+
 		DeclarePacket(MatchData)
 		{
 			struct Asset
@@ -441,16 +453,37 @@ namespace bw
 				CompressedUnsigned<Nz::UInt32> id;
 				Nz::RadianAnglef rotation;
 				Nz::Vector2f position;
+				Nz::UInt8 baselineAge = 0; //< if non-zero, unchanged fields were elided and must be taken from the state sent baselineAge ticks before
+				bool physicsChanged = true;
+				bool positionChanged = true;
+				bool rotationChanged = true;
 				std::optional<PlayerMovementData> playerMovement;
 				std::optional<PhysicsProperties> physicsProperties;
 			};
 
+			// Entity state as sent on the network, used as a baseline for delta encoding
+			struct EntityState
+			{
+				std::array<Nz::UInt32, 2> position;
+				Nz::UInt32 rotation;
+				std::optional<std::array<Nz::UInt32, 3>> physics; //< angular velocity, linear velocity
+			};
+
 			struct Layer
 			{
 				CompressedUnsigned<LayerIndex> layerIndex;
 				CompressedUnsigned<Nz::UInt32> entityCount;
 			};
 
+			// Entity states are sent as fixed-point values (position and velocities in pixels, angles in radians)
+			static constexpr FixedPointQuantization AngularVelocityQuantization = FixedPointQuantization(-64.f, 64.f, 1.f / 256.f);
+			static constexpr FixedPointQuantization LinearVelocityQuantization = FixedPointQuantization(-8192.f, 8192.f, 1.f / 16.f);
+			static constexpr FixedPointQuantization PositionQuantization = FixedPointQuantization(-65536.f, 65536.f, 1.f / 16.f);
+			static constexpr FixedPointQuantization RotationQuantization = FixedPointQuantization(-float(M_PI), float(M_PI), 1.f / 256.f);
+
+			static constexpr std::size_t BaselineAgeBitCount = 5;
+			static constexpr Nz::UInt8 MaxBaselineAge = (1 << BaselineAgeBitCount) - 1;
+
 			Nz::UInt16 lastInputTick;
 			Nz::UInt16 stateTick;
 			std::vector<Entity> entities;
@@ -463,6 +496,11 @@ namespace bw
 			std::vector<std::string> strings;
 		};
 
+		// Followed by a sequence of packets (each one starting with its opcode) to process in order
+		DeclarePacket(PacketFrame)
+		{
+		};
+
 		DeclarePacket(PlayerChat)
 		{
 			Nz::UInt8 localIndex;
@@ -512,9 +550,20 @@ namespace bw
 
 		DeclarePacket(PlayersInput)
 		{
+			static constexpr std::size_t MaxPreviousInputCount = 7;
+
+			struct PreviousInputs
+			{
+				CompressedUnsigned<Nz::UInt16> tickDelta; //< tick difference with the more recent inputs
+				std::vector<std::optional<PlayerInputData>> inputs;
+			};
+
 			Nz::UInt16 estimatedServerTick;
 			Nz::UInt16 inputTick;
-			std::vector<std::optional<PlayerInputData>> inputs;
+			std::optional<Nz::UInt16> lastStateTick; //< most recent MatchState received, acknowledging it
+			Nz::UInt32 previousStateBits = 0; //< bit N acknowledges lastStateTick - N - 1 (only sent along lastStateTick)
+			std::vector<std::optional<PlayerInputData>> inputs; //< only changed inputs are sent
+			std::vector<PreviousInputs> previousInputs; //< most recent first, sent again in case their packet was lost
 		};
 
 		DeclarePacket(PlayerSelectWeapon)
@@ -540,7 +589,14 @@ namespace bw
 		DeclarePacket(ScriptPacket)
 		{
 			CompressedUnsigned<Nz::UInt32> nameIndex;
-			std::vector<Nz::UInt8> content;
+			ByteView content;
+		};
+
+		// Area seen by the client, entities far from it are not sent
+		DeclarePacket(UpdateCameraRect)
+		{
+			Nz::Vector2f position;
+			Nz::Vector2f size;
 		};
 
 		DeclarePacket(UpdatePlayerName)
@@ -551,8 +607,19 @@ namespace bw
 
 #undef DeclarePacket
 
+		// Size of the entities part of a MatchState packet, updated as entities are added instead of computing the whole packet size again
+		struct MatchStateEntitiesSize
+		{
+			std::size_t flagCount = 0;
+			std::size_t idSize = 0;
+			std::size_t stateBitCount = 0;
+		};
+
 		// Compute size
-		std::size_t EstimateSize(const MatchState& matchState);
+		void AddEntitySize(MatchStateEntitiesSize& entitiesSize, const MatchState::Entity& entity);
+		template<typename T> std::size_t ComputeSize(const T& packet);
+		std::size_t ComputeSize(const MatchState& packet, const MatchStateEntitiesSize& entitiesSize);
+		MatchState::EntityState QuantizeState(const MatchState::Entity& entity);
 
 		// Packets serializer
 		void Serialize(PacketSerializer& serializer, Auth& data);
@@ -577,9 +644,11 @@ namespace bw
 		void Serialize(PacketSerializer& serializer, EntityWeapon& data);
 		void Serialize(PacketSerializer& serializer, HealthUpdate& data);
 		void Serialize(PacketSerializer& serializer, InputTimingCorrection& data);
+		void Serialize(PacketSerializer& serializer, LayerActivated& data);
 		void Serialize(PacketSerializer& serializer, MatchData& data);
 		void Serialize(PacketSerializer& serializer, MatchState& data);
 		void Serialize(PacketSerializer& serializer, NetworkStrings& data);
+		void Serialize(PacketSerializer& serializer, PacketFrame& data);
 		void Serialize(PacketSerializer& serializer, PlayerChat& data);
 		void Serialize(PacketSerializer& serializer, PlayerConsoleCommand& data);
 		void Serialize(PacketSerializer& serializer, PlayerJoined& data);
@@ -592,8 +661,24 @@ namespace bw
 		void Serialize(PacketSerializer& serializer, PlayerWeapons& data);
 		void Serialize(PacketSerializer& serializer, Ready& data);
 		void Serialize(PacketSerializer& serializer, ScriptPacket& data);
+		void Serialize(PacketSerializer& serializer, UpdateCameraRect& data);
 		void Serialize(PacketSerializer& serializer, UpdatePlayerName& data);
 
+		// Split serializers, allowing entity records to be encoded once and shared between packets
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, CreateEntities& data);
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EnableLayer& data);
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EntitiesInputs& data);
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EntitiesScale& data);
+		void SerializeHeader(PacketSerializer& serializer, EntityPhysics& data);
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, HealthUpdate& data);
+
+		void SerializeRecord(PacketSerializer& serializer, CreateEntities::Entity& data);
+		void SerializeRecord(PacketSerializer& serializer, EnableLayer::Entity& data);
+		void SerializeRecord(PacketSerializer& serializer, EntitiesInputs::Entity& data);
+		void SerializeRecord(PacketSerializer& serializer, EntitiesScale::Entity& data);
+		void SerializeRecord(PacketSerializer& serializer, EntityPhysics& data);
+		void SerializeRecord(PacketSerializer& serializer, HealthUpdate::Entity& data);
+
 		// Helpers
 		void Serialize(PacketSerializer& serializer, PlayerInputData& data);
 		void Serialize(PacketSerializer& serializer, Helper::EntityData& data);
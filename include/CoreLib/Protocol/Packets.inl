@@ -6,4 +6,18 @@
 
 namespace bw
 {
+	namespace Packets
+	{
+		template<typename T>
+		std::size_t ComputeSize(const T& packet)
+		{
+			// Runs the packet serializer without writing anything, includes the opcode
+			PacketSerializer serializer;
+			serializer &= static_cast<Nz::UInt8>(T::Type);
+
+			Serialize(serializer, const_cast<T&>(packet));
+
+			return serializer.GetComputedSize();
+		}
+	}
 }
@@ -9,6 +9,7 @@
 
 #include <CoreLib/Protocol/NetworkStringStore.hpp>
 #include <CoreLib/Protocol/Packets.hpp>
+#include <CoreLib/Utility/ByteView.hpp>
 #include <Nazara/Core/ByteArray.hpp>
 #include <Nazara/Core/ByteStream.hpp>
 #include <Nazara/Math/Vector2.hpp>
@@ -20,7 +21,7 @@ namespace bw
 	{
 		public:
 			inline NetworkPacket(std::string packetName); //< output
-			inline NetworkPacket(std::string packetName, const std::vector<Nz::UInt8>& content); //< input
+			inline NetworkPacket(std::string packetName, const ByteView& content); //< input
 			NetworkPacket(const NetworkPacket&) = delete;
 			NetworkPacket(NetworkPacket&&) = default;
 			~NetworkPacket() = default;
@@ -33,17 +34,23 @@ namespace bw
 			std::string m_packetName;
 	};
 
+	// Incoming packets read directly from the received network packet, they are invalidated once their handler returns
 	class IncomingNetworkPacket : public NetworkPacket
 	{
 		public:
 			inline IncomingNetworkPacket(const NetworkStringStore& stringStore, const Packets::ScriptPacket& packet);
 
+			inline void Invalidate();
+
 			inline double ReadDouble();
 			inline Nz::Int64 ReadCompressedInteger();
 			inline Nz::UInt64 ReadCompressedUnsigned();
 			inline float ReadSingle();
 			inline std::string ReadString();
 			inline Nz::Vector2f ReadVector2();
+
+		private:
+			inline Nz::ByteStream& GetInputStream();
 	};
 
 	class OutgoingNetworkPacket : public NetworkPacket
@@ -51,6 +58,7 @@ namespace bw
 		public:
 			inline OutgoingNetworkPacket(std::string packetName);
 
+			// Returned packet references this object content and has to be sent before it changes
 			Packets::ScriptPacket ToPacket(const NetworkStringStore& stringStore) const;
 			
 			inline void WriteCompressedInteger(Nz::Int64 number);
@@ -5,6 +5,7 @@
 #include <CoreLib/Scripting/NetworkPacket.hpp>
 #include <CoreLib/Protocol/CompressedInteger.hpp>
 #include <cassert>
+#include <stdexcept>
 
 namespace bw
 {
@@ -15,9 +16,8 @@ namespace bw
 	{
 	}
 	
-	inline NetworkPacket::NetworkPacket(std::string packetName, const std::vector<Nz::UInt8>& content) :
-	m_content(std::make_unique<Nz::ByteArray>(content.data(), content.size())),
-	m_stream(m_content.get(), Nz::OpenModeFlags(Nz::OpenMode_ReadOnly)),
+	inline NetworkPacket::NetworkPacket(std::string packetName, const ByteView& content) :
+	m_stream(content.data(), content.size()),
 	m_packetName(std::move(packetName))
 	{
 	}
@@ -27,10 +27,15 @@ namespace bw
 	{
 	}
 
+	inline void IncomingNetworkPacket::Invalidate()
+	{
+		m_stream = Nz::ByteStream();
+	}
+
 	inline double IncomingNetworkPacket::ReadDouble()
 	{
 		double output;
-		m_stream >> output;
+		GetInputStream() >> output;
 
 		return output;
 	}
@@ -38,7 +43,7 @@ namespace bw
 	inline Nz::Int64 IncomingNetworkPacket::ReadCompressedInteger()
 	{
 		CompressedSigned<Nz::Int64> output;
-		m_stream >> output;
+		GetInputStream() >> output;
 
 		return output;
 	}
@@ -46,7 +51,7 @@ namespace bw
 	inline Nz::UInt64 IncomingNetworkPacket::ReadCompressedUnsigned()
 	{
 		CompressedUnsigned<Nz::UInt64> output;
-		m_stream >> output;
+		GetInputStream() >> output;
 
 		return output;
 	}
@@ -54,7 +59,7 @@ namespace bw
 	inline float IncomingNetworkPacket::ReadSingle()
 	{
 		float output;
-		m_stream >> output;
+		GetInputStream() >> output;
 
 		return output;
 	}
@@ -62,7 +67,7 @@ namespace bw
 	inline std::string IncomingNetworkPacket::ReadString()
 	{
 		std::string output;
-		m_stream >> output;
+		GetInputStream() >> output;
 
 		return output;
 	}
@@ -76,6 +81,14 @@ namespace bw
 		return output;
 	}
 
+	inline Nz::ByteStream& IncomingNetworkPacket::GetInputStream()
+	{
+		if (!m_stream.GetStream())
+			throw std::runtime_error("packet can only be read during its handler call");
+
+		return m_stream;
+	}
+
 	inline OutgoingNetworkPacket::OutgoingNetworkPacket(std::string packetName) :
 	NetworkPacket(std::move(packetName))
 	{
@@ -85,7 +98,7 @@ namespace bw
 	{
 		Packets::ScriptPacket packet;
 		packet.nameIndex = stringStore.CheckStringIndex(m_packetName);
-		packet.content.assign(m_content->begin(), m_content->end());
+		packet.content = ByteView(m_content->GetConstBuffer(), m_content->GetSize());
 
 		return packet;
 	}
@@ -16,6 +16,7 @@ namespace bw
 	{
 		bool isNetworked;
 		Nz::UInt16 maxHealth;
+		Nz::UInt8 networkPriority;
 	};
 }
 
@@ -17,6 +17,7 @@ namespace bw
 	class SessionBridge
 	{
 		public:
+			struct OutgoingPacket;
 			struct SessionInfo;
 
 			inline SessionBridge(MatchClientSession* session);
@@ -36,11 +37,19 @@ namespace bw
 			virtual void QueryInfo(std::function<void(const SessionInfo& info)> callback) const = 0;
 
 			virtual void SendPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& data) = 0;
+			virtual void SendPacketBatch(OutgoingPacket* packets, std::size_t packetCount);
 
 			NazaraSignal(OnConnected, Nz::UInt32 /*data*/);
 			NazaraSignal(OnDisconnected, Nz::UInt32 /*data*/);
 			NazaraSignal(OnIncomingPacket, Nz::NetPacket& /*packet*/);
 
+			struct OutgoingPacket
+			{
+				Nz::ENetPacketFlags flags;
+				Nz::UInt8 channelId;
+				Nz::NetPacket packet;
+			};
+
 			struct SessionInfo
 			{
 				Nz::UInt32 ping;
@@ -22,6 +22,9 @@ namespace bw
 			inline SessionManager(MatchSessions* owner);
 			virtual ~SessionManager();
 
+			virtual void BroadcastPacket(MatchClientSession* const* sessions, std::size_t sessionCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet);
+
+			virtual const NetworkReactor* GetNetworkReactor() const;
 			inline MatchSessions* GetOwner();
 
 			virtual void Poll() = 0;
@@ -13,7 +13,11 @@
 #include <CoreLib/Components/InputComponent.hpp>
 #include <CoreLib/Components/NetworkSyncComponent.hpp>
 #include <CoreLib/Components/WeaponWielderComponent.hpp>
+#include <CoreLib/Protocol/EntityRecordBlock.hpp>
+#include <CoreLib/Protocol/Packets.hpp>
 #include <CoreLib/Scripting/ScriptedElement.hpp>
+#include <CoreLib/Utility/DenseEntityMap.hpp>
+#include <CoreLib/Utility/SpatialGrid.hpp>
 #include <Nazara/Core/Signal.hpp>
 #include <Nazara/Math/Angle.hpp>
 #include <Nazara/Math/Vector2.hpp>
@@ -34,21 +38,43 @@ namespace bw
 			struct EntityCreation;
 			struct EntityDestruction;
 			struct EntityMovement;
+			struct EntitySnapshot;
 
 			NetworkSyncSystem(TerrainLayer& layer);
 			~NetworkSyncSystem() = default;
 
-			void CreateEntities(const std::function<void(const EntityCreation* entityCreation, std::size_t entityCount)>& callback) const;
+			void ClearJournal();
+
 			void DeleteEntities(const std::function<void(const EntityDestruction* entityDestruction, std::size_t entityCount)>& callback) const;
+
+			template<typename F> void ForEachEntityInTree(Ndk::EntityId rootId, F&& callback) const;
 			
+			inline const EntitySnapshot& GetEntitySnapshot(Ndk::EntityId entityId) const;
+			inline const EntityRecordBlock& GetHealthRecords() const;
+			inline const EntityRecordBlock& GetInputRecords() const;
+			inline std::size_t GetJournalEnd() const;
 			inline TerrainLayer& GetLayer();
 			inline const TerrainLayer& GetLayer() const;
+			inline const EntityRecordBlock& GetPhysicsRecords() const;
+			inline Ndk::EntityId GetRootEntity(Ndk::EntityId entityId) const;
+			inline const SpatialGrid& GetRootGrid() const;
+			inline const EntityRecordBlock& GetScaleRecords() const;
 			
 			void MoveEntities(const std::function<void(const EntityMovement* entityMovement, std::size_t entityCount)>& callback) const;
 
+			void NotifyNameUpdate(const Ndk::EntityHandle& entity);
+			void NotifyParentUpdate(const Ndk::EntityHandle& entity);
 			void NotifyPhysicsUpdate(const Ndk::EntityHandle& entity);
 			void NotifyScaleUpdate(const Ndk::EntityHandle& entity);
 
+			// Events are journaled once for every reader, the journal isn't modified until it gets cleared
+			template<typename F> void ReadJournal(std::size_t& cursor, F&& handler) const;
+
+			// Snapshots are read by client sessions, they must be refreshed before those are updated
+			void RefreshSnapshots();
+
+			void WriteCreationRecord(Nz::ByteStream& stream, Ndk::EntityId entityId) const;
+
 			static Ndk::SystemIndex systemIndex;
 
 			struct HealthProperties
@@ -150,31 +176,40 @@ namespace bw
 			struct EntityMovement
 			{
 				Ndk::EntityId entityId;
+				Nz::UInt8 priority;
 				Nz::RadianAnglef rotation;
 				Nz::Vector2f position;
 				std::optional<PlayerMovementData> playerMovement;
 				std::optional<PhysicsProperties> physicsProperties;
 			};
 
-			NazaraSignal(OnEntityCreated, NetworkSyncSystem* /*emitter*/, const EntityCreation& /*event*/);
-			NazaraSignal(OnEntityDeath, NetworkSyncSystem* /*emitter*/, const EntityDeath& /*event*/);
-			NazaraSignal(OnEntityDeleted, NetworkSyncSystem* /*emitter*/, const EntityDestruction& /*event*/);
-			NazaraSignal(OnEntityPlayAnimation, NetworkSyncSystem* /*emitter*/, const EntityPlayAnimation& /*event*/);
-			NazaraSignal(OnEntityInvalidated, NetworkSyncSystem* /*emitter*/, const EntityMovement& /*event*/);
-			NazaraSignal(OnEntitiesInputUpdate, NetworkSyncSystem* /*emitter*/, const EntityInputs* /*events*/, std::size_t /*entityCount*/);
-			NazaraSignal(OnEntitiesHealthUpdate, NetworkSyncSystem* /*emitter*/, const EntityHealth* /*events*/, std::size_t /*entityCount*/);
-			NazaraSignal(OnEntitiesPhysicsUpdate, NetworkSyncSystem* /*emitter*/, const EntityPhysics* /*events*/, std::size_t /*entityCount*/);
-			NazaraSignal(OnEntitiesScaleUpdate, NetworkSyncSystem* /*emitter*/, const EntityScale* /*events*/, std::size_t /*entityCount*/);
-			NazaraSignal(OnEntitiesWeaponUpdate, NetworkSyncSystem* /*emitter*/, const EntityWeapon* /*events*/, std::size_t /*entityCount*/);
+			struct EntitySnapshot
+			{
+				EntityCreation creation;
+				EntityRecordBlock record; //< encoded creation, empty if the entity state changes without notification
+			};
 
 		private:
 			void BuildEvent(EntityCreation& creationEvent, Ndk::Entity* entity) const;
 			void BuildEvent(EntityDeath& deathEvent, Ndk::Entity* entity) const;
 			void BuildEvent(EntityDestruction& deleteEvent, Ndk::Entity* entity) const;
 			void BuildEvent(EntityMovement& movementEvent, Ndk::Entity* entity) const;
+			void BuildEntityData(const EntityCreation& creationEvent, Packets::Helper::EntityData& entityData) const;
+			void BuildEntityState(Packets::Helper::EntityData& entityData, Ndk::Entity* entity) const;
+
+			static Nz::Vector2f GetEntityPosition(Ndk::Entity* entity);
+			static bool HasVolatileState(Ndk::Entity* entity);
+
+			void AddToHierarchy(Ndk::Entity* entity);
+			void RemoveFromHierarchy(Ndk::EntityId entityId);
+
+			enum class JournalEventType;
+			inline void PushJournalEntry(JournalEventType type, std::size_t eventIndex, std::size_t eventCount = 1);
+
 
 			void OnEntityAdded(Ndk::Entity* entity) override;
 			void OnEntityRemoved(Ndk::Entity* entity) override;
+			void OnEntityValidation(Ndk::Entity* entity, bool justAdded) override;
 			void OnUpdate(float elapsedTime) override;
 
 			struct EntitySlots
@@ -187,6 +222,32 @@ namespace bw
 				NazaraSlot(WeaponWielderComponent, OnNewWeaponSelection, onNewWeaponSelection);
 			};
 
+			enum class JournalEventType
+			{
+				Creation,
+				Death,
+				Destruction,
+				HealthUpdate,
+				InputUpdate,
+				Invalidation,
+				PhysicsUpdate,
+				PlayAnimation,
+				ScaleUpdate,
+				WeaponUpdate
+			};
+
+			struct JournalEntry
+			{
+				JournalEventType type;
+				std::size_t eventIndex; //< index of the (first) event in the array of its type
+				std::size_t eventCount;
+			};
+
+			static constexpr float RootGridCellSize = 512.f;
+
+			// Only root entities are stored in the grid, children are positioned relative to their parent
+			tsl::hopscotch_map<Ndk::EntityId, std::vector<Ndk::EntityId>> m_entityChildren;
+			tsl::hopscotch_map<Ndk::EntityId, Ndk::EntityId> m_entityParents;
 			tsl::hopscotch_map<Ndk::EntityId, EntitySlots> m_entitySlots;
 
 			Ndk::EntityList m_inputUpdateEntities;
@@ -195,17 +256,28 @@ namespace bw
 			Ndk::EntityList m_physicsEntities;
 			Ndk::EntityList m_physicsUpdateEntities;
 			Ndk::EntityList m_scaleUpdateEntities;
+			Ndk::EntityList m_snapshotUpdateEntities;
 			Ndk::EntityList m_staticEntities;
 			Ndk::EntityList m_weaponUpdateEntities;
-			mutable std::vector<EntityCreation> m_creationEvents;
-			mutable std::vector<EntityDestruction> m_destructionEvents;
+			DenseEntityMap<EntitySnapshot> m_entitySnapshots;
 			std::vector<EntityHealth> m_healthEvents;
 			std::vector<EntityInputs> m_inputEvents;
 			std::vector<EntityPhysics> m_physicsEvent;
 			std::vector<EntityScale> m_scaleEvent;
 			std::vector<EntityWeapon> m_weaponEvents;
-			mutable std::vector<EntityMovement> m_movementEvents;
+			std::vector<EntityCreation> m_journalCreations;
+			std::vector<EntityDeath> m_journalDeaths;
+			std::vector<EntityDestruction> m_journalDestructions;
+			std::vector<EntityMovement> m_journalInvalidations;
+			std::vector<EntityPlayAnimation> m_journalPlayAnimations;
+			std::vector<JournalEntry> m_journal;
+			EntityRecordBlock m_healthRecords;
+			EntityRecordBlock m_inputRecords;
+			EntityRecordBlock m_physicsRecords;
+			EntityRecordBlock m_scaleRecords;
+			SpatialGrid m_rootGrid;
 			TerrainLayer& m_layer;
+			std::size_t m_journalStart; //< sequence number of the first journal entry
 	};
 }
 
@@ -3,9 +3,43 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/Systems/NetworkSyncSystem.hpp>
+#include <cassert>
 
 namespace bw
 {
+	template<typename F>
+	void NetworkSyncSystem::ForEachEntityInTree(Ndk::EntityId rootId, F&& callback) const
+	{
+		callback(rootId);
+
+		auto it = m_entityChildren.find(rootId);
+		if (it == m_entityChildren.end())
+			return;
+
+		for (Ndk::EntityId childId : it->second)
+			ForEachEntityInTree(childId, callback);
+	}
+
+	inline auto NetworkSyncSystem::GetEntitySnapshot(Ndk::EntityId entityId) const -> const EntitySnapshot&
+	{
+		return m_entitySnapshots.Get(entityId);
+	}
+
+	inline const EntityRecordBlock& NetworkSyncSystem::GetHealthRecords() const
+	{
+		return m_healthRecords;
+	}
+
+	inline const EntityRecordBlock& NetworkSyncSystem::GetInputRecords() const
+	{
+		return m_inputRecords;
+	}
+
+	inline std::size_t NetworkSyncSystem::GetJournalEnd() const
+	{
+		return m_journalStart + m_journal.size();
+	}
+
 	inline TerrainLayer& NetworkSyncSystem::GetLayer()
 	{
 		return m_layer;
@@ -15,4 +49,87 @@ namespace bw
 	{
 		return m_layer;
 	}
+
+	inline const EntityRecordBlock& NetworkSyncSystem::GetPhysicsRecords() const
+	{
+		return m_physicsRecords;
+	}
+
+	inline Ndk::EntityId NetworkSyncSystem::GetRootEntity(Ndk::EntityId entityId) const
+	{
+		for (auto it = m_entityParents.find(entityId); it != m_entityParents.end(); it = m_entityParents.find(entityId))
+			entityId = it->second;
+
+		return entityId;
+	}
+
+	inline const SpatialGrid& NetworkSyncSystem::GetRootGrid() const
+	{
+		return m_rootGrid;
+	}
+
+	inline const EntityRecordBlock& NetworkSyncSystem::GetScaleRecords() const
+	{
+		return m_scaleRecords;
+	}
+
+	template<typename F>
+	void NetworkSyncSystem::ReadJournal(std::size_t& cursor, F&& handler) const
+	{
+		assert(cursor >= m_journalStart); //< Events were cleared before being read
+
+		for (std::size_t i = cursor - m_journalStart; i < m_journal.size(); ++i)
+		{
+			const JournalEntry& entry = m_journal[i];
+			switch (entry.type)
+			{
+				case JournalEventType::Creation:
+					handler(m_journalCreations[entry.eventIndex]);
+					break;
+
+				case JournalEventType::Death:
+					handler(m_journalDeaths[entry.eventIndex]);
+					break;
+
+				case JournalEventType::Destruction:
+					handler(m_journalDestructions[entry.eventIndex]);
+					break;
+
+				case JournalEventType::HealthUpdate:
+					handler(&m_healthEvents[entry.eventIndex], entry.eventCount);
+					break;
+
+				case JournalEventType::InputUpdate:
+					handler(&m_inputEvents[entry.eventIndex], entry.eventCount);
+					break;
+
+				case JournalEventType::Invalidation:
+					handler(m_journalInvalidations[entry.eventIndex]);
+					break;
+
+				case JournalEventType::PhysicsUpdate:
+					handler(&m_physicsEvent[entry.eventIndex], entry.eventCount);
+					break;
+
+				case JournalEventType::PlayAnimation:
+					handler(m_journalPlayAnimations[entry.eventIndex]);
+					break;
+
+				case JournalEventType::ScaleUpdate:
+					handler(&m_scaleEvent[entry.eventIndex], entry.eventCount);
+					break;
+
+				case JournalEventType::WeaponUpdate:
+					handler(&m_weaponEvents[entry.eventIndex], entry.eventCount);
+					break;
+			}
+		}
+
+		cursor = GetJournalEnd();
+	}
+
+	inline void NetworkSyncSystem::PushJournalEntry(JournalEventType type, std::size_t eventIndex, std::size_t eventCount)
+	{
+		m_journal.push_back(JournalEntry{ type, eventIndex, eventCount });
+	}
 }
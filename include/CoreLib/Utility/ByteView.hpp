@@ -0,0 +1,47 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_BYTEVIEW_HPP
+#define BURGWAR_CORELIB_BYTEVIEW_HPP
+
+#include <Nazara/Prerequisites.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace bw
+{
+	// Non-owning view over a contiguous byte buffer, the viewed memory must outlive the view
+	class ByteView
+	{
+		public:
+			inline ByteView();
+			inline ByteView(const Nz::UInt8* data, std::size_t size);
+			inline ByteView(const std::vector<Nz::UInt8>& content);
+			ByteView(const ByteView&) = default;
+			~ByteView() = default;
+
+			inline const Nz::UInt8* begin() const;
+
+			inline const Nz::UInt8* data() const;
+
+			inline bool empty() const;
+			inline const Nz::UInt8* end() const;
+
+			inline std::size_t size() const;
+
+			inline std::vector<Nz::UInt8> ToVector() const;
+
+			ByteView& operator=(const ByteView&) = default;
+
+		private:
+			const Nz::UInt8* m_data;
+			std::size_t m_size;
+	};
+}
+
+#include <CoreLib/Utility/ByteView.inl>
+
+#endif
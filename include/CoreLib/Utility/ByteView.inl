@@ -0,0 +1,55 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Utility/ByteView.hpp>
+
+namespace bw
+{
+	inline ByteView::ByteView() :
+	m_data(nullptr),
+	m_size(0)
+	{
+	}
+
+	inline ByteView::ByteView(const Nz::UInt8* data, std::size_t size) :
+	m_data(data),
+	m_size(size)
+	{
+	}
+
+	inline ByteView::ByteView(const std::vector<Nz::UInt8>& content) :
+	ByteView(content.data(), content.size())
+	{
+	}
+
+	inline const Nz::UInt8* ByteView::begin() const
+	{
+		return m_data;
+	}
+
+	inline const Nz::UInt8* ByteView::data() const
+	{
+		return m_data;
+	}
+
+	inline bool ByteView::empty() const
+	{
+		return m_size == 0;
+	}
+
+	inline const Nz::UInt8* ByteView::end() const
+	{
+		return m_data + m_size;
+	}
+
+	inline std::size_t ByteView::size() const
+	{
+		return m_size;
+	}
+
+	inline std::vector<Nz::UInt8> ByteView::ToVector() const
+	{
+		return std::vector<Nz::UInt8>(begin(), end());
+	}
+}
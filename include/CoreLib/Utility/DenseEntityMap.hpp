@@ -0,0 +1,57 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_DENSEENTITYMAP_HPP
+#define BURGWAR_CORELIB_DENSEENTITYMAP_HPP
+
+#include <Nazara/Prerequisites.hpp>
+#include <Nazara/Core/Bitset.hpp>
+#include <vector>
+
+namespace bw
+{
+	// Map of entity ids to values stored in an array indexed by id, as entity ids are small and dense in a world
+	template<typename T>
+	class DenseEntityMap
+	{
+		public:
+			DenseEntityMap();
+			DenseEntityMap(const DenseEntityMap&) = default;
+			DenseEntityMap(DenseEntityMap&&) noexcept = default;
+			~DenseEntityMap() = default;
+
+			void Clear();
+
+			bool Contains(Nz::UInt32 id) const;
+
+			bool Erase(Nz::UInt32 id);
+
+			// Iterates by increasing id, callback may erase entries (including the current one)
+			template<typename F> void ForEach(F&& callback);
+
+			T& Get(Nz::UInt32 id);
+			const T& Get(Nz::UInt32 id) const;
+			std::size_t GetSize() const;
+
+			T& Insert(Nz::UInt32 id, T value);
+
+			bool IsEmpty() const;
+
+			void Reserve(std::size_t idCount);
+
+			DenseEntityMap& operator=(const DenseEntityMap&) = default;
+			DenseEntityMap& operator=(DenseEntityMap&&) noexcept = default;
+
+		private:
+			Nz::Bitset<Nz::UInt64> m_entities;
+			std::vector<T> m_values;
+			std::size_t m_size;
+	};
+}
+
+#include <CoreLib/Utility/DenseEntityMap.inl>
+
+#endif
@@ -0,0 +1,100 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Utility/DenseEntityMap.hpp>
+#include <cassert>
+#include <utility>
+
+namespace bw
+{
+	template<typename T>
+	DenseEntityMap<T>::DenseEntityMap() :
+	m_size(0)
+	{
+	}
+
+	template<typename T>
+	void DenseEntityMap<T>::Clear()
+	{
+		// Values are kept in place (and overwritten on insertion) to avoid reallocations
+		m_entities.Clear();
+		m_size = 0;
+	}
+
+	template<typename T>
+	bool DenseEntityMap<T>::Contains(Nz::UInt32 id) const
+	{
+		return m_entities.UnboundedTest(id);
+	}
+
+	template<typename T>
+	bool DenseEntityMap<T>::Erase(Nz::UInt32 id)
+	{
+		if (!m_entities.UnboundedTest(id))
+			return false;
+
+		m_entities.Reset(id);
+		m_size--;
+
+		return true;
+	}
+
+	template<typename T>
+	template<typename F>
+	void DenseEntityMap<T>::ForEach(F&& callback)
+	{
+		for (std::size_t id = m_entities.FindFirst(); id != m_entities.npos; id = m_entities.FindNext(id))
+			callback(static_cast<Nz::UInt32>(id), m_values[id]);
+	}
+
+	template<typename T>
+	T& DenseEntityMap<T>::Get(Nz::UInt32 id)
+	{
+		assert(Contains(id));
+		return m_values[id];
+	}
+
+	template<typename T>
+	const T& DenseEntityMap<T>::Get(Nz::UInt32 id) const
+	{
+		assert(Contains(id));
+		return m_values[id];
+	}
+
+	template<typename T>
+	std::size_t DenseEntityMap<T>::GetSize() const
+	{
+		return m_size;
+	}
+
+	template<typename T>
+	T& DenseEntityMap<T>::Insert(Nz::UInt32 id, T value)
+	{
+		Reserve(std::size_t(id) + 1);
+
+		if (!m_entities.UnboundedTest(id))
+		{
+			m_entities.UnboundedSet(id);
+			m_size++;
+		}
+
+		T& entry = m_values[id];
+		entry = std::move(value);
+
+		return entry;
+	}
+
+	template<typename T>
+	bool DenseEntityMap<T>::IsEmpty() const
+	{
+		return m_size == 0;
+	}
+
+	template<typename T>
+	void DenseEntityMap<T>::Reserve(std::size_t idCount)
+	{
+		if (m_values.size() < idCount)
+			m_values.resize(idCount);
+	}
+}
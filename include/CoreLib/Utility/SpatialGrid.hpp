@@ -0,0 +1,62 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_SPATIALGRID_HPP
+#define BURGWAR_CORELIB_SPATIALGRID_HPP
+
+#include <Nazara/Prerequisites.hpp>
+#include <Nazara/Math/Rect.hpp>
+#include <Nazara/Math/Vector2.hpp>
+#include <Thirdparty/tsl/hopscotch_map.h>
+#include <vector>
+
+namespace bw
+{
+	// Sparse uniform grid of points, query cost depends on the number of points near the queried area
+	class SpatialGrid
+	{
+		public:
+			inline SpatialGrid(float cellSize);
+			SpatialGrid(const SpatialGrid&) = delete;
+			SpatialGrid(SpatialGrid&&) noexcept = default;
+			~SpatialGrid() = default;
+
+			inline void Clear();
+
+			template<typename F> void ForEachInRect(const Nz::Rectf& rect, F&& callback) const;
+
+			inline const Nz::Vector2f* GetPosition(Nz::UInt32 id) const;
+
+			inline void Insert(Nz::UInt32 id, const Nz::Vector2f& position);
+
+			inline void Move(Nz::UInt32 id, const Nz::Vector2f& position);
+
+			inline void Remove(Nz::UInt32 id);
+
+			SpatialGrid& operator=(const SpatialGrid&) = delete;
+			SpatialGrid& operator=(SpatialGrid&&) noexcept = default;
+
+		private:
+			inline Nz::Vector2i GetCell(const Nz::Vector2f& position) const;
+			inline void RemoveFromCell(Nz::UInt64 cellKey, Nz::UInt32 id);
+
+			static inline Nz::UInt64 GetCellKey(const Nz::Vector2i& cell);
+
+			struct Entry
+			{
+				Nz::Vector2f position;
+				Nz::UInt64 cellKey;
+			};
+
+			tsl::hopscotch_map<Nz::UInt64 /*cellKey*/, std::vector<Nz::UInt32>> m_cells;
+			tsl::hopscotch_map<Nz::UInt32 /*id*/, Entry> m_entries;
+			float m_invCellSize;
+	};
+}
+
+#include <CoreLib/Utility/SpatialGrid.inl>
+
+#endif
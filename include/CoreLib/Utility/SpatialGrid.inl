@@ -0,0 +1,140 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Utility/SpatialGrid.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace bw
+{
+	inline SpatialGrid::SpatialGrid(float cellSize) :
+	m_invCellSize(1.f / cellSize)
+	{
+		assert(cellSize > 0.f);
+	}
+
+	inline void SpatialGrid::Clear()
+	{
+		m_cells.clear();
+		m_entries.clear();
+	}
+
+	template<typename F>
+	void SpatialGrid::ForEachInRect(const Nz::Rectf& rect, F&& callback) const
+	{
+		Nz::Vector2i minCell = GetCell(rect.GetCorner(Nz::RectCorner_LeftTop));
+		Nz::Vector2i maxCell = GetCell(rect.GetCorner(Nz::RectCorner_RightBottom));
+
+		auto CheckCell = [&](const std::vector<Nz::UInt32>& cellEntries)
+		{
+			for (Nz::UInt32 id : cellEntries)
+			{
+				auto it = m_entries.find(id);
+				assert(it != m_entries.end());
+
+				if (rect.Contains(it->second.position))
+					callback(id, it->second.position);
+			}
+		};
+
+		// Huge rects would visit many empty cells, iterate on occupied cells instead
+		Nz::UInt64 cellCount = Nz::UInt64(Nz::Int64(maxCell.x) - minCell.x + 1) * Nz::UInt64(Nz::Int64(maxCell.y) - minCell.y + 1);
+		if (cellCount > m_cells.size())
+		{
+			for (auto&& pair : m_cells)
+				CheckCell(pair.second);
+
+			return;
+		}
+
+		for (int y = minCell.y; y <= maxCell.y; ++y)
+		{
+			for (int x = minCell.x; x <= maxCell.x; ++x)
+			{
+				auto it = m_cells.find(GetCellKey(Nz::Vector2i(x, y)));
+				if (it != m_cells.end())
+					CheckCell(it->second);
+			}
+		}
+	}
+
+	inline const Nz::Vector2f* SpatialGrid::GetPosition(Nz::UInt32 id) const
+	{
+		auto it = m_entries.find(id);
+		if (it == m_entries.end())
+			return nullptr;
+
+		return &it->second.position;
+	}
+
+	inline void SpatialGrid::Insert(Nz::UInt32 id, const Nz::Vector2f& position)
+	{
+		Nz::UInt64 cellKey = GetCellKey(GetCell(position));
+
+		assert(m_entries.find(id) == m_entries.end());
+		m_entries.emplace(id, Entry{ position, cellKey });
+		m_cells[cellKey].push_back(id);
+	}
+
+	inline void SpatialGrid::Move(Nz::UInt32 id, const Nz::Vector2f& position)
+	{
+		auto it = m_entries.find(id);
+		assert(it != m_entries.end());
+
+		Entry& entry = it.value();
+		entry.position = position;
+
+		Nz::UInt64 cellKey = GetCellKey(GetCell(position));
+		if (cellKey == entry.cellKey)
+			return;
+
+		RemoveFromCell(entry.cellKey, id);
+		m_cells[cellKey].push_back(id);
+		entry.cellKey = cellKey;
+	}
+
+	inline void SpatialGrid::Remove(Nz::UInt32 id)
+	{
+		auto it = m_entries.find(id);
+		assert(it != m_entries.end());
+
+		RemoveFromCell(it->second.cellKey, id);
+		m_entries.erase(it);
+	}
+
+	inline Nz::Vector2i SpatialGrid::GetCell(const Nz::Vector2f& position) const
+	{
+		// Keep far away positions in range of integer coordinates
+		constexpr float MaxCoord = float(1 << 30);
+
+		return Nz::Vector2i(
+			int(std::clamp(std::floor(position.x * m_invCellSize), -MaxCoord, MaxCoord)),
+			int(std::clamp(std::floor(position.y * m_invCellSize), -MaxCoord, MaxCoord))
+		);
+	}
+
+	inline void SpatialGrid::RemoveFromCell(Nz::UInt64 cellKey, Nz::UInt32 id)
+	{
+		auto cellIt = m_cells.find(cellKey);
+		assert(cellIt != m_cells.end());
+
+		std::vector<Nz::UInt32>& cellEntries = cellIt.value();
+
+		auto entryIt = std::find(cellEntries.begin(), cellEntries.end(), id);
+		assert(entryIt != cellEntries.end());
+
+		// Order doesn't matter
+		std::swap(*entryIt, cellEntries.back());
+		cellEntries.pop_back();
+
+		if (cellEntries.empty())
+			m_cells.erase(cellIt);
+	}
+
+	inline Nz::UInt64 SpatialGrid::GetCellKey(const Nz::Vector2i& cell)
+	{
+		return Nz::UInt64(Nz::UInt32(cell.x)) << 32 | Nz::UInt32(cell.y);
+	}
+}
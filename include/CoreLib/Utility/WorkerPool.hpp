@@ -0,0 +1,57 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_CORELIB_WORKERPOOL_HPP
+#define BURGWAR_CORELIB_WORKERPOOL_HPP
+
+#include <Nazara/Prerequisites.hpp>
+#include <Nazara/Core/Thread.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace bw
+{
+	// Fixed set of threads running the iterations of a loop alongside the calling thread
+	class WorkerPool
+	{
+		public:
+			WorkerPool(std::size_t workerCount);
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool(WorkerPool&&) = delete;
+			~WorkerPool();
+
+			void ForEach(std::size_t count, const std::function<void(std::size_t index)>& func);
+
+			inline std::size_t GetWorkerCount() const;
+
+			WorkerPool& operator=(const WorkerPool&) = delete;
+			WorkerPool& operator=(WorkerPool&&) = delete;
+
+		private:
+			void ProcessJob();
+			void WorkerThread();
+
+			std::atomic_size_t m_nextIndex;
+			std::condition_variable m_doneSignal;
+			std::condition_variable m_jobSignal;
+			std::exception_ptr m_exception;
+			std::mutex m_mutex;
+			std::size_t m_activeWorkerCount;
+			std::size_t m_jobSize;
+			std::vector<Nz::Thread> m_workers;
+			const std::function<void(std::size_t index)>* m_job;
+			Nz::UInt64 m_jobGeneration;
+			bool m_running;
+	};
+}
+
+#include <CoreLib/Utility/WorkerPool.inl>
+
+#endif
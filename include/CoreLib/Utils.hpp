@@ -12,6 +12,7 @@
 #include <Nazara/Math/Vector2.hpp>
 #include <Nazara/Math/Vector3.hpp>
 #include <cctype>
+#include <optional>
 #include <string>
 #include <type_traits>
 
@@ -71,6 +72,7 @@ namespace bw
 	std::string ByteToString(Nz::UInt64 bytes, bool speed = false);
 	Nz::Vector3f DampenedString(const Nz::Vector3f& currentPos, const Nz::Vector3f& targetPos, float frametime, float springStrength = 3.f);
 	template<typename T> bool IsMoreRecent(T a, T b);
+	inline void RegisterReceivedTick(Nz::UInt16 tick, std::optional<Nz::UInt16>& lastTick, Nz::UInt32& previousTickBits);
 	inline std::string ReplaceStr(std::string str, const std::string_view& from, const std::string_view& to);
 	template<typename F> bool SplitString(const std::string_view& str, const std::string_view& token, F&& func);
 	template<typename F> bool SplitStringAny(const std::string_view& str, const std::string_view& token, F&& func);
@@ -59,6 +59,34 @@ namespace bw
 		return false;
 	}
 
+	void RegisterReceivedTick(Nz::UInt16 tick, std::optional<Nz::UInt16>& lastTick, Nz::UInt32& previousTickBits)
+	{
+		// Bit N of previousTickBits is set if lastTick - N - 1 was received
+		if (!lastTick)
+		{
+			lastTick = tick;
+			previousTickBits = 0;
+		}
+		else if (IsMoreRecent(tick, *lastTick))
+		{
+			Nz::UInt16 shift = static_cast<Nz::UInt16>(tick - *lastTick);
+			if (shift < 32)
+				previousTickBits = (previousTickBits << shift) | (Nz::UInt32(1) << (shift - 1));
+			else if (shift == 32)
+				previousTickBits = Nz::UInt32(1) << 31;
+			else
+				previousTickBits = 0;
+
+			lastTick = tick;
+		}
+		else if (tick != *lastTick)
+		{
+			Nz::UInt16 age = static_cast<Nz::UInt16>(*lastTick - tick);
+			if (age <= 32)
+				previousTickBits |= Nz::UInt32(1) << (age - 1);
+		}
+	}
+
 	std::string ReplaceStr(std::string str, const std::string_view& from, const std::string_view& to)
 	{
 		if (str.empty())
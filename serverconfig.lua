@@ -10,3 +10,8 @@ GameSettings = {
 	MapFile = "mapdetest.bmap",
 	TickRate = 33,
 }
+ServerSettings = {
+	NetworkThreadCount = 1, -- each network thread listens on its own UDP port, starting from 14768 (14768, 14769, ...)
+	PeerBandwidthBudget = 0, -- bytes per second and per client, 0 means unlimited
+	SessionThreadCount = 1 -- threads sending entity updates to clients, including the game thread
+}
@@ -0,0 +1,207 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <Bots/Bot.hpp>
+#include <CoreLib/BurgApp.hpp>
+#include <CoreLib/Utils.hpp>
+#include <CoreLib/LogSystem/Logger.hpp>
+
+namespace bw
+{
+	Bot::Bot(BurgApp& app, std::size_t botIndex, float inputChangeInterval) :
+	m_randomGenerator(static_cast<std::mt19937::result_type>(botIndex)),
+	m_botIndex(botIndex),
+	m_localPlayerCount(0),
+	m_app(app),
+	m_session(app),
+	m_correctionTick(0),
+	m_estimatedServerTick(0),
+	m_inputTick(0),
+	m_lastMatchStateTick(0),
+	m_acknowledgedStateBits(0),
+	m_isInMatch(false),
+	m_inputChangeInterval(inputChangeInterval),
+	m_inputChangeTimer(0.f),
+	m_tickDuration(0.f),
+	m_tickTimer(0.f)
+	{
+		m_session.OnConnected.Connect([this](ClientSession*)
+		{
+			Packets::Auth authPacket;
+			authPacket.players.emplace_back().nickname = "Bot #" + std::to_string(m_botIndex + 1);
+
+			m_session.SendPacket(authPacket);
+		});
+
+		m_session.OnDisconnected.Connect([this](ClientSession*)
+		{
+			bwLog(m_app.GetLogger(), LogLevel::Warning, "Bot #{0} has been disconnected", m_botIndex + 1);
+			m_isInMatch = false;
+		});
+
+		m_session.OnAuthFailure.Connect([this](ClientSession*, const Packets::AuthFailure& /*authFailure*/)
+		{
+			bwLog(m_app.GetLogger(), LogLevel::Error, "Bot #{0} failed to authenticate", m_botIndex + 1);
+		});
+
+		m_session.OnAuthSuccess.Connect([this](ClientSession*, const Packets::AuthSuccess& authSuccess)
+		{
+			m_localPlayerCount = authSuccess.players.size();
+		});
+
+		m_session.OnInputTimingCorrection.Connect([this](ClientSession*, const Packets::InputTimingCorrection& timingCorrection)
+		{
+			HandleInputTimingCorrection(timingCorrection);
+		});
+
+		m_session.OnMatchData.Connect([this](ClientSession*, const Packets::MatchData& matchData)
+		{
+			HandleMatchData(matchData);
+		});
+
+		m_session.OnMatchState.Connect([this](ClientSession*, const Packets::MatchState& matchState)
+		{
+			HandleMatchState(matchState);
+		});
+	}
+
+	auto Bot::CollectStats() -> Stats
+	{
+		// Session info is retrieved asynchronously, traffic will be reported on next call
+		m_session.QuerySessionInfo([this](const SessionBridge::SessionInfo& sessionInfo)
+		{
+			if (m_lastSessionInfo)
+			{
+				m_stats.receivedBytes += sessionInfo.totalByteReceived - m_lastSessionInfo->totalByteReceived;
+				m_stats.sentBytes += sessionInfo.totalByteSent - m_lastSessionInfo->totalByteSent;
+			}
+
+			m_lastSessionInfo = sessionInfo;
+		});
+
+		Stats stats = m_stats;
+		m_stats = Stats{};
+
+		return stats;
+	}
+
+	void Bot::Connect(std::shared_ptr<SessionBridge> sessionBridge)
+	{
+		m_session.Connect(std::move(sessionBridge));
+	}
+
+	void Bot::Update(float elapsedTime)
+	{
+		if (!m_isInMatch)
+			return;
+
+		m_inputChangeTimer -= elapsedTime;
+		if (m_inputChangeTimer < 0.f)
+		{
+			RandomizeInputs();
+			m_inputChangeTimer += m_inputChangeInterval;
+		}
+
+		m_tickTimer += elapsedTime;
+		while (m_tickTimer >= m_tickDuration)
+		{
+			m_tickTimer -= m_tickDuration;
+
+			SendInputs();
+			m_estimatedServerTick++;
+		}
+	}
+
+	void Bot::HandleInputTimingCorrection(const Packets::InputTimingCorrection& timingCorrection)
+	{
+		m_stats.timingCorrectionCount++;
+
+		Nz::Int32 tickError = timingCorrection.tickError;
+		if (tickError == 0)
+			return;
+
+		m_stats.timingErrorCount++;
+
+		// Inputs sent before our last correction were already off, don't correct the same error twice
+		if (IsMoreRecent(m_correctionTick, timingCorrection.serverTick))
+			return;
+
+		m_estimatedServerTick = static_cast<Nz::UInt16>(m_estimatedServerTick - tickError);
+		m_correctionTick = m_estimatedServerTick;
+	}
+
+	void Bot::HandleMatchData(const Packets::MatchData& matchData)
+	{
+		// Bots don't run scripts, there's no need to download assets or scripts before joining
+		m_correctionTick = matchData.currentTick;
+		m_estimatedServerTick = matchData.currentTick;
+		m_tickDuration = matchData.tickDuration;
+		m_tickTimer = 0.f;
+
+		m_isInMatch = true;
+
+		m_session.SendPacket(Packets::Ready{});
+
+		bwLog(m_app.GetLogger(), LogLevel::Info, "Bot #{0} joined the match", m_botIndex + 1);
+	}
+
+	void Bot::HandleMatchState(const Packets::MatchState& matchState)
+	{
+		m_stats.matchStateCount++;
+
+		Nz::UInt64 now = m_app.GetAppTime();
+		if (m_lastMatchStateTime && IsMoreRecent(matchState.stateTick, m_lastMatchStateTick))
+		{
+			m_stats.stateTickCount += static_cast<Nz::UInt16>(matchState.stateTick - m_lastMatchStateTick);
+			m_stats.stateIntervalTime += now - *m_lastMatchStateTime;
+		}
+
+		m_lastMatchStateTick = matchState.stateTick;
+		m_lastMatchStateTime = now;
+
+		RegisterReceivedTick(matchState.stateTick, m_acknowledgedStateTick, m_acknowledgedStateBits);
+
+		// A predicting client would replay every input the server didn't handle yet
+		Nz::UInt16 lastSentInputTick = static_cast<Nz::UInt16>(m_inputTick - 1);
+		if (IsMoreRecent(lastSentInputTick, matchState.lastInputTick))
+			m_stats.replayedInputCount += static_cast<Nz::UInt16>(lastSentInputTick - matchState.lastInputTick);
+	}
+
+	void Bot::RandomizeInputs()
+	{
+		std::bernoulli_distribution halfChance(0.5);
+		std::bernoulli_distribution lowChance(0.1);
+		std::uniform_real_distribution<float> aimDis(-1.f, 1.f);
+
+		PlayerInputData& inputs = m_inputController.GetInputs();
+		inputs.aimDirection = Nz::Vector2f(aimDis(m_randomGenerator), aimDis(m_randomGenerator));
+		if (inputs.aimDirection.GetSquaredLength() > 0.f)
+			inputs.aimDirection.Normalize();
+		else
+			inputs.aimDirection = Nz::Vector2f::UnitX();
+
+		inputs.isAttacking = halfChance(m_randomGenerator);
+		inputs.isCrouching = lowChance(m_randomGenerator);
+		inputs.isJumping = halfChance(m_randomGenerator);
+		inputs.isMovingLeft = halfChance(m_randomGenerator);
+		inputs.isMovingRight = !inputs.isMovingLeft && halfChance(m_randomGenerator);
+		inputs.isLookingRight = inputs.aimDirection.x >= 0.f;
+	}
+
+	void Bot::SendInputs()
+	{
+		Packets::PlayersInput inputPacket;
+		inputPacket.estimatedServerTick = m_estimatedServerTick;
+		inputPacket.inputTick = m_inputTick++;
+
+		// Bots don't use entity states but still acknowledge them to exercise server delta encoding
+		inputPacket.lastStateTick = m_acknowledgedStateTick;
+		inputPacket.previousStateBits = m_acknowledgedStateBits;
+
+		for (std::size_t i = 0; i < m_localPlayerCount; ++i)
+			inputPacket.inputs.emplace_back(m_inputController.GetInputs());
+
+		m_session.SendPacket(inputPacket);
+	}
+}
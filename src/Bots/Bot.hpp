@@ -0,0 +1,88 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_BOT_HPP
+#define BURGWAR_BOT_HPP
+
+#include <CoreLib/SessionBridge.hpp>
+#include <ClientLib/ClientSession.hpp>
+#include <ClientLib/DummyInputController.hpp>
+#include <memory>
+#include <optional>
+#include <random>
+
+namespace bw
+{
+	class BurgApp;
+
+	// Headless player, sending random inputs without simulating the match
+	class Bot
+	{
+		public:
+			struct Stats;
+
+			Bot(BurgApp& app, std::size_t botIndex, float inputChangeInterval);
+			Bot(const Bot&) = delete;
+			Bot(Bot&&) = delete;
+			~Bot() = default;
+
+			Stats CollectStats();
+			void Connect(std::shared_ptr<SessionBridge> sessionBridge);
+
+			inline bool IsConnected() const;
+			inline bool IsInMatch() const;
+
+			void Update(float elapsedTime);
+
+			Bot& operator=(const Bot&) = delete;
+			Bot& operator=(Bot&&) = delete;
+
+			// Counters since the last CollectStats call
+			struct Stats
+			{
+				Nz::UInt64 receivedBytes = 0;
+				Nz::UInt64 sentBytes = 0;
+				Nz::UInt64 matchStateCount = 0;
+				Nz::UInt64 replayedInputCount = 0; //< inputs a predicting client would have to replay on reconciliation
+				Nz::UInt64 stateTickCount = 0;
+				Nz::UInt64 stateIntervalTime = 0; //< milliseconds elapsed between match states, over stateTickCount ticks (includes network jitter, not the server tick cost)
+				Nz::UInt64 timingCorrectionCount = 0;
+				Nz::UInt64 timingErrorCount = 0;
+			};
+
+		private:
+			void HandleInputTimingCorrection(const Packets::InputTimingCorrection& timingCorrection);
+			void HandleMatchData(const Packets::MatchData& matchData);
+			void HandleMatchState(const Packets::MatchState& matchState);
+			void RandomizeInputs();
+			void SendInputs();
+
+			std::optional<Nz::UInt16> m_acknowledgedStateTick;
+			std::optional<Nz::UInt64> m_lastMatchStateTime;
+			std::optional<SessionBridge::SessionInfo> m_lastSessionInfo;
+			std::mt19937 m_randomGenerator;
+			std::size_t m_botIndex;
+			std::size_t m_localPlayerCount;
+			BurgApp& m_app;
+			ClientSession m_session;
+			DummyInputController m_inputController;
+			Stats m_stats;
+			Nz::UInt16 m_correctionTick;
+			Nz::UInt16 m_estimatedServerTick;
+			Nz::UInt16 m_inputTick;
+			Nz::UInt16 m_lastMatchStateTick;
+			Nz::UInt32 m_acknowledgedStateBits;
+			bool m_isInMatch;
+			float m_inputChangeInterval;
+			float m_inputChangeTimer;
+			float m_tickDuration;
+			float m_tickTimer;
+	};
+}
+
+#include <Bots/Bot.inl>
+
+#endif
@@ -0,0 +1,18 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <Bots/Bot.hpp>
+
+namespace bw
+{
+	inline bool Bot::IsConnected() const
+	{
+		return m_session.IsConnected();
+	}
+
+	inline bool Bot::IsInMatch() const
+	{
+		return m_isInMatch;
+	}
+}
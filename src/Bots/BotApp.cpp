@@ -0,0 +1,194 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <Bots/BotApp.hpp>
+#include <CoreLib/NetworkSessionBridge.hpp>
+#include <Nazara/Core/Thread.hpp>
+#include <Nazara/Network/Algorithm.hpp>
+#include <Nazara/Network/IpAddress.hpp>
+#include <Nazara/Network/NetPacket.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+namespace bw
+{
+	BotApp::BotApp(int argc, char* argv[]) :
+	Application(argc, argv),
+	BurgApp(LogSide::Client, m_configFile),
+	m_configFile(*this),
+	m_networkReactors(GetLogger(), 64),
+	m_serverTickCount(0),
+	m_serverTickTime(0),
+	m_reportTimer(0.f)
+	{
+		if (!m_configFile.LoadFromFile("botconfig.lua"))
+			throw std::runtime_error("failed to load config file");
+
+		// We don't have any window
+		MakeExitOnLastWindowClosed(false);
+
+		m_reportInterval = m_configFile.GetFloatValue<float>("Bots.ReportInterval");
+
+		BindDebugSocket();
+
+		const std::string& serverHostname = m_configFile.GetStringValue("ServerSettings.Address");
+		Nz::UInt16 serverPort = m_configFile.GetIntegerValue<Nz::UInt16>("ServerSettings.Port");
+
+		Nz::ResolveError resolveError;
+		std::vector<Nz::HostnameInfo> serverAddresses = Nz::IpAddress::ResolveHostname(Nz::NetProtocol_Any, serverHostname, Nz::String::Number(serverPort), &resolveError);
+		if (serverAddresses.empty())
+			throw std::runtime_error("failed to resolve " + serverHostname + ": " + Nz::ErrorToString(resolveError));
+
+		const Nz::IpAddress& serverAddress = serverAddresses.front().address;
+
+		std::size_t botCount = m_configFile.GetIntegerValue<std::size_t>("Bots.Count");
+		float inputChangeInterval = m_configFile.GetFloatValue<float>("Bots.InputChangeInterval");
+
+		bwLog(GetLogger(), LogLevel::Info, "Connecting {0} bots to {1}...", botCount, serverAddress.ToString().ToStdString());
+
+		m_bots.reserve(botCount);
+		for (std::size_t i = 0; i < botCount; ++i)
+		{
+			auto sessionBridge = m_networkReactors.ConnectToServer(serverAddress, 0);
+			if (!sessionBridge)
+				throw std::runtime_error("failed to connect bot #" + std::to_string(i + 1));
+
+			auto& bot = m_bots.emplace_back(std::make_unique<Bot>(*this, i, inputChangeInterval));
+			bot->Connect(std::move(sessionBridge));
+		}
+	}
+
+	BotApp::~BotApp()
+	{
+		m_bots.clear();
+		m_networkReactors.ClearReactors();
+	}
+
+	int BotApp::Run()
+	{
+		while (Application::Run())
+		{
+			BurgApp::Update();
+
+			m_networkReactors.Update();
+			ReceiveDebugPackets();
+
+			float elapsedTime = GetUpdateTime();
+			for (auto& bot : m_bots)
+				bot->Update(elapsedTime);
+
+			m_reportTimer += elapsedTime;
+			if (m_reportTimer >= m_reportInterval)
+			{
+				PrintReport(m_reportTimer);
+				m_reportTimer = 0.f;
+			}
+
+			Nz::Thread::Sleep(1);
+		}
+
+		return 0;
+	}
+
+	void BotApp::BindDebugSocket()
+	{
+		// Server tick time is only known by the server, which sends it on the debug ports of this host (see Debug.SendServerState)
+		if (!m_debugSocket.Create(Nz::NetProtocol_IPv4))
+		{
+			bwLog(GetLogger(), LogLevel::Warning, "Failed to create debug socket: {0}", Nz::ErrorToString(m_debugSocket.GetLastError()));
+			return;
+		}
+
+		m_debugSocket.EnableBlocking(false);
+
+		Nz::IpAddress localhost = Nz::IpAddress::LoopbackIpV4;
+		for (std::size_t i = 0; i < 4; ++i)
+		{
+			localhost.SetPort(static_cast<Nz::UInt16>(42000 + i));
+
+			if (m_debugSocket.Bind(localhost) == Nz::SocketState_Bound)
+				break;
+		}
+
+		if (m_debugSocket.GetState() == Nz::SocketState_Bound)
+			bwLog(GetLogger(), LogLevel::Info, "Debug socket bound to port {0}", m_debugSocket.GetBoundPort());
+		else
+			bwLog(GetLogger(), LogLevel::Warning, "Failed to bind debug socket, server tick time won't be reported: {0}", Nz::ErrorToString(m_debugSocket.GetLastError()));
+	}
+
+	void BotApp::PrintReport(float elapsedTime)
+	{
+		std::size_t connectedCount = 0;
+		std::size_t inMatchCount = 0;
+		Bot::Stats totalStats;
+
+		for (auto& bot : m_bots)
+		{
+			if (bot->IsConnected())
+				connectedCount++;
+
+			if (bot->IsInMatch())
+				inMatchCount++;
+
+			Bot::Stats stats = bot->CollectStats();
+			totalStats.matchStateCount += stats.matchStateCount;
+			totalStats.receivedBytes += stats.receivedBytes;
+			totalStats.replayedInputCount += stats.replayedInputCount;
+			totalStats.sentBytes += stats.sentBytes;
+			totalStats.stateTickCount += stats.stateTickCount;
+			totalStats.stateIntervalTime += stats.stateIntervalTime;
+			totalStats.timingCorrectionCount += stats.timingCorrectionCount;
+			totalStats.timingErrorCount += stats.timingErrorCount;
+		}
+
+		double botCount = std::max<double>(inMatchCount, 1.0);
+
+		double serverTickTime = (m_serverTickCount > 0) ? m_serverTickTime / 1000.0 / m_serverTickCount : 0.0;
+		double stateIntervalTime = (totalStats.stateTickCount > 0) ? double(totalStats.stateIntervalTime) / totalStats.stateTickCount : 0.0;
+		double receivedBytes = totalStats.receivedBytes / botCount / elapsedTime;
+		double sentBytes = totalStats.sentBytes / botCount / elapsedTime;
+		double replayedInputs = (totalStats.matchStateCount > 0) ? double(totalStats.replayedInputCount) / totalStats.matchStateCount : 0.0;
+		double timingErrorRate = (totalStats.timingCorrectionCount > 0) ? 100.0 * totalStats.timingErrorCount / totalStats.timingCorrectionCount : 0.0;
+
+		bwLog(GetLogger(), LogLevel::Info, "{0}/{1} bots connected ({2} in match)", connectedCount, m_bots.size(), inMatchCount);
+		if (m_serverTickCount > 0)
+			bwLog(GetLogger(), LogLevel::Info, "Server tick time: {0:.2f}ms over {1} ticks", serverTickTime, m_serverTickCount);
+		else
+			bwLog(GetLogger(), LogLevel::Info, "Server tick time: unknown (server must run on this host with Debug.SendServerState enabled)");
+
+		bwLog(GetLogger(), LogLevel::Info, "State interval: {0:.2f}ms per server tick, match states per client: {1:.1f}/s", stateIntervalTime, totalStats.matchStateCount / botCount / elapsedTime);
+		bwLog(GetLogger(), LogLevel::Info, "Traffic per client: {0:.0f}B/s down, {1:.0f}B/s up", receivedBytes, sentBytes);
+		bwLog(GetLogger(), LogLevel::Info, "Reconciliation: {0:.2f} replayed inputs per match state, {1:.1f}% of inputs needed a timing correction", replayedInputs, timingErrorRate);
+
+		m_serverTickCount = 0;
+		m_serverTickTime = 0;
+	}
+
+	void BotApp::ReceiveDebugPackets()
+	{
+		if (m_debugSocket.GetState() != Nz::SocketState_Bound)
+			return;
+
+		Nz::NetPacket debugPacket;
+		while (m_debugSocket.ReceivePacket(&debugPacket, nullptr))
+		{
+			switch (debugPacket.GetNetCode())
+			{
+				case 3: //< TickStats
+				{
+					Nz::UInt64 tickCount;
+					Nz::UInt64 tickTime;
+					debugPacket >> tickCount >> tickTime;
+
+					m_serverTickCount += tickCount;
+					m_serverTickTime += tickTime;
+					break;
+				}
+
+				default:
+					break;
+			}
+		}
+	}
+}
@@ -0,0 +1,47 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_BOTAPP_HPP
+#define BURGWAR_BOTAPP_HPP
+
+#include <CoreLib/BurgApp.hpp>
+#include <ClientLib/NetworkReactorManager.hpp>
+#include <Bots/Bot.hpp>
+#include <Bots/BotAppConfig.hpp>
+#include <Nazara/Network/UdpSocket.hpp>
+#include <NDK/Application.hpp>
+#include <memory>
+#include <vector>
+
+namespace bw
+{
+	class BotApp : public Ndk::Application, public BurgApp
+	{
+		public:
+			BotApp(int argc, char* argv[]);
+			~BotApp();
+
+			int Run();
+
+		private:
+			void BindDebugSocket();
+			void PrintReport(float elapsedTime);
+			void ReceiveDebugPackets();
+
+			std::vector<std::unique_ptr<Bot>> m_bots;
+			BotAppConfig m_configFile;
+			NetworkReactorManager m_networkReactors;
+			Nz::UdpSocket m_debugSocket;
+			Nz::UInt64 m_serverTickCount;
+			Nz::UInt64 m_serverTickTime; //< microseconds
+			float m_reportInterval;
+			float m_reportTimer;
+	};
+}
+
+#include <Bots/BotApp.inl>
+
+#endif
@@ -0,0 +1,9 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <Bots/BotApp.hpp>
+
+namespace bw
+{
+}
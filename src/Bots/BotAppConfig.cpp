@@ -0,0 +1,19 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <Bots/BotAppConfig.hpp>
+#include <Bots/BotApp.hpp>
+
+namespace bw
+{
+	BotAppConfig::BotAppConfig(BotApp& app) :
+	ConfigFile(app)
+	{
+		RegisterIntegerOption("Bots.Count", 1, 1024, 16);
+		RegisterFloatOption("Bots.InputChangeInterval", 0.0, 60.0, 1.0);
+		RegisterFloatOption("Bots.ReportInterval", 0.1, 3600.0, 5.0);
+		RegisterStringOption("ServerSettings.Address", "localhost");
+		RegisterIntegerOption("ServerSettings.Port", 1, 0xFFFF, 14768);
+	}
+}
@@ -0,0 +1,26 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#ifndef BURGWAR_BOTAPPCONFIG_HPP
+#define BURGWAR_BOTAPPCONFIG_HPP
+
+#include <CoreLib/ConfigFile.hpp>
+
+namespace bw
+{
+	class BotApp;
+
+	class BotAppConfig : public ConfigFile
+	{
+		public:
+			BotAppConfig(BotApp& app);
+			~BotAppConfig() = default;
+	};
+}
+
+#include <Bots/BotAppConfig.inl>
+
+#endif
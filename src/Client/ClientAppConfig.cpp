@@ -12,6 +12,11 @@ namespace bw
 	{
 		RegisterStringOption("Debug.ShowConnectionData");
 		RegisterBoolOption("Debug.ShowServerGhosts");
+		RegisterFloatOption("Debug.SimulatedDuplication", 0.0, 1.0, 0.0);
+		RegisterIntegerOption("Debug.SimulatedJitter", 0, 10'000, 0);
+		RegisterIntegerOption("Debug.SimulatedLatency", 0, 10'000, 0);
+		RegisterFloatOption("Debug.SimulatedLoss", 0.0, 1.0, 0.0);
+		RegisterFloatOption("Debug.SimulatedReorder", 0.0, 1.0, 0.0);
 		RegisterIntegerOption("WindowSettings.AntialiasingLevel", 0, 16);
 		RegisterBoolOption("WindowSettings.Fullscreen");
 		RegisterBoolOption("WindowSettings.VSync");
@@ -24,9 +24,9 @@ namespace bw
 
 		auto scriptDirectory = std::make_shared<VirtualDirectory>();
 
-		m_downloadManager->OnFileChecked.Connect([scriptDirectory](ClientScriptDownloadManager* /*downloadManager*/, const std::string& filePath, const std::vector<Nz::UInt8>& fileContent)
+		m_downloadManager->OnFileChecked.Connect([scriptDirectory](ClientScriptDownloadManager* /*downloadManager*/, const std::string& filePath, const ByteView& fileContent)
 		{
-			scriptDirectory->StoreFile(filePath, fileContent);
+			scriptDirectory->StoreFile(filePath, fileContent.ToVector());
 		});
 
 		m_downloadManager->OnDownloadRequest.Connect([this](ClientScriptDownloadManager* /*downloadManager*/, const Packets::DownloadClientScriptRequest& request)
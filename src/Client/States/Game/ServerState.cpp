@@ -31,6 +31,16 @@ namespace bw
 
 		MatchSessions& sessions = m_match->GetSessions();
 		m_localSessionManager = sessions.CreateSessionManager<LocalSessionManager>();
+
+		LocalSessionManager::NetworkConditions networkConditions;
+		networkConditions.duplicationRate = config.GetFloatValue<float>("Debug.SimulatedDuplication");
+		networkConditions.jitter = config.GetIntegerValue<Nz::UInt32>("Debug.SimulatedJitter");
+		networkConditions.latency = config.GetIntegerValue<Nz::UInt32>("Debug.SimulatedLatency");
+		networkConditions.lossRate = config.GetFloatValue<float>("Debug.SimulatedLoss");
+		networkConditions.reorderRate = config.GetFloatValue<float>("Debug.SimulatedReorder");
+
+		m_localSessionManager->SetNetworkConditions(networkConditions);
+
 		if (listenPort != 0)
 			m_networkSessionManager = sessions.CreateSessionManager<NetworkSessionManager>(listenPort, 64);
 		else
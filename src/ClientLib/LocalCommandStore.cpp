@@ -38,6 +38,7 @@ namespace bw
 		IncomingCommand(EntityWeapon);
 		IncomingCommand(HealthUpdate);
 		IncomingCommand(InputTimingCorrection);
+		IncomingCommand(LayerActivated);
 		IncomingCommand(MatchData);
 		IncomingCommand(MatchState);
 		IncomingCommand(NetworkStrings);
@@ -49,17 +50,20 @@ namespace bw
 		IncomingCommand(PlayerWeapons);
 		IncomingCommand(ScriptPacket);
 
+		RegisterIncomingFrameCommand<Packets::PacketFrame>("PacketFrame");
+
 		// Outgoing commands
-		OutgoingCommand(Auth,                        Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(DownloadClientScriptRequest, Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(NetworkStrings,              Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(PlayerChat,                  Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(PlayerConsoleCommand,        Nz::ENetPacketFlag_Reliable, 1);
-		OutgoingCommand(PlayersInput,                Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(PlayerSelectWeapon,          Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(Ready,                       Nz::ENetPacketFlag_Reliable, 0);
-		OutgoingCommand(ScriptPacket,                Nz::ENetPacketFlag_Reliable, 1);
-		OutgoingCommand(UpdatePlayerName,            Nz::ENetPacketFlag_Reliable, 1);
+		OutgoingCommand(Auth,                        Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(DownloadClientScriptRequest, Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(NetworkStrings,              Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(PlayerChat,                  Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(PlayerConsoleCommand,        Nz::ENetPacketFlag_Reliable,    1);
+		OutgoingCommand(PlayersInput,                Nz::ENetPacketFlag_Unsequenced, 0);
+		OutgoingCommand(PlayerSelectWeapon,          Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(Ready,                       Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(ScriptPacket,                Nz::ENetPacketFlag_Reliable,    1);
+		OutgoingCommand(UpdateCameraRect,            Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(UpdatePlayerName,            Nz::ENetPacketFlag_Reliable,    1);
 
 #undef IncomingCommand
 #undef OutgoingCommand
@@ -41,6 +41,7 @@
 #include <Nazara/Utility/SimpleTextDrawer.hpp>
 #include <NDK/Components.hpp>
 #include <NDK/Systems.hpp>
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 
@@ -708,9 +709,21 @@ namespace bw
 			HandleTickError(timingCorrection.serverTick, timingCorrection.tickError);
 		});
 
+		m_session.OnLayerActivated.Connect([this](ClientSession* /*session*/, const Packets::LayerActivated& layerActivated)
+		{
+			PushTickPacket(layerActivated.stateTick, layerActivated);
+		});
+
 		m_session.OnMatchState.Connect([this](ClientSession* /*session*/, const Packets::MatchState& matchState)
 		{
-			PushTickPacket(matchState.stateTick, matchState);
+			Packets::MatchState resolvedState = matchState;
+			if (ResolveMatchState(resolvedState))
+			{
+				// Acknowledge this state so the server can use it as a baseline
+				RegisterReceivedTick(resolvedState.stateTick, m_inputPacket.lastStateTick, m_inputPacket.previousStateBits);
+			}
+
+			PushTickPacket(resolvedState.stateTick, std::move(resolvedState));
 		});
 
 		m_session.OnPlayerLayer.Connect([this](ClientSession* /*session*/, const Packets::PlayerLayer& layerUpdate)
@@ -967,7 +980,10 @@ namespace bw
 
 		const std::string& packetName = stringStore.GetString(packet.nameIndex);
 
-		registry.Call(packetName, IncomingNetworkPacket(stringStore, packet));
+		// Packet content is only a view into the received data, scripts can't keep reading it afterwards
+		auto incomingPacket = std::make_shared<IncomingNetworkPacket>(stringStore, packet);
+		registry.Call(packetName, incomingPacket);
+		incomingPacket->Invalidate();
 	}
 
 	void LocalMatch::HandleTickPacket(TickPacketContent&& packet)
@@ -1031,6 +1047,10 @@ namespace bw
 			assert(layerData.layerIndex < m_layers.size());
 			auto& layer = m_layers[layerData.layerIndex];
 			layer->HandlePacket(&packet.entities[offset], layerData.entityCount);
+
+			for (std::size_t i = 0; i < layerData.entityCount; ++i)
+				DiscardReceivedStates(packet.stateTick, layerData.layerIndex, Nz::UInt32(packet.entities[offset + i].id));
+
 			offset += layerData.entityCount;
 		}
 	}
@@ -1042,6 +1062,8 @@ namespace bw
 
 		//TODO
 		m_layers[packet.layerIndex]->Disable();
+
+		DiscardReceivedStates(packet.stateTick, packet.layerIndex);
 	}
 
 	void LocalMatch::HandleTickPacket(Packets::EnableLayer&& packet)
@@ -1075,6 +1097,10 @@ namespace bw
 			assert(layerData.layerIndex < m_layers.size());
 			auto& layer = m_layers[layerData.layerIndex];
 			layer->HandlePacket(&packet.entities[offset], layerData.entityCount);
+
+			for (std::size_t i = 0; i < layerData.entityCount; ++i)
+				DiscardReceivedStates(packet.stateTick, layerData.layerIndex, Nz::UInt32(packet.entities[offset + i].id));
+
 			offset += layerData.entityCount;
 		}
 	}
@@ -1129,6 +1155,13 @@ namespace bw
 		}
 	}
 
+	void LocalMatch::HandleTickPacket(Packets::LayerActivated&& packet)
+	{
+		// Entities of a newly enabled layer are streamed over several ticks, every one of them has been received by now
+		assert(m_layers[packet.layerIndex]->IsEnabled());
+		bwLog(GetLogger(), LogLevel::Debug, "Layer {} is now fully synchronized", packet.layerIndex);
+	}
+
 	void LocalMatch::HandleTickPacket(Packets::MatchState&& packet)
 	{
 		if (Nz::Keyboard::IsKeyPressed(Nz::Keyboard::Scancode::Q))
@@ -1492,6 +1525,7 @@ namespace bw
 		if (lastTick)
 		{
 			SendInputs(estimatedServerTick, true);
+			SendCameraRect();
 
 			for (std::size_t i = 0; i < m_localPlayers.size(); ++i)
 			{
@@ -1626,14 +1660,136 @@ namespace bw
 		m_tickedPackets.emplace(it, std::move(newPacket));
 	}
 
+	void LocalMatch::DiscardReceivedStates(Nz::UInt16 removalTick, LayerIndex layerIndex, std::optional<Nz::UInt32> entityId)
+	{
+		// States received before the removal belong to entities whose id may be reused, they can't be used as baselines anymore
+		for (ReceivedMatchState& receivedState : m_receivedMatchStates)
+		{
+			if (!receivedState.isValid || !IsMoreRecent(removalTick, receivedState.stateTick))
+				continue;
+
+			if (entityId)
+			{
+				receivedState.entities.erase(Nz::UInt64(layerIndex) << 32 | *entityId);
+				continue;
+			}
+
+			for (auto it = receivedState.entities.begin(); it != receivedState.entities.end();)
+			{
+				if (LayerIndex(it->first >> 32) == layerIndex)
+					it = receivedState.entities.erase(it);
+				else
+					++it;
+			}
+		}
+	}
+
+	bool LocalMatch::ResolveMatchState(Packets::MatchState& matchState)
+	{
+		ReceivedMatchState& receivedState = m_receivedMatchStates[matchState.stateTick % m_receivedMatchStates.size()];
+		if (!receivedState.isValid || receivedState.stateTick != matchState.stateTick)
+		{
+			receivedState.entities.clear();
+			receivedState.isValid = true;
+			receivedState.stateTick = matchState.stateTick;
+		}
+
+		bool isComplete = true;
+
+		std::size_t entityIndex = 0;
+		std::size_t resolvedEntityCount = 0;
+		for (auto& layer : matchState.layers)
+		{
+			Nz::UInt32 layerEntityCount = 0;
+			for (std::size_t i = 0; i < layer.entityCount; ++i)
+			{
+				auto& entity = matchState.entities[entityIndex++];
+				Nz::UInt64 entityKey = Nz::UInt64(layer.layerIndex) << 32 | entity.id;
+
+				if (entity.baselineAge != 0)
+				{
+					// Retrieve elided fields from the baseline state
+					Nz::UInt16 baselineTick = static_cast<Nz::UInt16>(matchState.stateTick - entity.baselineAge);
+
+					const ReceivedMatchState& baselineState = m_receivedMatchStates[baselineTick % m_receivedMatchStates.size()];
+					auto it = (baselineState.isValid && baselineState.stateTick == baselineTick) ? baselineState.entities.find(entityKey) : baselineState.entities.end();
+					if (it == baselineState.entities.end() || (entity.physicsProperties && !entity.physicsChanged && !it->second.physicsProperties))
+					{
+						bwLog(GetLogger(), LogLevel::Warning, "Missing baseline state (tick {0}) for entity #{1} of layer {2}, ignoring it", baselineTick, Nz::UInt32(entity.id), LayerIndex(layer.layerIndex));
+						isComplete = false;
+						continue;
+					}
+
+					const Packets::MatchState::Entity& baselineEntity = it->second;
+					if (!entity.positionChanged)
+						entity.position = baselineEntity.position;
+
+					if (!entity.rotationChanged)
+						entity.rotation = baselineEntity.rotation;
+
+					if (entity.physicsProperties && !entity.physicsChanged)
+						entity.physicsProperties = baselineEntity.physicsProperties;
+
+					entity.baselineAge = 0;
+				}
+
+				receivedState.entities[entityKey] = entity;
+
+				if (resolvedEntityCount != entityIndex - 1)
+					matchState.entities[resolvedEntityCount] = std::move(entity);
+
+				resolvedEntityCount++;
+				layerEntityCount++;
+			}
+
+			layer.entityCount = layerEntityCount;
+		}
+
+		matchState.entities.resize(resolvedEntityCount);
+
+		return isComplete;
+	}
+
+	void LocalMatch::SendCameraRect()
+	{
+		const Nz::Recti& viewport = m_camera->GetViewport();
+
+		Nz::Vector2f topLeft = m_camera->Unproject(Nz::Vector2f(float(viewport.x), float(viewport.y)));
+		Nz::Vector2f bottomRight = m_camera->Unproject(Nz::Vector2f(float(viewport.x + viewport.width), float(viewport.y + viewport.height)));
+
+		Nz::Rectf cameraRect(topLeft, bottomRight);
+
+		// Server keeps a margin around the camera rect, small moves don't have to be sent
+		if (m_lastSentCameraRect)
+		{
+			auto HasMoved = [&](Nz::RectCorner corner)
+			{
+				return m_lastSentCameraRect->GetCorner(corner).SquaredDistance(cameraRect.GetCorner(corner)) >= CameraRectUpdateThreshold * CameraRectUpdateThreshold;
+			};
+
+			if (!HasMoved(Nz::RectCorner_LeftTop) && !HasMoved(Nz::RectCorner_RightBottom))
+				return;
+		}
+
+		Packets::UpdateCameraRect cameraRectPacket;
+		cameraRectPacket.position = cameraRect.GetPosition();
+		cameraRectPacket.size = cameraRect.GetLengths();
+
+		m_session.SendPacket(cameraRectPacket);
+
+		m_lastSentCameraRect = cameraRect;
+	}
+
 	bool LocalMatch::SendInputs(Nz::UInt16 serverTick, bool force)
 	{
 		assert(m_localPlayers.size() == m_inputPacket.inputs.size());
 
-		m_inputPacket.estimatedServerTick = serverTick;
-		m_inputPacket.inputTick = GetNetworkTick();
+		Nz::UInt16 inputTick = GetNetworkTick();
+
+		//bwLog(GetLogger(), LogLevel::Debug, "Send input tick: {}", inputTick);
 
-		//bwLog(GetLogger(), LogLevel::Debug, "Send input tick: {}", m_inputPacket.inputTick);
+		// Periodically send all inputs, in case more packets were lost than previous inputs can recover
+		bool sendAllInputs = (inputTick % FullInputInterval == 0);
 
 		bool checkInputs = m_hasFocus &&
 		                   !m_chatBox.IsTyping() &&
@@ -1649,7 +1805,7 @@ namespace bw
 			if (checkInputs)
 				input = controllerData.inputController->Poll(*this, controllerData.controlledEntity);
 
-			if (controllerData.lastInputData != input)
+			if (controllerData.lastInputData != input || sendAllInputs)
 			{
 				hasInputData = true;
 				controllerData.lastInputData = input;
@@ -1661,8 +1817,22 @@ namespace bw
 
 		if (hasInputData || force)
 		{
+			auto& previousInputs = m_inputPacket.previousInputs;
+			if (!previousInputs.empty())
+				previousInputs.front().tickDelta = static_cast<Nz::UInt16>(inputTick - m_inputPacket.inputTick);
+
+			m_inputPacket.estimatedServerTick = serverTick;
+			m_inputPacket.inputTick = inputTick;
+
 			m_session.SendPacket(m_inputPacket);
 
+			// Input packets are unreliable, send those inputs again with the next packets
+			if (previousInputs.size() < Packets::PlayersInput::MaxPreviousInputCount)
+				previousInputs.emplace_back();
+
+			std::rotate(previousInputs.rbegin(), previousInputs.rbegin() + 1, previousInputs.rend());
+			previousInputs.front().inputs = m_inputPacket.inputs;
+
 			return true;
 		}
 		else
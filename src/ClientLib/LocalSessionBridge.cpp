@@ -60,13 +60,13 @@ namespace bw
 		callback(m_sessionInfo);
 	}
 
-	void LocalSessionBridge::SendPacket(Nz::UInt8 /*channelId*/, Nz::ENetPacketFlags /*flags*/, Nz::NetPacket&& packet)
+	void LocalSessionBridge::SendPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet)
 	{
 		assert(IsConnected());
 
 		m_sessionInfo.totalByteSent += packet.GetDataSize();
 		m_sessionInfo.totalPacketSent++;
 
-		m_sessionManager.SendPacket(m_peerId, std::move(packet), m_isServer);
+		m_sessionManager.SendPacket(m_peerId, channelId, flags, std::move(packet), m_isServer);
 	}
 }
@@ -4,12 +4,22 @@
 
 #include <ClientLib/LocalSessionManager.hpp>
 #include <ClientLib/LocalSessionBridge.hpp>
+#include <CoreLib/BurgApp.hpp>
 #include <CoreLib/Match.hpp>
 #include <CoreLib/MatchSessions.hpp>
 #include <CoreLib/LogSystem/Logger.hpp>
+#include <algorithm>
+#include <iterator>
 
 namespace bw
 {
+	LocalSessionManager::LocalSessionManager(MatchSessions* owner) :
+	SessionManager(owner),
+	m_randomGenerator(std::random_device{}()),
+	m_simulateNetworkConditions(false)
+	{
+	}
+
 	LocalSessionManager::~LocalSessionManager() = default;
 
 	std::shared_ptr<LocalSessionBridge> LocalSessionManager::CreateSession()
@@ -30,7 +40,7 @@ namespace bw
 		peer.emplace();
 		peer->clientBridge = std::make_shared<LocalSessionBridge>(*this, peerId, false);
 		peer->serverBridge = std::make_shared<LocalSessionBridge>(*this, peerId, true);
-		peer->session = GetOwner()->CreateSession(peer->serverBridge);
+		peer->session = GetOwner()->CreateSession(this, peer->serverBridge);
 
 		return peer->clientBridge;
 	}
@@ -42,15 +52,8 @@ namespace bw
 			if (peerOpt)
 			{
 				Peer& peer = peerOpt.value();
-				for (auto&& packet : peer.clientPackets)
-					peer.clientBridge->HandleIncomingPacket(packet);
-
-				peer.clientPackets.clear();
-
-				for (auto&& packet : peer.serverPackets)
-					peer.serverBridge->HandleIncomingPacket(packet);
-
-				peer.serverPackets.clear();
+				PollLink(peer.clientLink, *peer.clientBridge, false);
+				PollLink(peer.serverLink, *peer.serverBridge, true);
 
 				if (peer.disconnectionRequested)
 				{
@@ -59,12 +62,34 @@ namespace bw
 
 					GetOwner()->DeleteSession(peer.session);
 
+					// Packets sent by the server come from the match packet pool
+					NetPacketPool& packetPool = GetOwner()->GetMatch().GetPacketPool();
+					for (auto& pendingPacket : peer.clientLink.pendingPackets)
+						packetPool.Release(std::move(pendingPacket.packet));
+
 					peerOpt.reset();
 				}
 			}
 		}
 	}
 
+	void LocalSessionManager::SetNetworkConditions(const NetworkConditions& conditions)
+	{
+		for (std::size_t i = 0; i < m_networkConditions.size(); ++i)
+			SetNetworkConditions(static_cast<Nz::UInt8>(i), conditions);
+	}
+
+	void LocalSessionManager::SetNetworkConditions(Nz::UInt8 channelId, const NetworkConditions& conditions)
+	{
+		assert(channelId < m_networkConditions.size());
+		m_networkConditions[channelId] = conditions;
+
+		m_simulateNetworkConditions = std::any_of(m_networkConditions.begin(), m_networkConditions.end(), [](const NetworkConditions& channelConditions)
+		{
+			return channelConditions.latency > 0 || channelConditions.jitter > 0 || channelConditions.duplicationRate > 0.f || channelConditions.lossRate > 0.f || channelConditions.reorderRate > 0.f;
+		});
+	}
+
 	void LocalSessionManager::DisconnectPeer(std::size_t peerId)
 	{
 		assert(peerId < m_peers.size() && m_peers[peerId]);
@@ -72,17 +97,146 @@ namespace bw
 		peer.disconnectionRequested = true;
 	}
 
-	void LocalSessionManager::SendPacket(std::size_t peerId, Nz::NetPacket&& packet, bool isServer)
+	void LocalSessionManager::PollLink(Link& link, LocalSessionBridge& bridge, bool isServerLink)
+	{
+		if (link.pendingPackets.empty())
+			return;
+
+		// Handling packets may send new ones, deliver from a separate buffer
+		if (m_simulateNetworkConditions)
+		{
+			Nz::UInt64 now = GetOwner()->GetMatch().GetApp().GetAppTime();
+
+			auto it = std::stable_partition(link.pendingPackets.begin(), link.pendingPackets.end(), [&](const PendingPacket& pendingPacket)
+			{
+				return pendingPacket.deliveryTime <= now;
+			});
+
+			std::move(link.pendingPackets.begin(), it, std::back_inserter(m_deliveredPackets));
+			link.pendingPackets.erase(link.pendingPackets.begin(), it);
+
+			std::stable_sort(m_deliveredPackets.begin(), m_deliveredPackets.end(), [](const PendingPacket& lhs, const PendingPacket& rhs)
+			{
+				return lhs.deliveryTime < rhs.deliveryTime;
+			});
+		}
+		else
+			std::swap(link.pendingPackets, m_deliveredPackets);
+
+		NetPacketPool& packetPool = GetOwner()->GetMatch().GetPacketPool();
+		for (auto& pendingPacket : m_deliveredPackets)
+		{
+			Nz::UInt64& lastDeliveredSequence = link.lastDeliveredSequence[pendingPacket.channelId];
+			if (!pendingPacket.isSequenced || pendingPacket.sequenceId > lastDeliveredSequence)
+			{
+				if (pendingPacket.isSequenced)
+					lastDeliveredSequence = pendingPacket.sequenceId;
+
+				bridge.HandleIncomingPacket(pendingPacket.packet);
+			}
+
+			// Packets sent by the server come from the match packet pool
+			if (!isServerLink)
+				packetPool.Release(std::move(pendingPacket.packet));
+		}
+
+		m_deliveredPackets.clear();
+	}
+
+	void LocalSessionManager::SendPacket(std::size_t peerId, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet, bool isServer)
 	{
 		assert(peerId < m_peers.size() && m_peers[peerId]);
+		assert(channelId < NetworkChannelCount);
 		Peer& peer = m_peers[peerId].value();
 
 		// Reset cursor position
 		packet.GetStream()->SetCursorPos(Nz::NetPacket::HeaderSize);
 
-		if (isServer)
-			peer.clientPackets.emplace_back(std::move(packet));
-		else
-			peer.serverPackets.emplace_back(std::move(packet));
+		Link& link = (isServer) ? peer.clientLink : peer.serverLink;
+
+		if (!m_simulateNetworkConditions)
+		{
+			auto& pendingPacket = link.pendingPackets.emplace_back();
+			pendingPacket.channelId = channelId;
+			pendingPacket.deliveryTime = 0;
+			pendingPacket.isSequenced = false;
+			pendingPacket.packet = std::move(packet);
+			pendingPacket.sequenceId = 0;
+			return;
+		}
+
+		const NetworkConditions& conditions = m_networkConditions[channelId];
+		Nz::UInt64 now = GetOwner()->GetMatch().GetApp().GetAppTime();
+
+		std::uniform_real_distribution<float> chanceDis(0.f, 1.f);
+		std::uniform_int_distribution<Nz::UInt32> jitterDis(0, conditions.jitter);
+
+		auto ComputeDeliveryTime = [&]
+		{
+			return now + conditions.latency + jitterDis(m_randomGenerator);
+		};
+
+		Nz::UInt64 sequenceId = link.nextSequenceId++;
+		auto PushPacket = [&](Nz::NetPacket&& pendingData, Nz::UInt64 deliveryTime, bool isSequenced)
+		{
+			auto& pendingPacket = link.pendingPackets.emplace_back();
+			pendingPacket.channelId = channelId;
+			pendingPacket.deliveryTime = deliveryTime;
+			pendingPacket.isSequenced = isSequenced;
+			pendingPacket.packet = std::move(pendingData);
+			pendingPacket.sequenceId = sequenceId;
+		};
+
+		if (flags & Nz::ENetPacketFlag_Reliable)
+		{
+			// Lost reliable packets are resent after a round-trip, and hold back the following ones as they're delivered in order
+			Nz::UInt64 deliveryTime = ComputeDeliveryTime();
+			for (unsigned int resendCount = 0; resendCount < 8 && chanceDis(m_randomGenerator) < conditions.lossRate; ++resendCount)
+				deliveryTime += 2 * conditions.latency + conditions.jitter;
+
+			Nz::UInt64& lastReliableDeliveryTime = link.lastReliableDeliveryTime[channelId];
+			deliveryTime = std::max(deliveryTime, lastReliableDeliveryTime);
+			lastReliableDeliveryTime = deliveryTime;
+
+			PushPacket(std::move(packet), deliveryTime, false);
+			return;
+		}
+
+		if (chanceDis(m_randomGenerator) < conditions.lossRate)
+		{
+			if (isServer)
+				GetOwner()->GetMatch().GetPacketPool().Release(std::move(packet));
+
+			return;
+		}
+
+		bool isSequenced = (flags & Nz::ENetPacketFlag_Unsequenced) == 0;
+
+		if (chanceDis(m_randomGenerator) < conditions.duplicationRate)
+		{
+			const Nz::UInt8* packetData = packet.GetConstData() + Nz::NetPacket::HeaderSize;
+			std::size_t packetSize = packet.GetDataSize() - Nz::NetPacket::HeaderSize;
+
+			// Server packets are released to the match packet pool once delivered, duplicates have to come from it as well
+			Nz::NetPacket duplicatedPacket;
+			if (isServer)
+			{
+				duplicatedPacket = GetOwner()->GetMatch().GetPacketPool().Acquire(packet.GetNetCode());
+				duplicatedPacket.Write(packetData, packetSize);
+			}
+			else
+				duplicatedPacket = Nz::NetPacket(packet.GetNetCode(), packetData, packetSize);
+
+			duplicatedPacket.GetStream()->SetCursorPos(Nz::NetPacket::HeaderSize);
+
+			// Duplicates share the sequence of the original packet, only the first one to arrive is handled unless packet is unsequenced
+			PushPacket(std::move(duplicatedPacket), ComputeDeliveryTime(), isSequenced);
+		}
+
+		Nz::UInt64 deliveryTime = ComputeDeliveryTime();
+		if (chanceDis(m_randomGenerator) < conditions.reorderRate)
+			deliveryTime += ReorderDelay + conditions.jitter;
+
+		PushPacket(std::move(packet), deliveryTime, isSequenced);
 	}
 }
@@ -10,16 +10,11 @@ namespace bw
 {
 	std::shared_ptr<NetworkSessionBridge> NetworkReactorManager::ConnectToServer(const Nz::IpAddress& serverAddress, Nz::UInt32 data)
 	{
-		constexpr std::size_t MaxPeerCount = 1;
-
 		auto ConnectWithReactor = [&](NetworkReactor* reactor) -> std::shared_ptr<NetworkSessionBridge>
 		{
 			std::size_t newPeerId = reactor->ConnectTo(serverAddress, data);
 			if (newPeerId == NetworkReactor::InvalidPeerId)
-			{
-				bwLog(m_logger, LogLevel::Error, "Failed to allocate new peer");
 				return nullptr;
-			}
 
 			auto bridge = std::make_shared<NetworkSessionBridge>(*reactor, newPeerId);
 
@@ -38,12 +33,19 @@ namespace bw
 			if (reactor->GetProtocol() != serverAddress.GetProtocol())
 				continue;
 
-			return ConnectWithReactor(reactor.get());
+			// Reactor may be full
+			if (auto bridge = ConnectWithReactor(reactor.get()))
+				return bridge;
 		}
 
-		// We don't have any reactor compatible with the server's protocol, allocate a new one
-		std::size_t reactorId = AddReactor(std::make_unique<NetworkReactor>(reactorCount * MaxPeerCount, serverAddress.GetProtocol(), Nz::UInt16(0), MaxPeerCount));
-		return ConnectWithReactor(GetReactor(reactorId).get());
+		// We don't have any reactor compatible with the server's protocol (or with a free peer), allocate a new one
+		std::size_t reactorId = AddReactor(std::make_unique<NetworkReactor>(reactorCount * m_reactorPeerCount, serverAddress.GetProtocol(), Nz::UInt16(0), m_reactorPeerCount));
+
+		auto bridge = ConnectWithReactor(GetReactor(reactorId).get());
+		if (!bridge)
+			bwLog(m_logger, LogLevel::Error, "Failed to allocate new peer");
+
+		return bridge;
 	}
 
 	void NetworkReactorManager::Update()
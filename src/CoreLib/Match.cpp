@@ -17,7 +17,9 @@
 #include <CoreLib/Scripting/ServerGamemode.hpp>
 #include <CoreLib/Scripting/ServerScriptingLibrary.hpp>
 #include <CoreLib/Systems/NetworkSyncSystem.hpp>
+#include <CoreLib/Utility/WorkerPool.hpp>
 #include <CoreLib/Utils.hpp>
+#include <Nazara/Core/Clock.hpp>
 #include <Nazara/Core/File.hpp>
 #include <NDK/Components/PhysicsComponent2D.hpp>
 #include <cassert>
@@ -42,6 +44,10 @@ namespace bw
 		m_terrain = std::make_unique<Terrain>(m_map);
 		m_terrain->Initialize(*this);
 
+		// Game thread updates sessions as well, hence one less worker
+		if (matchSettings.sessionThreadCount > 1)
+			m_sessionWorkerPool = std::make_unique<WorkerPool>(matchSettings.sessionThreadCount - 1);
+
 		BuildMatchData();
 
 		m_gamemode->ExecuteCallback<GamemodeEvent::Init>();
@@ -562,14 +568,43 @@ namespace bw
 			debugPacket.GetStream()->SetCursorPos(offset);
 			debugPacket << entityCount;
 
-			Nz::IpAddress localAddress = Nz::IpAddress::LoopbackIpV4;
-			for (std::size_t i = 0; i < 4; ++i)
+			SendDebugPacket(debugPacket);
+		}
+
+		if (m_debug && appTime - m_debug->lastNetworkStatsTime > 1000)
+		{
+			m_debug->lastNetworkStatsTime = appTime;
+
+			// Send tick stats
+			Nz::NetPacket tickStatsPacket(3);
+			tickStatsPacket << m_debug->tickCount << m_debug->tickTime;
+			SendDebugPacket(tickStatsPacket);
+
+			m_debug->tickCount = 0;
+			m_debug->tickTime = 0;
+
+			// Send network reactors stats
+			Nz::UInt8 reactorIndex = 0;
+			m_sessions.ForEachNetworkReactor([&](const NetworkReactor& reactor)
 			{
-				localAddress.SetPort(static_cast<Nz::UInt16>(42000 + i));
+				NetworkReactor::Stats stats = reactor.GetStats();
 
-				if (!m_debug->socket.SendPacket(localAddress, debugPacket))
-					bwLog(GetLogger(), LogLevel::Error, "Failed to send debug packet: {1}", Nz::ErrorToString(m_debug->socket.GetLastError()));
-			}
+				Nz::NetPacket debugPacket(2);
+				debugPacket << reactorIndex++;
+				debugPacket << Nz::UInt32(stats.peerCount) << Nz::UInt32(stats.incomingQueueSize) << Nz::UInt32(stats.outgoingQueueSize) << Nz::UInt32(stats.backlogSize);
+				debugPacket << stats.serviceTime << stats.sendTime;
+				debugPacket << stats.sendLatency.averageTime << stats.sendLatency.maxTime << stats.sendLatency.packetCount;
+
+				debugPacket << Nz::UInt8(stats.channels.size());
+				for (const auto& channelStats : stats.channels)
+					debugPacket << channelStats.byteCount << channelStats.packetCount;
+
+				debugPacket << Nz::UInt8(stats.roundTripTimes.size());
+				for (std::size_t peerCount : stats.roundTripTimes)
+					debugPacket << Nz::UInt32(peerCount);
+
+				SendDebugPacket(debugPacket);
+			});
 		}
 	}
 
@@ -650,6 +685,7 @@ namespace bw
 
 	void Match::OnTick(bool lastTick)
 	{
+		Nz::UInt64 tickStartTime = Nz::GetElapsedMicroseconds();
 		float elapsedTime = GetTickDuration();
 
 		m_sessions.ForEachSession([&](MatchClientSession* session)
@@ -666,12 +702,66 @@ namespace bw
 
 		m_terrain->Update(elapsedTime);
 
+		// Creation snapshots must reflect this tick before sessions read them
+		for (LayerIndex i = 0; i < m_terrain->GetLayerCount(); ++i)
+			m_terrain->GetLayer(i).GetWorld().GetSystem<NetworkSyncSystem>().RefreshSnapshots();
+
+		// World state is read-only from here until the journals are cleared, which allows sessions to be updated concurrently
+		if (m_sessionWorkerPool)
+		{
+			m_concurrentSessions.clear();
+			m_sessions.ForEachSession([&](MatchClientSession* session)
+			{
+				// Local sessions share their manager and answer synchronously, keep them on this thread
+				if (session->GetSessionBridge().IsLocal())
+					session->Update(elapsedTime);
+				else
+					m_concurrentSessions.push_back(session);
+			});
+
+			m_sessionWorkerPool->ForEach(m_concurrentSessions.size(), [&](std::size_t sessionIndex)
+			{
+				m_concurrentSessions[sessionIndex]->Update(elapsedTime);
+			});
+		}
+		else
+		{
+			m_sessions.ForEachSession([&](MatchClientSession* session)
+			{
+				session->Update(elapsedTime);
+			});
+		}
+
+		// Sessions may have been updated by any worker thread, their packets are submitted from this thread only.
+		// Everything sent to a peer then goes through the same producer of the network reactor, which keeps sending order
 		m_sessions.ForEachSession([&](MatchClientSession* session)
 		{
-			session->Update(elapsedTime);
+			session->SubmitPacketBatch();
 		});
+
+		// Every session has read entity events of this tick
+		for (LayerIndex i = 0; i < m_terrain->GetLayerCount(); ++i)
+			m_terrain->GetLayer(i).GetWorld().GetSystem<NetworkSyncSystem>().ClearJournal();
+
+		if (m_debug)
+		{
+			m_debug->tickCount++;
+			m_debug->tickTime += Nz::GetElapsedMicroseconds() - tickStartTime;
+		}
 	}
 	
+	void Match::SendDebugPacket(const Nz::NetPacket& debugPacket)
+	{
+		Nz::IpAddress localAddress = Nz::IpAddress::LoopbackIpV4;
+		for (std::size_t i = 0; i < 4; ++i)
+		{
+			localAddress.SetPort(static_cast<Nz::UInt16>(42000 + i));
+
+			if (!m_debug->socket.SendPacket(localAddress, debugPacket))
+				bwLog(GetLogger(), LogLevel::Error, "Failed to send debug packet: {1}", Nz::ErrorToString(m_debug->socket.GetLastError()));
+		}
+	}
+
 	void Match::SendPingUpdate()
 	{
 		Packets::PlayerPingUpdate pingUpdate;
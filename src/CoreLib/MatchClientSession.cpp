@@ -3,28 +3,36 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/MatchClientSession.hpp>
+#include <CoreLib/BurgApp.hpp>
 #include <CoreLib/Match.hpp>
 #include <CoreLib/MatchClientVisibility.hpp>
 #include <CoreLib/NetworkReactor.hpp>
 #include <CoreLib/Player.hpp>
 #include <CoreLib/PlayerCommandStore.hpp>
 #include <CoreLib/Terrain.hpp>
+#include <CoreLib/Utils.hpp>
 #include <CoreLib/Scripting/NetworkPacket.hpp>
 #include <CoreLib/Scripting/ServerGamemode.hpp>
 #include <CoreLib/Components/PlayerControlledComponent.hpp>
 #include <CoreLib/Components/WeaponWielderComponent.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 namespace bw
 {
 	MatchClientSession::MatchClientSession(Match& match, std::size_t sessionId, PlayerCommandStore& commandStore, std::shared_ptr<SessionBridge> bridge) :
-	m_queuedInputs(4),
+	m_queuedInputs(2 * MaxInputDelay),
 	m_match(match),
+	m_packetPool(match.GetPacketPool()),
 	m_commandStore(commandStore),
 	m_sessionId(sessionId),
 	m_bridge(std::move(bridge)),
+	m_targetInputDelay(2),
 	m_ping(0),
-	m_peerInfoUpdateCounter(0.f)
+	m_inputJitter(0.f),
+	m_peerInfoUpdateCounter(0.f),
+	m_isBatchingPackets(false)
 	{
 		m_visibility = std::make_unique<MatchClientVisibility>(match, *this);
 		m_bridge->OnIncomingPacket.Connect([this](Nz::NetPacket& packet)
@@ -41,6 +49,12 @@ namespace bw
 		});
 	}
 
+	void MatchClientSession::BeginPacketBatch()
+	{
+		assert(!m_isBatchingPackets);
+		m_isBatchingPackets = true;
+	}
+
 	void MatchClientSession::Disconnect()
 	{
 		m_bridge->Disconnect();
@@ -55,24 +69,59 @@ namespace bw
 	{
 		if (!m_queuedInputs.IsEmpty())
 		{
-			Input inputData = m_queuedInputs.Dequeue();
-			m_lastInputTick = inputData.inputTick;
+			ApplyInput(m_queuedInputs.Dequeue());
 
-			for (std::size_t playerIndex = 0; playerIndex < inputData.inputs.size(); ++playerIndex)
-			{
-				const auto& inputOpt = inputData.inputs[playerIndex];
-				if (!inputOpt.has_value())
-					continue;
-
-				m_players[playerIndex]->UpdateInputs(*inputOpt);
-			}
+			// Drain inputs piling up over the target delay, to get back to it
+			if (m_queuedInputs.GetSize() > m_targetInputDelay)
+				ApplyInput(m_queuedInputs.Dequeue());
 		}
+		// When no input is available, players keep their previous inputs for this tick
 		/*else
 			bwLog(m_match.GetLogger(), LogLevel::Warning, "Player session #{} has no input for this tick", m_sessionId);*/
 	}
 
+	void MatchClientSession::SendPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet)
+	{
+		if (m_isBatchingPackets)
+		{
+			if (Nz::NetPacket* framePacket = GetFramePacket(channelId, flags))
+			{
+				framePacket->Write(packet.GetConstData() + Nz::NetPacket::HeaderSize, packet.GetDataSize() - Nz::NetPacket::HeaderSize);
+				m_packetPool.Release(std::move(packet));
+				return;
+			}
+
+			auto& outgoingPacket = m_packetBatch.emplace_back();
+			outgoingPacket.channelId = channelId;
+			outgoingPacket.flags = flags;
+			outgoingPacket.packet = std::move(packet);
+
+			return;
+		}
+
+		m_bridge->SendPacket(channelId, flags, std::move(packet));
+	}
+
+	void MatchClientSession::SubmitPacketBatch()
+	{
+		assert(m_isBatchingPackets);
+		m_isBatchingPackets = false;
+
+		FlushFramePacket();
+
+		if (m_packetBatch.empty())
+			return;
+
+		// Packets are handed to the bridge all at once, allowing the network reactor to enqueue them in one operation
+		m_bridge->SendPacketBatch(m_packetBatch.data(), m_packetBatch.size());
+		m_packetBatch.clear();
+	}
+
 	void MatchClientSession::Update(float elapsedTime)
 	{
+		// Gather every packet of this tick, the match submits them once every session has been updated
+		BeginPacketBatch();
+
 		m_visibility->Update();
 
 		m_peerInfoUpdateCounter += elapsedTime;
@@ -90,6 +139,58 @@ namespace bw
 		}
 	}
 
+	void MatchClientSession::ApplyInput(const Input& input)
+	{
+		m_lastInputTick = input.inputTick;
+
+		for (std::size_t playerIndex = 0; playerIndex < input.inputs.size(); ++playerIndex)
+		{
+			const auto& inputOpt = input.inputs[playerIndex];
+			if (!inputOpt.has_value())
+				continue;
+
+			m_players[playerIndex]->UpdateInputs(*inputOpt);
+		}
+	}
+
+	void MatchClientSession::FlushFramePacket()
+	{
+		if (!m_framePacket)
+			return;
+
+		const auto& command = m_commandStore.GetOutgoingCommand<Packets::PacketFrame>();
+
+		auto& outgoingPacket = m_packetBatch.emplace_back();
+		outgoingPacket.channelId = command.channelId;
+		outgoingPacket.flags = command.flags;
+		outgoingPacket.packet = std::move(*m_framePacket);
+
+		m_framePacket.reset();
+	}
+
+	Nz::NetPacket* MatchClientSession::GetFramePacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags)
+	{
+		if (!m_isBatchingPackets)
+			return nullptr;
+
+		// Batched packets sharing the frame channel and flags are coalesced into a single frame packet
+		const auto& command = m_commandStore.GetOutgoingCommand<Packets::PacketFrame>();
+		if (channelId != command.channelId || flags != command.flags)
+		{
+			// Keep sending order by closing the current frame before any other packet
+			FlushFramePacket();
+			return nullptr;
+		}
+
+		if (!m_framePacket)
+		{
+			m_framePacket = m_packetPool.Acquire();
+			m_commandStore.SerializePacket(*m_framePacket, Packets::PacketFrame{});
+		}
+
+		return &m_framePacket.value();
+	}
+
 	void MatchClientSession::HandleIncomingPacket(const Packets::Auth& packet)
 	{
 		std::size_t playerCount = packet.players.size();
@@ -146,7 +247,7 @@ namespace bw
 		if (m_match.GetClientScript(packet.path, &clientScript))
 		{
 			Packets::DownloadClientScriptResponse response;
-			response.fileContent = clientScript->content;
+			response.fileContent = ByteView(clientScript->content); //< sent right away, no need to copy the script
 
 			SendPacket(response);
 		}
@@ -191,9 +292,17 @@ namespace bw
 			return;
 		}
 
+		if (packet.previousInputs.size() > Packets::PlayersInput::MaxPreviousInputCount)
+		{
+			bwLog(m_match.GetLogger(), LogLevel::Error, "Too many previous inputs ({0})", packet.previousInputs.size());
+			return;
+		}
+
+		UpdateInputJitter(packet.inputTick);
+
 		// Compute client error
 		Nz::UInt16 currentTick = m_match.GetNetworkTick();
-		Nz::UInt16 adjustedTick = currentTick + 2; // Prevent network jitter
+		Nz::UInt16 adjustedTick = currentTick + m_targetInputDelay; // Prevent network jitter
 		Nz::UInt16 estimatedServerTick = packet.estimatedServerTick;
 
 		//std::cout << "[Server] Estimated server tick: " << estimatedServerTick << " (current tick: " << adjustedTick << ")" << std::endl;
@@ -211,7 +320,21 @@ namespace bw
 
 		SendPacket(correctionPacket);
 
-		m_queuedInputs.Enqueue(Input{ std::move(packet.inputs), packet.inputTick });
+		if (packet.lastStateTick)
+			m_visibility->AcknowledgeMatchState(*packet.lastStateTick, packet.previousStateBits);
+
+		// Input packets are unreliable and repeat previous inputs, queue the ones we missed (oldest first)
+		Nz::UInt16 inputTick = packet.inputTick;
+		for (const auto& previousInputs : packet.previousInputs)
+			inputTick = static_cast<Nz::UInt16>(inputTick - previousInputs.tickDelta);
+
+		for (auto it = packet.previousInputs.rbegin(); it != packet.previousInputs.rend(); ++it)
+		{
+			QueueInput(it->inputs, inputTick);
+			inputTick = static_cast<Nz::UInt16>(inputTick + it->tickDelta);
+		}
+
+		QueueInput(packet.inputs, packet.inputTick);
 	}
 
 	void MatchClientSession::HandleIncomingPacket(const Packets::PlayerSelectWeapon& packet)
@@ -248,7 +371,21 @@ namespace bw
 
 		const std::string& packetName = stringStore.GetString(packet.nameIndex);
 
-		registry.Call(packetName, IncomingNetworkPacket(stringStore, packet));
+		// Packet content is only a view into the received data, scripts can't keep reading it afterwards
+		auto incomingPacket = std::make_shared<IncomingNetworkPacket>(stringStore, packet);
+		registry.Call(packetName, incomingPacket);
+		incomingPacket->Invalidate();
+	}
+
+	void MatchClientSession::HandleIncomingPacket(const Packets::UpdateCameraRect& packet)
+	{
+		if (!std::isfinite(packet.position.x) || !std::isfinite(packet.position.y) || !std::isfinite(packet.size.x) || !std::isfinite(packet.size.y))
+			return;
+
+		if (packet.size.x < 0.f || packet.size.y < 0.f)
+			return;
+
+		m_visibility->SetInterestArea(Nz::Rectf(packet.position.x, packet.position.y, packet.size.x, packet.size.y));
 	}
 
 	void MatchClientSession::HandleIncomingPacket(Packets::UpdatePlayerName&& packet)
@@ -262,6 +399,42 @@ namespace bw
 		m_players[packet.localIndex]->UpdateName(std::move(packet.newName));
 	}
 	
+	void MatchClientSession::QueueInput(const std::vector<std::optional<PlayerInputData>>& inputs, Nz::UInt16 inputTick)
+	{
+		if (m_lastReceivedInputTick && !IsMoreRecent(inputTick, *m_lastReceivedInputTick))
+			return; //< Already received
+
+		m_lastReceivedInputTick = inputTick;
+
+		// Inputs only hold changes and cannot be dropped, apply the oldest ones right away to make room
+		if (m_queuedInputs.IsFull())
+			ApplyInput(m_queuedInputs.Dequeue());
+
+		m_queuedInputs.Enqueue(Input{ inputs, inputTick });
+	}
+
+	void MatchClientSession::UpdateInputJitter(Nz::UInt16 inputTick)
+	{
+		Nz::UInt64 now = m_match.GetApp().GetAppTime();
+		float tickDuration = m_match.GetTickDuration();
+
+		if (m_lastInputArrivalTime)
+		{
+			// Inputs are sent every tick, any difference between their arrival interval and their tick interval is jitter
+			float arrivalDelta = (now - *m_lastInputArrivalTime) / 1000.f;
+			float tickDelta = static_cast<Nz::Int16>(inputTick - m_lastArrivalInputTick) * tickDuration;
+
+			// Smoothed like RFC 3550 interarrival jitter
+			m_inputJitter += (std::abs(arrivalDelta - tickDelta) - m_inputJitter) / 16.f;
+
+			float jitterTickCount = std::min(InputJitterMargin * m_inputJitter / tickDuration, float(MaxInputDelay));
+			m_targetInputDelay = std::min(static_cast<Nz::UInt16>(MinInputDelay + std::ceil(jitterTickCount)), MaxInputDelay);
+		}
+
+		m_lastInputArrivalTime = now;
+		m_lastArrivalInputTick = inputTick;
+	}
+
 	void MatchClientSession::UpdatePeerInfo(const SessionBridge::SessionInfo& sessionInfo)
 	{
 		m_ping = sessionInfo.ping;
@@ -5,17 +5,70 @@
 #include <CoreLib/MatchClientVisibility.hpp>
 #include <Nazara/Core/StackArray.hpp>
 #include <Nazara/Core/StackVector.hpp>
+#include <Nazara/Math/Algorithm.hpp>
 #include <CoreLib/Protocol/Packets.hpp>
 #include <CoreLib/MatchClientSession.hpp>
 #include <CoreLib/Terrain.hpp>
+#include <CoreLib/Utils.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <queue>
+#include <stdexcept>
 
 namespace bw
 {
+	void MatchClientVisibility::AcknowledgeMatchState(Nz::UInt16 stateTick, Nz::UInt32 previousStateBits)
+	{
+		AcknowledgeSentState(stateTick);
+		for (Nz::UInt16 i = 0; i < 32; ++i)
+		{
+			if (previousStateBits & (Nz::UInt32(1) << i))
+				AcknowledgeSentState(static_cast<Nz::UInt16>(stateTick - i - 1));
+		}
+
+		// Client would have acknowledged older states if it had received them
+		for (SentMatchState& sentState : m_sentMatchStates)
+		{
+			if (sentState.isValid && !sentState.isAcknowledged && IsMoreRecent(stateTick, sentState.stateTick))
+				HandleLostMatchState(sentState);
+		}
+	}
+
+	void MatchClientVisibility::AcknowledgeSentState(Nz::UInt16 stateTick)
+	{
+		SentMatchState& sentState = m_sentMatchStates[stateTick % m_sentMatchStates.size()];
+		if (!sentState.isValid || sentState.stateTick != stateTick || sentState.isAcknowledged)
+			return; //< Too old or already acknowledged
+
+		// Client now knows those entity states, they can be used as delta baseline
+		for (const SentEntity& sentEntity : sentState.entities)
+		{
+			auto layerIt = m_layers.find(LayerIndex(sentEntity.entityKey >> 32));
+			if (layerIt == m_layers.end())
+				continue;
+
+			// Entity may have been removed since, and its id reused by another entity which doesn't share its state
+			Nz::UInt32 entityId = Nz::UInt32(sentEntity.entityKey & 0xFFFFFFFF);
+			const Layer& layer = *layerIt.value();
+			if (!layer.visibleEntities.Contains(entityId) || IsMoreRecent(layer.visibleEntities.Get(entityId).visibilityTick, stateTick))
+				continue;
+
+			auto it = m_entityBaselines.find(sentEntity.entityKey);
+			if (it == m_entityBaselines.end())
+				m_entityBaselines.emplace(sentEntity.entityKey, EntityBaseline{ sentEntity.state, stateTick });
+			else if (IsMoreRecent(stateTick, it->second.stateTick))
+				it.value() = EntityBaseline{ sentEntity.state, stateTick };
+		}
+
+		sentState.isAcknowledged = true;
+	}
+
 	void MatchClientVisibility::ShowLayer(LayerIndex layerIndex)
 	{
-		m_newlyHiddenLayers.UnboundedReset(layerIndex);
+		// Client only received part of the layer if its activation was interrupted, it has to be disabled and sent again
+		if (!m_activatingLayers.UnboundedTest(layerIndex))
+			m_newlyHiddenLayers.UnboundedReset(layerIndex);
 
 		if (auto it = m_layers.find(layerIndex); it != m_layers.end())
 		{
@@ -32,131 +85,38 @@ namespace bw
 			/* Create all newly visible entities */
 			TerrainLayer& terrainLayer = terrain.GetLayer(layerIndex);
 			NetworkSyncSystem& syncSystem = terrainLayer.GetWorld().GetSystem<NetworkSyncSystem>();
-			
-			layer.onEntityCreatedSlot.Connect(syncSystem.OnEntityCreated, [this](NetworkSyncSystem* syncSystem, const NetworkSyncSystem::EntityCreation& entityCreation)
-			{
-				HandleEntityCreation(syncSystem->GetLayer().GetLayerIndex(), entityCreation);
-			});
-
-			layer.onEntityDeletedSlot.Connect(syncSystem.OnEntityDeleted, [this](NetworkSyncSystem* syncSystem, const NetworkSyncSystem::EntityDestruction& entityDestruction)
-			{
-				HandleEntityRemove(syncSystem->GetLayer().GetLayerIndex(), entityDestruction.entityId, false);
-			});
-
-			layer.onEntityInvalidated.Connect(syncSystem.OnEntityInvalidated, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityMovement& entityMovement)
-			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-
-				if (layer.visibleEntities.find(entityMovement.entityId) == layer.visibleEntities.end())
-					return;
-
-				layer.staticMovementUpdateEvents[entityMovement.entityId] = entityMovement;
-			});
-
-			layer.onEntityPlayAnimation.Connect(syncSystem.OnEntityPlayAnimation, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityPlayAnimation& entityPlayAnimation)
-			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-
-				if (layer.visibleEntities.find(entityPlayAnimation.entityId) == layer.visibleEntities.end())
-					return;
-
-				layer.playAnimationEvents[entityPlayAnimation.entityId] = entityPlayAnimation;
-				m_pendingEvents.Set(VisibilityEventType::PlayAnimation);
-			});
-
-			layer.onEntityDeath.Connect(syncSystem.OnEntityDeath, [this](NetworkSyncSystem* syncSystem, const NetworkSyncSystem::EntityDeath& entityDeath)
-			{
-				HandleEntityRemove(syncSystem->GetLayer().GetLayerIndex(), entityDeath.entityId, true);
-			});
-
-			layer.onEntitiesHealthUpdate.Connect(syncSystem.OnEntitiesHealthUpdate, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityHealth* events, std::size_t entityCount)
-			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-				
-				for (std::size_t i = 0; i < entityCount; ++i)
-				{
-					if (layer.visibleEntities.find(events[i].entityId) == layer.visibleEntities.end())
-						continue;
-
-					layer.healthUpdateEvents[events[i].entityId] = events[i];
-					m_pendingEvents.Set(VisibilityEventType::HealthUpdate);
-				}
-			});
-
-			layer.onEntitiesInputUpdate.Connect(syncSystem.OnEntitiesInputUpdate, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityInputs* events, std::size_t entityCount)
-			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-
-				for (std::size_t i = 0; i < entityCount; ++i)
-				{
-					Nz::UInt64 entityKey = Nz::UInt64(layerIndex) << 32 | events[i].entityId;
-					if (m_controlledEntities.find(entityKey) != m_controlledEntities.end())
-						continue;
+			layer.syncSystem = &syncSystem;
 
-					if (layer.visibleEntities.find(events[i].entityId) == layer.visibleEntities.end())
-						continue;
+			// Only events published from now on are relevant
+			layer.journalCursor = syncSystem.GetJournalEnd();
 
-					layer.inputUpdateEvents[events[i].entityId] = events[i];
-					m_pendingEvents.Set(VisibilityEventType::InputUpdate);
-				}
-			});
+			m_newlyVisibleLayers.UnboundedSet(layerIndex);
+		}
+	}
 
-			layer.onEntitiesPhysicsUpdate.Connect(syncSystem.OnEntitiesPhysicsUpdate, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityPhysics* events, std::size_t entityCount)
-			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
+	void MatchClientVisibility::Update()
+	{
+		Nz::UInt16 networkTick = m_match.GetNetworkTick();
+		std::size_t activationBudget = LayerActivationBudget;
 
-				for (std::size_t i = 0; i < entityCount; ++i)
-				{
-					if (layer.visibleEntities.find(events[i].entityId) == layer.visibleEntities.end())
-						continue;
+		// Catch up on entity events published by the layers since last update
+		for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
+		{
+			LayerIndex layerIndex = it.key();
+			Layer& layer = *it.value();
 
-					layer.physicsEvents[events[i].entityId] = events[i];
-					m_pendingEvents.Set(VisibilityEventType::PhysicsUpdate);
-				}
-			});
-			
-			layer.onEntitiesScaleUpdate.Connect(syncSystem.OnEntitiesScaleUpdate, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityScale* events, std::size_t entityCount)
+			// Layers about to be activated are sent from their current state, past events are irrelevant
+			if (m_newlyVisibleLayers.UnboundedTest(layerIndex) && !m_clientVisibleLayers.UnboundedTest(layerIndex))
 			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-
-				for (std::size_t i = 0; i < entityCount; ++i)
-				{
-					if (layer.visibleEntities.find(events[i].entityId) == layer.visibleEntities.end())
-						continue;
-
-					layer.scaleEvents[events[i].entityId] = events[i];
-					m_pendingEvents.Set(VisibilityEventType::ScaleUpdate);
-				}
-			});
+				layer.journalCursor = layer.syncSystem->GetJournalEnd();
+				continue;
+			}
 
-			layer.onEntitiesWeaponUpdate.Connect(syncSystem.OnEntitiesWeaponUpdate, [this, layerIndex](NetworkSyncSystem*, const NetworkSyncSystem::EntityWeapon* events, std::size_t entityCount)
+			layer.syncSystem->ReadJournal(layer.journalCursor, [&](const auto&... eventArgs)
 			{
-				assert(m_layers.find(layerIndex) != m_layers.end());
-				Layer& layer = *m_layers[layerIndex];
-
-				for (std::size_t i = 0; i < entityCount; ++i)
-				{
-					if (layer.visibleEntities.find(events[i].entityId) == layer.visibleEntities.end())
-						continue;
-
-					layer.weaponEvents[events[i].entityId] = events[i];
-					m_pendingEvents.Set(VisibilityEventType::WeaponUpdate);
-				}
+				HandleSyncEvent(layerIndex, layer, eventArgs...);
 			});
-
-			m_newlyVisibleLayers.UnboundedSet(layerIndex);
 		}
-	}
-
-	void MatchClientVisibility::Update()
-	{
-		Nz::UInt16 networkTick = m_match.GetNetworkTick();
 
 		// Handle hidden and shown layers
 		if (m_newlyHiddenLayers.GetSize() != 0)
@@ -175,6 +135,7 @@ namespace bw
 				
 				m_session.SendPacket(disableLayer);
 
+				m_activatingLayers.UnboundedReset(layerIndex);
 				m_clientVisibleLayers.UnboundedReset(layerIndex);
 			}
 			m_newlyHiddenLayers.Clear();
@@ -197,8 +158,6 @@ namespace bw
 
 		if (m_newlyVisibleLayers.GetSize() != 0)
 		{
-			PendingCreationEventMap pendingCreationMap; //< Used to resolve parenting
-
 			for (std::size_t i = m_newlyVisibleLayers.FindFirst(); i != m_newlyVisibleLayers.npos; i = m_newlyVisibleLayers.FindNext(i))
 			{
 				LayerIndex layerIndex = LayerIndex(i);
@@ -217,76 +176,36 @@ namespace bw
 				if (m_clientVisibleLayers.UnboundedTest(i))
 				{
 					for (const Ndk::EntityHandle& entity : syncSystem.GetEntities())
-						layer.visibleEntities.emplace(entity->GetId(), Layer::VisibleEntityData{});
+						AddVisibleEntity(layer, entity->GetId());
 
 					continue;
 				}
 
-				syncSystem.CreateEntities([&](const NetworkSyncSystem::EntityCreation* entitiesCreation, std::size_t entityCount)
-				{
-					for (std::size_t i = 0; i < entityCount; ++i)
-					{
-						if (layer.visibleEntities.find(entitiesCreation[i].entityId) == layer.visibleEntities.end())
-							pendingCreationMap[entitiesCreation[i].entityId] = entitiesCreation[i];
-					}
-				});
+				PrepareLayerActivation(layerIndex, layer);
 
 				Packets::EnableLayer enableLayerPacket;
+				enableLayerPacket.entityCount = static_cast<Nz::UInt32>(StreamLayerActivation(layerIndex, layer, activationBudget));
 				enableLayerPacket.layerIndex = layerIndex;
 				enableLayerPacket.stateTick = networkTick;
 
-				std::function<void(PendingCreationEventMap::iterator it)> PushEntity;
-				PushEntity = [&](PendingCreationEventMap::iterator it)
+				// Only the closest entities are sent along the layer, the others follow over the next ticks
+				m_session.SendPacket(enableLayerPacket, [&](Nz::ByteStream& stream)
 				{
-					auto& entityId = it.key();
-					auto& eventData = it.value();
-					if (!eventData.has_value())
-						return;
-
-					auto HandleDependentEntity = [&](Nz::UInt32 entityId)
-					{
-						auto dependentIt = pendingCreationMap.find(entityId);
-						if (dependentIt != pendingCreationMap.end() && dependentIt != it)
-							PushEntity(dependentIt);
-					};
-
-					if (eventData->parent)
-						HandleDependentEntity(static_cast<Nz::UInt32>(eventData->parent.value()));
-
-					if (eventData->weapon)
-					{
-						NetworkSyncSystem::EntityWeapon weaponEvent;
-						weaponEvent.entityId = eventData->entityId;
-						weaponEvent.weaponId = eventData->weapon.value();
-
-						layer.weaponEvents[weaponEvent.entityId] = weaponEvent;
-						m_pendingEvents.Set(VisibilityEventType::WeaponUpdate);
-					}
-
-					for (auto&& [layerIndex, entityIndex] : eventData->dependentIds)
-						HandleDependentEntity(static_cast<Nz::UInt32>(entityIndex));
-
-					auto& entityData = enableLayerPacket.layerEntities.emplace_back();
-					entityData.id = eventData->entityId;
-					FillEntityData(eventData.value(), entityData.data);
-
-					layer.visibleEntities.emplace(entityId, Layer::VisibleEntityData{});
-
-					eventData.reset();
-				};
-
-				for (auto it = pendingCreationMap.begin(); it != pendingCreationMap.end(); ++it)
-					PushEntity(it);
-
-				m_session.SendPacket(enableLayerPacket);
+					WriteActivationRecords(stream);
+				});
 
+				m_activatingLayers.UnboundedSet(layerIndex);
 				m_clientVisibleLayers.UnboundedSet(layerIndex);
-
-				pendingCreationMap.clear();
 			}
 			m_newlyVisibleLayers.Clear();
 		}
 
+		if (m_interestArea)
+		{
+			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
+				UpdateInterest(it.key(), *it.value());
+		}
+
 		// Send packet in fixed order
 		if (m_pendingEvents.Test(VisibilityEventType::Death))
 		{
@@ -298,19 +217,20 @@ namespace bw
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.deathEvents.empty())
+				if (layer.deathEvents.FindFirst() == layer.deathEvents.npos)
 					continue;
 
-				auto& layerData = m_entitiesDeathPacket.layers.emplace_back();
-				layerData.layerIndex = it.key();
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.deathEvents.size());
-
-				for (Nz::UInt32 entityId : layer.deathEvents)
+				std::size_t firstEntity = m_entitiesDeathPacket.entities.size();
+				for (std::size_t entityId = layer.deathEvents.FindFirst(); entityId != layer.deathEvents.npos; entityId = layer.deathEvents.FindNext(entityId))
 				{
 					auto& entityData = m_entitiesDeathPacket.entities.emplace_back();
-					entityData.id = entityId;
+					entityData.id = static_cast<Nz::UInt32>(entityId);
 				}
-				layer.deathEvents.clear();
+				layer.deathEvents.Clear();
+
+				auto& layerData = m_entitiesDeathPacket.layers.emplace_back();
+				layerData.layerIndex = it.key();
+				layerData.entityCount = static_cast<Nz::UInt32>(m_entitiesDeathPacket.entities.size() - firstEntity);
 			}
 
 			m_session.SendPacket(m_entitiesDeathPacket);
@@ -328,21 +248,20 @@ namespace bw
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.destructionEvents.empty())
+				if (layer.destructionEvents.FindFirst() == layer.destructionEvents.npos)
 					continue;
 
-				LayerIndex layerIndex = it.key();
-
-				auto& layerData = m_deleteEntitiesPacket.layers.emplace_back();
-				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.destructionEvents.size());
-
-				for (Nz::UInt32 entityId : layer.destructionEvents)
+				std::size_t firstEntity = m_deleteEntitiesPacket.entities.size();
+				for (std::size_t entityId = layer.destructionEvents.FindFirst(); entityId != layer.destructionEvents.npos; entityId = layer.destructionEvents.FindNext(entityId))
 				{
 					auto& entityData = m_deleteEntitiesPacket.entities.emplace_back();
-					entityData.id = entityId;
+					entityData.id = static_cast<Nz::UInt32>(entityId);
 				}
-				layer.destructionEvents.clear();
+				layer.destructionEvents.Clear();
+
+				auto& layerData = m_deleteEntitiesPacket.layers.emplace_back();
+				layerData.layerIndex = it.key();
+				layerData.entityCount = static_cast<Nz::UInt32>(m_deleteEntitiesPacket.entities.size() - firstEntity);
 			}
 
 			m_session.SendPacket(m_deleteEntitiesPacket);
@@ -350,103 +269,86 @@ namespace bw
 			m_pendingEvents.Clear(VisibilityEventType::Destruction);
 		}
 
-		if (m_pendingEvents.Test(VisibilityEventType::Creation))
+		// Entities of activated layers are streamed after destructions, as their ids may have been reused
+		for (std::size_t i = m_activatingLayers.FindFirst(); i != m_activatingLayers.npos; i = m_activatingLayers.FindNext(i))
 		{
-			m_createEntitiesPacket.stateTick = networkTick;
+			LayerIndex layerIndex = LayerIndex(i);
 
-			m_createEntitiesPacket.entities.clear();
-			m_createEntitiesPacket.layers.clear();
+			auto layerIt = m_layers.find(layerIndex);
+			assert(layerIt != m_layers.end());
+			Layer& layer = *layerIt.value();
 
-			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
+			if (std::size_t entityCount = StreamLayerActivation(layerIndex, layer, activationBudget); entityCount > 0)
 			{
-				auto& layer = *it.value();
-				if (layer.creationEvents.empty())
-					continue;
-
-				LayerIndex layerIndex = it.key();
-
-				std::function<void(PendingCreationEventMap::iterator it)> PushEntity;
-				PushEntity = [&](PendingCreationEventMap::iterator it)
-				{
-					auto& eventData = it.value();
-					if (!eventData.has_value())
-						return;
-
-					auto HandleDependentEntity = [&](Nz::UInt32 entityId)
-					{
-						auto dependentIt = layer.creationEvents.find(entityId);
-						if (dependentIt != layer.creationEvents.end() && dependentIt != it)
-							PushEntity(dependentIt);
-					};
-
-					if (eventData->parent)
-						HandleDependentEntity(static_cast<Nz::UInt32>(eventData->parent.value()));
-
-					if (eventData->weapon)
-					{
-						NetworkSyncSystem::EntityWeapon weaponEvent;
-						weaponEvent.entityId = eventData->entityId;
-						weaponEvent.weaponId = eventData->weapon.value();
-
-						layer.weaponEvents[weaponEvent.entityId] = weaponEvent;
-						m_pendingEvents.Set(VisibilityEventType::WeaponUpdate);
-					}
+				m_createEntitiesPacket.stateTick = networkTick;
 
-					for (auto&& [layerIndex, entityIndex] : eventData->dependentIds)
-						HandleDependentEntity(static_cast<Nz::UInt32>(entityIndex));
-
-					auto& entityData = m_createEntitiesPacket.entities.emplace_back();
-					entityData.id = eventData->entityId;
-					FillEntityData(eventData.value(), entityData.data);
-
-					eventData.reset();
-				};
+				m_createEntitiesPacket.layers.clear();
 
 				auto& layerData = m_createEntitiesPacket.layers.emplace_back();
 				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.creationEvents.size());
+				layerData.entityCount = static_cast<Nz::UInt32>(entityCount);
 
-				for (auto eventIt = layer.creationEvents.begin(); eventIt != layer.creationEvents.end(); ++eventIt)
-					PushEntity(eventIt);
-				layer.creationEvents.clear();
+				m_session.SendPacket(m_createEntitiesPacket, [&](Nz::ByteStream& stream)
+				{
+					WriteActivationRecords(stream);
+				});
 			}
 
-			m_session.SendPacket(m_createEntitiesPacket);
+			// Let the client know every entity of the layer was sent
+			if (layer.activationQueue.empty())
+			{
+				Packets::LayerActivated layerActivated;
+				layerActivated.layerIndex = layerIndex;
+				layerActivated.stateTick = networkTick;
 
-			m_pendingEvents.Clear(VisibilityEventType::Creation);
+				m_session.SendPacket(layerActivated);
+
+				m_activatingLayers.Reset(i);
+			}
 		}
 
-		if (m_pendingEvents.Test(VisibilityEventType::HealthUpdate))
+		if (m_pendingEvents.Test(VisibilityEventType::Creation))
 		{
-			m_healthUpdatePacket.stateTick = networkTick;
+			m_createEntitiesPacket.stateTick = networkTick;
 
-			m_healthUpdatePacket.entities.clear();
-			m_healthUpdatePacket.layers.clear();
+			m_createEntitiesPacket.layers.clear();
+			m_createdEntities.clear();
 
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.healthUpdateEvents.empty())
+				if (layer.creationEvents.FindFirst() == layer.creationEvents.npos)
 					continue;
 
-				LayerIndex layerIndex = it.key();
+				std::size_t firstEntity = m_createdEntities.size();
+				FlushCreationEvents(layer, [&](Nz::UInt32 entityId)
+				{
+					m_createdEntities.emplace_back(layer.syncSystem, entityId);
+				});
 
-				auto& layerData = m_healthUpdatePacket.layers.emplace_back();
-				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.healthUpdateEvents.size());
+				auto& layerData = m_createEntitiesPacket.layers.emplace_back();
+				layerData.layerIndex = it.key();
+				layerData.entityCount = static_cast<Nz::UInt32>(m_createdEntities.size() - firstEntity);
+			}
 
-				for (auto&& pair : layer.healthUpdateEvents)
+			// Entities may have been sent along their layer
+			if (!m_createEntitiesPacket.layers.empty())
+			{
+				m_session.SendPacket(m_createEntitiesPacket, [&](Nz::ByteStream& stream)
 				{
-					auto& eventData = pair.second;
-					
-					auto& entityData = m_healthUpdatePacket.entities.emplace_back();
-					entityData.id = pair.first;
-					entityData.currentHealth = eventData.currentHealth;
-				}
-				layer.healthUpdateEvents.clear();
+					for (auto&& [entitySyncSystem, entityId] : m_createdEntities)
+						entitySyncSystem->WriteCreationRecord(stream, entityId);
+				});
 			}
 
-			m_session.SendPacket(m_healthUpdatePacket);
+			m_pendingEvents.Clear(VisibilityEventType::Creation);
+		}
+
+		if (m_pendingEvents.Test(VisibilityEventType::HealthUpdate))
+		{
+			m_healthUpdatePacket.stateTick = networkTick;
+
+			SendEntityRecords(m_healthUpdatePacket, &Layer::healthUpdateEvents, &NetworkSyncSystem::GetHealthRecords);
 
 			m_pendingEvents.Clear(VisibilityEventType::HealthUpdate);
 		}
@@ -455,33 +357,7 @@ namespace bw
 		{
 			m_inputUpdatePacket.stateTick = networkTick;
 
-			m_inputUpdatePacket.entities.clear();
-			m_inputUpdatePacket.layers.clear();
-
-			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
-			{
-				auto& layer = *it.value();
-				if (layer.inputUpdateEvents.empty())
-					continue;
-
-				LayerIndex layerIndex = it.key();
-
-				auto& layerData = m_inputUpdatePacket.layers.emplace_back();
-				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.inputUpdateEvents.size());
-
-				for (auto&& pair : layer.inputUpdateEvents)
-				{
-					auto& eventData = pair.second;
-
-					auto& entityData = m_inputUpdatePacket.entities.emplace_back();
-					entityData.id = pair.first;
-					entityData.inputs = eventData.inputs;
-				}
-				layer.inputUpdateEvents.clear();
-			}
-
-			m_session.SendPacket(m_inputUpdatePacket);
+			SendEntityRecords(m_inputUpdatePacket, &Layer::inputUpdateEvents, &NetworkSyncSystem::GetInputRecords);
 
 			m_pendingEvents.Clear(VisibilityEventType::InputUpdate);
 		}
@@ -496,24 +372,22 @@ namespace bw
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.playAnimationEvents.empty())
+				if (layer.playAnimationEvents.IsEmpty())
 					continue;
 
 				LayerIndex layerIndex = it.key();
 
 				auto& layerData = m_entitiesAnimationPacket.layers.emplace_back();
 				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.playAnimationEvents.size());
+				layerData.entityCount = static_cast<Nz::UInt32>(layer.playAnimationEvents.GetSize());
 
-				for (auto&& pair : layer.playAnimationEvents)
+				layer.playAnimationEvents.ForEach([&](Nz::UInt32 entityId, const NetworkSyncSystem::EntityPlayAnimation& eventData)
 				{
-					auto& eventData = pair.second;
-
 					auto& entityData = m_entitiesAnimationPacket.entities.emplace_back();
-					entityData.entityId = pair.first;
+					entityData.entityId = entityId;
 					entityData.animId = static_cast<Nz::UInt8>(eventData.animId);
-				}
-				layer.playAnimationEvents.clear();
+				});
+				layer.playAnimationEvents.Clear();
 			}
 
 			m_session.SendPacket(m_entitiesAnimationPacket);
@@ -526,37 +400,26 @@ namespace bw
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.physicsEvents.empty())
+				if (layer.physicsEvents.IsEmpty())
 					continue;
 
 				LayerIndex layerIndex = it.key();
+				const EntityRecordBlock& physicsRecords = layer.syncSystem->GetPhysicsRecords();
 
-				for (auto&& pair : layer.physicsEvents)
+				layer.physicsEvents.ForEach([&](Nz::UInt32 entityId, std::size_t recordIndex)
 				{
 					Packets::EntityPhysics physicsPacket;
 					physicsPacket.entityId.layerId = layerIndex;
-					physicsPacket.entityId.entityId = pair.first;
+					physicsPacket.entityId.entityId = entityId;
 					physicsPacket.stateTick = networkTick;
 
-					auto& physicsData = pair.second;
-					physicsPacket.asleep = physicsData.isAsleep;
-					physicsPacket.mass = physicsData.mass;
-					physicsPacket.momentOfInertia = physicsData.momentOfInertia;
-					
-					if (physicsData.playerMovement)
+					m_session.SendPacket(physicsPacket, [&](Nz::ByteStream& stream)
 					{
-						const auto& playerMovementData = physicsData.playerMovement.value();
-
-						auto& packetMovement = physicsPacket.playerMovement.emplace();
-						packetMovement.jumpHeight = playerMovementData.jumpHeight;
-						packetMovement.jumpHeightBoost = playerMovementData.jumpHeightBoost;
-						packetMovement.movementSpeed = playerMovementData.movementSpeed;
-					}
-
-					m_session.SendPacket(physicsPacket);
-				}
+						physicsRecords.WriteRecord(stream, recordIndex);
+					});
+				});
 
-				layer.physicsEvents.clear();
+				layer.physicsEvents.Clear();
 			}
 
 			m_pendingEvents.Clear(VisibilityEventType::PhysicsUpdate);
@@ -566,32 +429,7 @@ namespace bw
 		{
 			m_scaleUpdatePacket.stateTick = networkTick;
 
-			m_scaleUpdatePacket.entities.clear();
-			m_scaleUpdatePacket.layers.clear();
-
-			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
-			{
-				auto& layer = *it.value();
-				if (layer.scaleEvents.empty())
-					continue;
-
-				LayerIndex layerIndex = it.key();
-
-				auto& layerData = m_scaleUpdatePacket.layers.emplace_back();
-				layerData.layerIndex = layerIndex;
-				layerData.entityCount = static_cast<Nz::UInt32>(layer.scaleEvents.size());
-
-				for (auto&& pair : layer.scaleEvents)
-				{
-					auto& entityData = m_scaleUpdatePacket.entities.emplace_back();
-					entityData.id = pair.first;
-					entityData.newScale = pair.second.newScale;
-				}
-
-				layer.scaleEvents.clear();
-			}
-
-			m_session.SendPacket(m_scaleUpdatePacket);
+			SendEntityRecords(m_scaleUpdatePacket, &Layer::scaleEvents, &NetworkSyncSystem::GetScaleRecords);
 
 			m_pendingEvents.Clear(VisibilityEventType::ScaleUpdate);
 		}
@@ -601,25 +439,23 @@ namespace bw
 			for (auto it = m_layers.begin(); it != m_layers.end(); ++it)
 			{
 				auto& layer = *it.value();
-				if (layer.weaponEvents.empty())
+				if (layer.weaponEvents.IsEmpty())
 					continue;
 
 				LayerIndex layerIndex = it.key();
 
-				for (auto&& pair : layer.weaponEvents)
+				layer.weaponEvents.ForEach([&](Nz::UInt32 entityId, const NetworkSyncSystem::EntityWeapon& weaponData)
 				{
 					Packets::EntityWeapon weaponPacket;
 					weaponPacket.entityId.layerId = layerIndex;
-					weaponPacket.entityId.entityId = pair.first;
+					weaponPacket.entityId.entityId = entityId;
 					weaponPacket.stateTick = networkTick;
-
-					auto& weaponData = pair.second;
 					weaponPacket.weaponEntityId = (weaponData.weaponId.has_value()) ? weaponData.weaponId.value() : Packets::EntityWeapon::NoWeapon;
 
 					m_session.SendPacket(weaponPacket);
-				}
+				});
 
-				layer.weaponEvents.clear();
+				layer.weaponEvents.Clear();
 			}
 
 			m_pendingEvents.Clear(VisibilityEventType::WeaponUpdate);
@@ -641,7 +477,7 @@ namespace bw
 			}
 			Layer& layer = *m_layers[layerId];
 
-			if (layer.visibleEntities.find(entityId) != layer.visibleEntities.end())
+			if (layer.visibleEntities.Contains(entityId))
 			{
 				auto& callbackVec = it.value();
 				for (auto&& func : callbackVec)
@@ -667,7 +503,7 @@ namespace bw
 			bool allEntitiesVisible = true;
 			for (std::size_t i = it->entitiesId.FindFirst(); i != it->entitiesId.npos; i = it->entitiesId.FindNext(i))
 			{
-				if (layer.visibleEntities.find(Nz::UInt32(i)) == layer.visibleEntities.end())
+				if (!layer.visibleEntities.Contains(Nz::UInt32(i)))
 				{
 					allEntitiesVisible = false;
 					break;
@@ -685,12 +521,50 @@ namespace bw
 		}
 	}
 
-	void MatchClientVisibility::HandleEntityCreation(LayerIndex layerIndex, const NetworkSyncSystem::EntityCreation& eventData)
+	void MatchClientVisibility::ActivateRoot(Layer& layer, Ndk::EntityId rootId)
+	{
+		layer.activationRoots.UnboundedReset(rootId);
+
+		layer.syncSystem->ForEachEntityInTree(rootId, [&](Ndk::EntityId entityId)
+		{
+			if (layer.visibleEntities.Contains(entityId))
+				return;
+
+			AddVisibleEntity(layer, entityId);
+			layer.creationEvents.UnboundedSet(entityId);
+		});
+
+		m_pendingEvents.Set(VisibilityEventType::Creation);
+	}
+
+	void MatchClientVisibility::AddVisibleEntity(Layer& layer, Ndk::EntityId entityId)
+	{
+		// Grow every per-entity array at once, so events of this entity don't allocate when registered
+		std::size_t idCount = std::size_t(entityId) + 1;
+		layer.inputUpdateEvents.Reserve(idCount);
+		layer.healthUpdateEvents.Reserve(idCount);
+		layer.staticMovementUpdateEvents.Reserve(idCount);
+		layer.playAnimationEvents.Reserve(idCount);
+		layer.physicsEvents.Reserve(idCount);
+		layer.scaleEvents.Reserve(idCount);
+		layer.weaponEvents.Reserve(idCount);
+
+		Layer::VisibleEntityData visibleData;
+		visibleData.visibilityTick = m_match.GetNetworkTick();
+
+		layer.visibleEntities.Insert(entityId, visibleData);
+
+		if (layer.syncSystem->GetRootEntity(entityId) == entityId)
+			layer.interestRoots.UnboundedSet(entityId);
+	}
+
+	void MatchClientVisibility::HandleEntityCreation(LayerIndex layerIndex, Ndk::EntityId entityId)
 	{
 		assert(m_layers.find(layerIndex) != m_layers.end());
 		Layer& layer = *m_layers[layerIndex];
-		layer.creationEvents[eventData.entityId] = eventData;
-		layer.visibleEntities.emplace(eventData.entityId, Layer::VisibleEntityData{});
+
+		AddVisibleEntity(layer, entityId);
+		layer.creationEvents.UnboundedSet(entityId);
 
 		m_pendingEvents.Set(VisibilityEventType::Creation);
 	}
@@ -700,47 +574,284 @@ namespace bw
 		assert(m_layers.find(layerIndex) != m_layers.end());
 		Layer& layer = *m_layers[layerIndex];
 
+		// Root may be waiting for the layer activation
+		layer.activationRoots.UnboundedReset(entityId);
+
+		// Entity was never sent to the client (or was already removed)
+		if (!layer.visibleEntities.Contains(entityId))
+			return;
+
 		// Only send entity destruction packet if this entity was already created client-side
-		auto it = layer.creationEvents.find(entityId);
-		if (it != layer.creationEvents.end())
-			layer.creationEvents.erase(it);
+		if (layer.creationEvents.UnboundedTest(entityId))
+			layer.creationEvents.Reset(entityId);
 		else
 		{
 			if (deathEvent)
 			{
-				layer.deathEvents.insert(entityId);
+				layer.deathEvents.UnboundedSet(entityId);
 				m_pendingEvents.Set(VisibilityEventType::Death);
 			}
 			else
 			{
-				layer.destructionEvents.insert(entityId);
+				layer.destructionEvents.UnboundedSet(entityId);
 				m_pendingEvents.Set(VisibilityEventType::Destruction);
 			}
 		}
 
-		layer.inputUpdateEvents.erase(entityId);
-		layer.healthUpdateEvents.erase(entityId);
-		layer.physicsEvents.erase(entityId);
-		layer.playAnimationEvents.erase(entityId);
-		layer.staticMovementUpdateEvents.erase(entityId);
-		layer.visibleEntities.erase(entityId);
-		layer.weaponEvents.erase(entityId);
+		layer.inputUpdateEvents.Erase(entityId);
+		layer.healthUpdateEvents.Erase(entityId);
+		layer.interestRoots.UnboundedReset(entityId);
+		layer.physicsEvents.Erase(entityId);
+		layer.playAnimationEvents.Erase(entityId);
+		layer.scaleEvents.Erase(entityId);
+		layer.staticMovementUpdateEvents.Erase(entityId);
+		layer.visibleEntities.Erase(entityId);
+		layer.weaponEvents.Erase(entityId);
+
+		m_entityBaselines.erase(Nz::UInt64(layerIndex) << 32 | entityId);
+	}
+
+	void MatchClientVisibility::HandleLostMatchState(SentMatchState& sentState)
+	{
+		if (sentState.isLost)
+			return;
+
+		sentState.isLost = true;
+
+		for (const SentEntity& sentEntity : sentState.entities)
+		{
+			auto layerIt = m_layers.find(LayerIndex(sentEntity.entityKey >> 32));
+			if (layerIt == m_layers.end())
+				continue;
+
+			Layer& layer = *layerIt.value();
+
+			Nz::UInt32 entityId = Nz::UInt32(sentEntity.entityKey & 0xFFFFFFFF);
+
+			if (!layer.visibleEntities.Contains(entityId))
+				continue;
+
+			// Entity was sent again since then, the more recent state supersedes this one
+			auto& visibleData = layer.visibleEntities.Get(entityId);
+			if (visibleData.lastSentStateTick != sentState.stateTick)
+				continue;
+
+			visibleData.priorityAccumulator += sentEntity.priority;
+
+			// Static entities are only sent when they change, queue their state again
+			if (sentEntity.staticMovement && !layer.staticMovementUpdateEvents.Contains(entityId))
+				layer.staticMovementUpdateEvents.Insert(entityId, *sentEntity.staticMovement);
+		}
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityCreation& entityCreation)
+	{
+		// Entities outside of the interest area are created once they enter it
+		Ndk::EntityId rootId = layer.syncSystem->GetRootEntity(entityCreation.entityId);
+		if (rootId == entityCreation.entityId)
+		{
+			if (!IsInInterestArea(layerIndex, layer, rootId, InterestEnterMargin))
+				return;
+		}
+		else if (m_interestArea && !layer.interestRoots.UnboundedTest(rootId))
+			return;
+		else if (layer.activationRoots.UnboundedTest(rootId))
+			return; //< Will be sent along its root
+
+		HandleEntityCreation(layerIndex, entityCreation.entityId);
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex layerIndex, Layer& /*layer*/, const NetworkSyncSystem::EntityDeath& entityDeath)
+	{
+		HandleEntityRemove(layerIndex, entityDeath.entityId, true);
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex layerIndex, Layer& /*layer*/, const NetworkSyncSystem::EntityDestruction& entityDestruction)
+	{
+		HandleEntityRemove(layerIndex, entityDestruction.entityId, false);
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityMovement& entityMovement)
+	{
+		// Static entity was moved
+		if (!layer.visibleEntities.Contains(entityMovement.entityId))
+			return;
+
+		layer.staticMovementUpdateEvents.Insert(entityMovement.entityId, entityMovement);
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityPlayAnimation& entityPlayAnimation)
+	{
+		if (!layer.visibleEntities.Contains(entityPlayAnimation.entityId))
+			return;
+
+		layer.playAnimationEvents.Insert(entityPlayAnimation.entityId, entityPlayAnimation);
+		m_pendingEvents.Set(VisibilityEventType::PlayAnimation);
+	}
+
+	// Only the index of the event record is kept, as records are encoded once by the NetworkSyncSystem for every session
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityHealth* events, std::size_t entityCount)
+	{
+		for (std::size_t i = 0; i < entityCount; ++i)
+		{
+			if (!layer.visibleEntities.Contains(events[i].entityId))
+				continue;
+
+			layer.healthUpdateEvents.Insert(events[i].entityId, i);
+			m_pendingEvents.Set(VisibilityEventType::HealthUpdate);
+		}
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex layerIndex, Layer& layer, const NetworkSyncSystem::EntityInputs* events, std::size_t entityCount)
+	{
+		for (std::size_t i = 0; i < entityCount; ++i)
+		{
+			Nz::UInt64 entityKey = Nz::UInt64(layerIndex) << 32 | events[i].entityId;
+			if (m_controlledEntities.find(entityKey) != m_controlledEntities.end())
+				continue;
+
+			if (!layer.visibleEntities.Contains(events[i].entityId))
+				continue;
+
+			layer.inputUpdateEvents.Insert(events[i].entityId, i);
+			m_pendingEvents.Set(VisibilityEventType::InputUpdate);
+		}
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityPhysics* events, std::size_t entityCount)
+	{
+		for (std::size_t i = 0; i < entityCount; ++i)
+		{
+			if (!layer.visibleEntities.Contains(events[i].entityId))
+				continue;
+
+			layer.physicsEvents.Insert(events[i].entityId, i);
+			m_pendingEvents.Set(VisibilityEventType::PhysicsUpdate);
+		}
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityScale* events, std::size_t entityCount)
+	{
+		for (std::size_t i = 0; i < entityCount; ++i)
+		{
+			if (!layer.visibleEntities.Contains(events[i].entityId))
+				continue;
+
+			layer.scaleEvents.Insert(events[i].entityId, i);
+			m_pendingEvents.Set(VisibilityEventType::ScaleUpdate);
+		}
+	}
+
+	void MatchClientVisibility::HandleSyncEvent(LayerIndex /*layerIndex*/, Layer& layer, const NetworkSyncSystem::EntityWeapon* events, std::size_t entityCount)
+	{
+		for (std::size_t i = 0; i < entityCount; ++i)
+		{
+			if (!layer.visibleEntities.Contains(events[i].entityId))
+				continue;
+
+			layer.weaponEvents.Insert(events[i].entityId, events[i]);
+			m_pendingEvents.Set(VisibilityEventType::WeaponUpdate);
+		}
+	}
+
+	bool MatchClientVisibility::IsInInterestArea(LayerIndex layerIndex, const Layer& layer, Ndk::EntityId rootId, float margin) const
+	{
+		if (!m_interestArea)
+			return true;
+
+		// Controlled entities are always relevant to their owner
+		if (m_controlledEntities.find(Nz::UInt64(layerIndex) << 32 | rootId) != m_controlledEntities.end())
+			return true;
+
+		const Nz::Vector2f* position = layer.syncSystem->GetRootGrid().GetPosition(rootId);
+		if (!position)
+			return true;
+
+		return GetInterestArea(margin).Contains(*position);
+	}
+
+	void MatchClientVisibility::PrepareLayerActivation(LayerIndex layerIndex, Layer& layer)
+	{
+		NetworkSyncSystem& syncSystem = *layer.syncSystem;
+
+		// Entities closer to the client camera and to its controlled entities are sent first
+		Nz::StackVector<Nz::Vector2f> viewerPositions = NazaraStackVector(Nz::Vector2f, m_controlledEntities.size() + 1);
+		if (m_interestArea)
+			viewerPositions.push_back(m_interestArea->GetCenter());
+
+		for (Nz::UInt64 entityKey : m_controlledEntities)
+		{
+			if (LayerIndex(entityKey >> 32) != layerIndex)
+				continue;
+
+			Ndk::EntityId rootId = syncSystem.GetRootEntity(Ndk::EntityId(entityKey & 0xFFFFFFFF));
+			if (const Nz::Vector2f* position = syncSystem.GetRootGrid().GetPosition(rootId))
+				viewerPositions.push_back(*position);
+		}
+
+		// Children are sent along their root
+		m_activationOrder.clear();
+		for (const Ndk::EntityHandle& entity : syncSystem.GetEntities())
+		{
+			Ndk::EntityId entityId = entity->GetId();
+			if (syncSystem.GetRootEntity(entityId) != entityId || !IsInInterestArea(layerIndex, layer, entityId, InterestEnterMargin))
+				continue;
+
+			float squaredDistance = 0.f;
+			if (const Nz::Vector2f* position = syncSystem.GetRootGrid().GetPosition(entityId); position && !viewerPositions.empty())
+			{
+				squaredDistance = std::numeric_limits<float>::infinity();
+				for (const Nz::Vector2f& viewerPosition : viewerPositions)
+					squaredDistance = std::min(squaredDistance, viewerPosition.SquaredDistance(*position));
+			}
+
+			m_activationOrder.emplace_back(squaredDistance, entityId);
+		}
+
+		// Roots are popped from the back of the queue
+		std::sort(m_activationOrder.begin(), m_activationOrder.end(), [](const auto& lhs, const auto& rhs)
+		{
+			return lhs.first > rhs.first;
+		});
+
+		layer.activationQueue.clear();
+		layer.activationQueue.reserve(m_activationOrder.size());
+		for (auto&& [squaredDistance, rootId] : m_activationOrder)
+		{
+			layer.activationQueue.push_back(rootId);
+			layer.activationRoots.UnboundedSet(rootId);
+		}
 	}
 
 	void MatchClientVisibility::SendMatchState()
 	{
 		constexpr std::size_t MaxPacketSize = Nz::ENetConstants::ENetHost_DefaultMTU - sizeof(Nz::ENetProtocolHeader) - sizeof(Nz::ENetProtocolSendFragment);
 
-		auto HasExceededPacketSize = [&]() -> bool
+		Terrain& terrain = m_match.GetTerrain();
+
+		// Entities close to the session controlled entities are more relevant
+		m_viewerPositions.clear();
+		for (Nz::UInt64 entityKey : m_controlledEntities)
 		{
-			std::size_t size = Packets::EstimateSize(m_matchStatePacket);
-			return size > MaxPacketSize;
-		};
+			auto layerIt = m_layers.find(LayerIndex(entityKey >> 32));
+			if (layerIt == m_layers.end())
+				continue;
 
-		Terrain& terrain = m_match.GetTerrain();
+			const NetworkSyncSystem& syncSystem = *layerIt.value()->syncSystem;
+
+			Ndk::EntityId rootId = syncSystem.GetRootEntity(Ndk::EntityId(entityKey & 0xFFFFFFFF));
+			if (const Nz::Vector2f* position = syncSystem.GetRootGrid().GetPosition(rootId))
+				m_viewerPositions.emplace_back(layerIt.key(), *position);
+		}
+
+		// Current slot is about to be reused, its state was never acknowledged
+		Nz::UInt16 networkTick = m_match.GetNetworkTick();
+		SentMatchState& sentState = m_sentMatchStates[networkTick % m_sentMatchStates.size()];
+		if (sentState.isValid && !sentState.isAcknowledged && sentState.stateTick != networkTick)
+			HandleLostMatchState(sentState);
 
 		m_priorityMovementData.clear();
-		auto PushMovementData = [this](LayerIndex layerIndex, Nz::UInt8 priorityAccumulator, const NetworkSyncSystem::EntityMovement& movementData, bool isStatic)
+		auto PushMovementData = [this](LayerIndex layerIndex, float priorityAccumulator, const NetworkSyncSystem::EntityMovement& movementData, bool isStatic)
 		{
 			m_priorityMovementData.push_back(PriorityMovementData{
 				priorityAccumulator,
@@ -755,18 +866,15 @@ namespace bw
 			LayerIndex layerIndex = it.key();
 			auto& layer = *it.value();
 
-			for (auto&& pair : layer.staticMovementUpdateEvents)
+			layer.staticMovementUpdateEvents.ForEach([&](Nz::UInt32 entityId, const NetworkSyncSystem::EntityMovement& movementData)
 			{
-				auto visibleIt = layer.visibleEntities.find(pair.first);
-				assert(visibleIt != layer.visibleEntities.end());
+				auto& visibleData = layer.visibleEntities.Get(entityId);
+				visibleData.priorityAccumulator += ComputePriority(layerIndex, movementData) * StaticEntityPriorityFactor;
 
-				auto& visibleData = visibleIt.value();
-				visibleData.priorityAccumulator += 3; //< TODO use NetworkSyncComponent value
-
-				PushMovementData(layerIndex, visibleData.priorityAccumulator, pair.second, true);
-			}
+				PushMovementData(layerIndex, visibleData.priorityAccumulator, movementData, true);
+			});
 
-			layer.staticMovementUpdateEvents.clear();
+			layer.staticMovementUpdateEvents.Clear();
 
 			TerrainLayer& terrainLayer = terrain.GetLayer(layerIndex);
 			const NetworkSyncSystem& syncSystem = terrainLayer.GetWorld().GetSystem<NetworkSyncSystem>();
@@ -777,38 +885,42 @@ namespace bw
 				{
 					auto& movementData = entitiesMovement[i];
 
-					auto visibleIt = layer.visibleEntities.find(movementData.entityId);
-					if (visibleIt == layer.visibleEntities.end())
+					if (!layer.visibleEntities.Contains(movementData.entityId))
 						continue;
 
-					auto& visibleData = visibleIt.value();
+					auto& visibleData = layer.visibleEntities.Get(movementData.entityId);
 					Nz::UInt64 entityKey = Nz::UInt64(layerIndex) << 32 | movementData.entityId;
 					if (m_controlledEntities.find(entityKey) != m_controlledEntities.end())
-					{
-						//FIXME
-						visibleData.priorityAccumulator = 0xFF;
-					}
+						visibleData.priorityAccumulator = std::numeric_limits<float>::infinity(); //< Always send controlled entities
 					else
-						visibleData.priorityAccumulator += 1; //< TODO use NetworkSyncComponent value
+						visibleData.priorityAccumulator += ComputePriority(layerIndex, movementData);
 
 					PushMovementData(layerIndex, visibleData.priorityAccumulator, movementData, false);
 				}
 			});
 		}
 
-		std::sort(m_priorityMovementData.begin(), m_priorityMovementData.end(), [](const PriorityMovementData& lhs, const PriorityMovementData& rhs)
+		// Only the most important entities fit in the packet, extract them in priority order instead of sorting everything
+		auto PriorityComparator = [](const PriorityMovementData& lhs, const PriorityMovementData& rhs)
 		{
-			return lhs.priorityAccumulator > rhs.priorityAccumulator;
-		});
+			return lhs.priorityAccumulator < rhs.priorityAccumulator;
+		};
+
+		std::make_heap(m_priorityMovementData.begin(), m_priorityMovementData.end(), PriorityComparator);
 
 		m_matchStatePacket.entities.clear();
 		m_matchStatePacket.layers.clear();
-		m_matchStatePacket.stateTick = m_match.GetNetworkTick();
+		m_matchStatePacket.stateTick = networkTick;
 		m_matchStatePacket.lastInputTick = m_session.GetLastInputTick();
 
+		// Extracted entities are moved at the end of the vector, by decreasing priority
+		Packets::MatchStateEntitiesSize entitiesSize;
 		std::size_t handledEntities = 0;
-		for (PriorityMovementData& movementData : m_priorityMovementData)
+		for (auto heapEnd = m_priorityMovementData.end(); heapEnd != m_priorityMovementData.begin(); --heapEnd)
 		{
+			std::pop_heap(m_priorityMovementData.begin(), heapEnd, PriorityComparator);
+			PriorityMovementData& movementData = *(heapEnd - 1);
+
 			std::size_t entityIndex = 0;
 
 			LayerIndex layerIndex = 0;
@@ -837,8 +949,12 @@ namespace bw
 			assert(entityIndex <= m_matchStatePacket.entities.size());
 			auto entityIt = m_matchStatePacket.entities.emplace(m_matchStatePacket.entities.begin() + entityIndex);
 			BuildMovementPacket(*entityIt, movementData.movementData);
+			DeltaEncodeEntity(Nz::UInt64(movementData.layerIndex) << 32 | movementData.movementData.entityId, *entityIt);
+
+			Packets::MatchStateEntitiesSize newEntitiesSize = entitiesSize;
+			Packets::AddEntitySize(newEntitiesSize, *entityIt);
 
-			if (handledEntities != 0 && HasExceededPacketSize()) //< Allow at least one entity in the packet
+			if (handledEntities != 0 && Packets::ComputeSize(m_matchStatePacket, newEntitiesSize) > MaxPacketSize) //< Allow at least one entity in the packet
 			{
 				// Remove last inserted entity
 				m_matchStatePacket.entities.erase(entityIt);
@@ -850,17 +966,23 @@ namespace bw
 					m_matchStatePacket.layers.pop_back();
 				}
 
-				handledEntities--;
-
 				break;
 			}
 
+			entitiesSize = newEntitiesSize;
 			handledEntities++;
 		}
 
-		// Reset priority only once we're sure entities are being sent
-		// TODO: Reset priority accumulator only once a client acknowledge the packet? (Or maybe reset priority / events if the packet is lost)
-		for (std::size_t i = 0; i < handledEntities; ++i)
+		assert(Packets::ComputeSize(m_matchStatePacket, entitiesSize) == Packets::ComputeSize(m_matchStatePacket));
+
+		// Remember sent states until client acknowledges them, along with the priority to restore if they get lost
+		sentState.entities.clear();
+		sentState.isAcknowledged = false;
+		sentState.isLost = false;
+		sentState.isValid = true;
+		sentState.stateTick = m_matchStatePacket.stateTick;
+
+		for (std::size_t i = m_priorityMovementData.size() - handledEntities; i < m_priorityMovementData.size(); ++i)
 		{
 			const PriorityMovementData& movementData = m_priorityMovementData[i];
 
@@ -871,21 +993,139 @@ namespace bw
 
 			Nz::UInt32 entityId = Nz::UInt32(movementData.movementData.entityId);
 
-			auto visibleIt = layerData.visibleEntities.find(entityId);
-			assert(visibleIt != layerData.visibleEntities.end());
+			auto& visibleData = layerData.visibleEntities.Get(entityId);
+
+			SentEntity& sentEntity = sentState.entities.emplace_back();
+			sentEntity.entityKey = Nz::UInt64(movementData.layerIndex) << 32 | entityId;
+			sentEntity.priority = visibleData.priorityAccumulator;
 
-			auto& visibleData = visibleIt.value();
-			visibleData.priorityAccumulator = 0;
+			Packets::MatchState::Entity entityData;
+			BuildMovementPacket(entityData, movementData.movementData);
+			sentEntity.state = Packets::QuantizeState(entityData);
+
+			// Reset priority as soon as entities are sent instead of waiting for an acknowledgement, it gets restored if the packet is lost
+			visibleData.lastSentStateTick = sentState.stateTick;
+			visibleData.priorityAccumulator = 0.f;
 
 			if (movementData.staticEntity)
-				layerData.staticMovementUpdateEvents.erase(entityId);
+			{
+				sentEntity.staticMovement = movementData.movementData;
+				layerData.staticMovementUpdateEvents.Erase(entityId);
+			}
 		}
 
-		//bwLog(m_match.GetLogger(), LogLevel::Debug, "Entity count: {0} (packet size: {1})", m_matchStatePacket.entities.size(), Packets::EstimateSize(m_matchStatePacket));
+		//bwLog(m_match.GetLogger(), LogLevel::Debug, "Entity count: {0} (packet size: {1})", m_matchStatePacket.entities.size(), Packets::ComputeSize(m_matchStatePacket));
 
 		m_session.SendPacket(m_matchStatePacket);
 	}
 
+	std::size_t MatchClientVisibility::StreamLayerActivation(LayerIndex layerIndex, Layer& layer, std::size_t& budget)
+	{
+		m_activationRecords.Clear();
+
+		Nz::ByteStream stream(&m_activationRecords, Nz::OpenMode_WriteOnly);
+
+		// At least one root is sent as long as there's budget left, even if its records exceed it
+		std::size_t entityCount = 0;
+		while (!layer.activationQueue.empty() && m_activationRecords.GetSize() < budget)
+		{
+			Ndk::EntityId entityId = layer.activationQueue.back();
+			layer.activationQueue.pop_back();
+
+			// Root may have been destroyed or sent along an entity depending on it
+			if (!layer.activationRoots.UnboundedTest(entityId))
+				continue;
+
+			layer.activationRoots.Reset(entityId);
+
+			// It may also have been attached to another entity, or have left the interest area (which will handle it if it comes back)
+			Ndk::EntityId rootId = layer.syncSystem->GetRootEntity(entityId);
+			if (!IsInInterestArea(layerIndex, layer, rootId, InterestEnterMargin))
+				continue;
+
+			ActivateRoot(layer, rootId);
+
+			// Flushing every root keeps entities in dependency order, anything they depend on is sent beforehand
+			FlushCreationEvents(layer, [&](Nz::UInt32 createdEntityId)
+			{
+				layer.syncSystem->WriteCreationRecord(stream, createdEntityId);
+				entityCount++;
+			});
+		}
+
+		budget -= std::min(budget, m_activationRecords.GetSize());
+
+		return entityCount;
+	}
+
+	void MatchClientVisibility::UpdateInterest(LayerIndex layerIndex, Layer& layer)
+	{
+		NetworkSyncSystem& syncSystem = *layer.syncSystem;
+
+		// Only visible roots and the grid cells around the interest area are checked, the cost doesn't depend on the layer size
+		m_leavingRoots.clear();
+		for (std::size_t rootId = layer.interestRoots.FindFirst(); rootId != layer.interestRoots.npos; rootId = layer.interestRoots.FindNext(rootId))
+		{
+			if (!IsInInterestArea(layerIndex, layer, Ndk::EntityId(rootId), InterestLeaveMargin))
+				m_leavingRoots.push_back(Ndk::EntityId(rootId));
+		}
+
+		for (Ndk::EntityId rootId : m_leavingRoots)
+		{
+			layer.interestRoots.UnboundedReset(rootId);
+
+			syncSystem.ForEachEntityInTree(rootId, [&](Ndk::EntityId entityId)
+			{
+				if (layer.visibleEntities.Contains(entityId))
+					HandleEntityRemove(layerIndex, entityId, false);
+			});
+		}
+
+		m_enteringEntities.clear();
+
+		auto EnterInterestArea = [&](Ndk::EntityId rootId)
+		{
+			if (layer.interestRoots.UnboundedTest(rootId))
+				return;
+
+			layer.interestRoots.UnboundedSet(rootId);
+
+			syncSystem.ForEachEntityInTree(rootId, [&](Ndk::EntityId entityId)
+			{
+				if (!layer.visibleEntities.Contains(entityId))
+					m_enteringEntities.push_back(entityId);
+			});
+		};
+
+		syncSystem.GetRootGrid().ForEachInRect(GetInterestArea(InterestEnterMargin), [&](Nz::UInt32 rootId, const Nz::Vector2f& /*position*/)
+		{
+			// Roots waiting for the layer activation are sent closest first
+			if (!layer.activationRoots.UnboundedTest(rootId))
+				EnterInterestArea(rootId);
+		});
+
+		// Controlled entities may be created away from the area the client currently sees
+		for (Nz::UInt64 entityKey : m_controlledEntities)
+		{
+			if (LayerIndex(entityKey >> 32) != layerIndex)
+				continue;
+
+			Ndk::EntityId rootId = syncSystem.GetRootEntity(Ndk::EntityId(entityKey & 0xFFFFFFFF));
+			if (syncSystem.GetRootGrid().GetPosition(rootId))
+				EnterInterestArea(rootId);
+		}
+
+		for (Ndk::EntityId entityId : m_enteringEntities)
+			HandleEntityCreation(layerIndex, entityId);
+	}
+
+	void MatchClientVisibility::WriteActivationRecords(Nz::ByteStream& stream) const
+	{
+		std::size_t recordSize = m_activationRecords.GetSize();
+		if (stream.Write(m_activationRecords.GetConstBuffer(), recordSize) != recordSize)
+			throw std::runtime_error("failed to write");
+	}
+
 	void MatchClientVisibility::BuildMovementPacket(Packets::MatchState::Entity& packetData, const NetworkSyncSystem::EntityMovement& eventData)
 	{
 		packetData.id = eventData.entityId;
@@ -906,59 +1146,60 @@ namespace bw
 		}
 	}
 
-	void MatchClientVisibility::FillEntityData(const NetworkSyncSystem::EntityCreation& creationEvent, Packets::Helper::EntityData& entityData)
+	float MatchClientVisibility::ComputePriority(LayerIndex layerIndex, const NetworkSyncSystem::EntityMovement& eventData) const
 	{
-		const NetworkStringStore& networkStringStore = m_match.GetNetworkStringStore();
-
-		assert(creationEvent.uniqueId > 0);
-
-		entityData.entityClass = networkStringStore.CheckStringIndex(creationEvent.entityClass);
-		entityData.uniqueId = static_cast<Nz::UInt64>(creationEvent.uniqueId);
-		entityData.position = creationEvent.position;
-		entityData.rotation = creationEvent.rotation;
+		float priority = eventData.priority;
 
-		if (!Nz::NumberEquals(creationEvent.scale, 1.f))
-			entityData.scale = creationEvent.scale;
-
-		if (creationEvent.inputs.has_value())
-			entityData.inputs = creationEvent.inputs.value();
+		std::optional<float> closestSquaredDistance;
+		for (auto&& [viewerLayerIndex, viewerPosition] : m_viewerPositions)
+		{
+			if (viewerLayerIndex != layerIndex)
+				continue;
 
-		if (creationEvent.parent.has_value())
-			entityData.parentId = creationEvent.parent.value();
+			float squaredDistance = viewerPosition.SquaredDistance(eventData.position);
+			if (!closestSquaredDistance || squaredDistance < *closestSquaredDistance)
+				closestSquaredDistance = squaredDistance;
+		}
 
-		if (creationEvent.healthProperties.has_value())
+		// Distance only matters when a controlled entity is on the same layer
+		if (closestSquaredDistance)
 		{
-			entityData.health.emplace();
-			entityData.health->currentHealth = creationEvent.healthProperties->currentHealth;
-			entityData.health->maxHealth = creationEvent.healthProperties->maxHealth;
+			float distanceRatio = std::min(std::sqrt(*closestSquaredDistance) / PriorityDistanceFalloff, 1.f);
+			priority *= Nz::Lerp(PriorityMaxDistanceWeight, PriorityMinDistanceWeight, distanceRatio);
 		}
 
-		if (!creationEvent.name.empty())
-			entityData.name = creationEvent.name;
-
-		if (creationEvent.playerMovement.has_value())
+		if (eventData.physicsProperties)
 		{
-			entityData.playerMovement.emplace();
-			entityData.playerMovement->isFacingRight = creationEvent.playerMovement->isFacingRight;
+			float velocityRatio = std::min(eventData.physicsProperties->linearVelocity.GetLength() / PriorityVelocityReference, 1.f);
+			priority *= Nz::Lerp(1.f, PriorityMaxVelocityWeight, velocityRatio);
 		}
 
-		if (creationEvent.physicsProperties.has_value())
-		{
-			const auto& physicsProperties = *creationEvent.physicsProperties;
+		return priority;
+	}
 
-			entityData.physicsProperties.emplace();
-			entityData.physicsProperties->angularVelocity = physicsProperties.angularVelocity;
-			entityData.physicsProperties->linearVelocity = physicsProperties.linearVelocity;
-			entityData.physicsProperties->isAsleep = physicsProperties.isSleeping;
-			entityData.physicsProperties->mass = physicsProperties.mass;
-			entityData.physicsProperties->momentOfInertia = physicsProperties.momentOfInertia;
-		}
+	void MatchClientVisibility::DeltaEncodeEntity(Nz::UInt64 entityKey, Packets::MatchState::Entity& packetData)
+	{
+		auto it = m_entityBaselines.find(entityKey);
+		if (it == m_entityBaselines.end())
+			return;
+
+		const EntityBaseline& baseline = it->second;
 
-		for (auto&& [propertyName, propertyValue] : creationEvent.properties)
+		Nz::UInt16 baselineAge = static_cast<Nz::UInt16>(m_matchStatePacket.stateTick - baseline.stateTick);
+		if (baselineAge == 0 || baselineAge > Packets::MatchState::MaxBaselineAge)
 		{
-			auto& propertyData = entityData.properties.emplace_back();
-			propertyData.name = networkStringStore.CheckStringIndex(propertyName);
-			propertyData.value = propertyValue;
+			// Client may no longer have this state, send it whole until a more recent one gets acknowledged
+			if (baselineAge != 0)
+				m_entityBaselines.erase(it);
+
+			return;
 		}
+
+		Packets::MatchState::EntityState entityState = Packets::QuantizeState(packetData);
+
+		packetData.baselineAge = static_cast<Nz::UInt8>(baselineAge);
+		packetData.physicsChanged = (entityState.physics != baseline.state.physics);
+		packetData.positionChanged = (entityState.position != baseline.state.position);
+		packetData.rotationChanged = (entityState.rotation != baseline.state.rotation);
 	}
 }
@@ -12,6 +12,7 @@ namespace bw
 	MatchSessions::MatchSessions(Match& match) :
 	m_nextSessionId(0),
 	m_match(match),
+	m_packetPool(match.GetPacketPool()),
 	m_commandStore(m_match.GetLogger()),
 	m_sessionPool(sizeof(MatchClientSession))
 	{
@@ -25,23 +26,42 @@ namespace bw
 	void MatchSessions::Clear()
 	{
 		for (const auto& pair : m_sessionIdToSession)
-			m_sessionPool.Delete(pair.second);
+			m_sessionPool.Delete(pair.second.session);
 
 		m_sessionIdToSession.clear();
 	}
 
+	void MatchSessions::BroadcastPacket(Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet)
+	{
+		// Each session manager handles all of its sessions at once
+		for (const auto& manager : m_managers)
+		{
+			m_broadcastManagerSessions.clear();
+			for (const SessionData& sessionData : m_broadcastSessions)
+			{
+				if (sessionData.manager == manager.get())
+					m_broadcastManagerSessions.push_back(sessionData.session);
+			}
+
+			if (!m_broadcastManagerSessions.empty())
+				manager->BroadcastPacket(m_broadcastManagerSessions.data(), m_broadcastManagerSessions.size(), channelId, flags, packet);
+		}
+
+		m_packetPool.Release(std::move(packet));
+	}
+
 	void MatchSessions::Poll()
 	{
 		for (auto& sessionManager : m_managers)
 			sessionManager->Poll();
 	}
 
-	MatchClientSession* MatchSessions::CreateSession(std::shared_ptr<SessionBridge> bridge)
+	MatchClientSession* MatchSessions::CreateSession(SessionManager* manager, std::shared_ptr<SessionBridge> bridge)
 	{
 		std::size_t sessionId = m_nextSessionId++;
 		MatchClientSession* session = m_sessionPool.New<MatchClientSession>(m_match, sessionId, m_commandStore, std::move(bridge));
 
-		m_sessionIdToSession.insert_or_assign(sessionId, session);
+		m_sessionIdToSession.insert_or_assign(sessionId, SessionData{ session, manager });
 
 		bwLog(m_match.GetLogger(), LogLevel::Info, "Created session #{0}", sessionId);
 
@@ -0,0 +1,56 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/NetPacketPool.hpp>
+
+namespace bw
+{
+	NetPacketPool::NetPacketPool(std::size_t maxPooledPacketCount) :
+	m_maxPooledPacketCount(maxPooledPacketCount)
+	{
+		m_allocationCount.store(0, std::memory_order_relaxed);
+		m_livePacketCount.store(0, std::memory_order_relaxed);
+		m_pooledPacketCount.store(0, std::memory_order_relaxed);
+	}
+
+	Nz::NetPacket NetPacketPool::Acquire(Nz::UInt16 netCode)
+	{
+		m_livePacketCount.fetch_add(1, std::memory_order_relaxed);
+
+		Nz::NetPacket packet;
+		if (m_pooledPackets.try_dequeue(packet))
+		{
+			m_pooledPacketCount.fetch_sub(1, std::memory_order_relaxed);
+
+			// Keep the buffer (and its capacity) but drop its content
+			packet.Resize(Nz::NetPacket::HeaderSize);
+			packet.GetStream()->SetCursorPos(Nz::NetPacket::HeaderSize);
+			packet.SetNetCode(netCode);
+		}
+		else
+		{
+			m_allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+			packet.Reset(netCode);
+		}
+
+		return packet;
+	}
+
+	void NetPacketPool::Release(Nz::NetPacket&& packet)
+	{
+		m_livePacketCount.fetch_sub(1, std::memory_order_relaxed);
+
+		// Only writable packets can be reused as-is (received packets are read-only)
+		Nz::Stream* stream = packet.GetStream();
+		if (!stream || !stream->IsWritable())
+			return;
+
+		if (m_pooledPacketCount.load(std::memory_order_relaxed) >= m_maxPooledPacketCount)
+			return;
+
+		m_pooledPacketCount.fetch_add(1, std::memory_order_relaxed);
+		m_pooledPackets.enqueue(std::move(packet));
+	}
+}
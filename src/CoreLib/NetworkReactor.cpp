@@ -3,42 +3,280 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/NetworkReactor.hpp>
+#include <Nazara/Core/Clock.hpp>
 #include <CoreLib/Config.hpp>
+#include <CoreLib/NetPacketPool.hpp>
 #include <CoreLib/Utils.hpp>
+#include <algorithm>
 #include <cassert>
 #include <condition_variable>
+#include <iterator>
 #include <mutex>
 #include <stdexcept>
 
 namespace bw
 {
-	NetworkReactor::NetworkReactor(std::size_t firstId, Nz::NetProtocol protocol, Nz::UInt16 port, std::size_t maxClient) :
+	NetworkReactor::NetworkReactor(std::size_t firstId, Nz::NetProtocol protocol, Nz::UInt16 port, std::size_t maxClient, std::size_t threadCount, NetPacketPool* packetPool) :
 	m_firstId(firstId),
+	m_maxPeerCount(maxClient),
+	m_shardCapacity(maxClient),
+	m_packetPool(packetPool),
 	m_protocol(protocol)
 	{
-		if (port > 0)
+		assert(threadCount > 0);
+
+		// Identifies this reactor in per-thread producer token caches (addresses could be reused)
+		static std::atomic<Nz::UInt64> s_reactorCounter(0);
+		m_reactorId = ++s_reactorCounter;
+
+		m_incomingEventBuffer.resize(BulkDequeueSize);
+		m_peerBandwidthBudget.store(0, std::memory_order_relaxed);
+		m_peerCount.store(0, std::memory_order_relaxed);
+
+		// Channel 1 carries entity creation and updates, which can be deferred in favor of channel 0 events
+		for (std::size_t i = 0; i < m_channelPriorities.size(); ++i)
+			m_channelPriorities[i].store((i == 1) ? SendPriority::Bulk : SendPriority::Normal, std::memory_order_relaxed);
+
+		// Each shard owns its own host, listening on port + shardIndex
+		if (port == 0 && threadCount > 1)
+			throw std::runtime_error("sharded reactor requires a listen port");
+
+		m_shards.reserve(threadCount);
+		for (std::size_t shardIndex = 0; shardIndex < threadCount; ++shardIndex)
 		{
-			if (!m_host.Create(protocol, port, maxClient, NetworkChannelCount))
+			Shard& shard = *m_shards.emplace_back(std::make_unique<Shard>());
+			shard.firstId = m_firstId + shardIndex * m_shardCapacity;
+			shard.backlogSize.store(0, std::memory_order_relaxed);
+			shard.peerCount.store(0, std::memory_order_relaxed);
+			shard.sendLatencyMax.store(0, std::memory_order_relaxed);
+			shard.sendLatencySum.store(0, std::memory_order_relaxed);
+			shard.sendTime.store(0, std::memory_order_relaxed);
+			shard.sentPacketCount.store(0, std::memory_order_relaxed);
+			shard.serviceTime.store(0, std::memory_order_relaxed);
+			for (std::size_t i = 0; i < NetworkChannelCount; ++i)
+			{
+				shard.channelByteCount[i].store(0, std::memory_order_relaxed);
+				shard.channelPacketCount[i].store(0, std::memory_order_relaxed);
+			}
+
+			for (auto& bucket : shard.roundTripTimes)
+				bucket.store(0, std::memory_order_relaxed);
+
+			shard.shardIndex = shardIndex;
+			shard.wakeupPending.store(false, std::memory_order_relaxed);
+
+			// One more ENet peer is used by the wakeup connection
+			if (port > 0)
+			{
+				if (!shard.host.Create(protocol, static_cast<Nz::UInt16>(port + shardIndex), maxClient + 1, ReactorChannelCount))
+					throw std::runtime_error("failed to start reactor");
+			}
+			else if (!shard.host.Create((protocol == Nz::NetProtocol_IPv4) ? Nz::IpAddress::LoopbackIpV4 : Nz::IpAddress::LoopbackIpV6, maxClient + 1, ReactorChannelCount))
 				throw std::runtime_error("failed to start reactor");
-		}
-		else if (!m_host.Create((protocol == Nz::NetProtocol_IPv4) ? Nz::IpAddress::LoopbackIpV4 : Nz::IpAddress::LoopbackIpV6, maxClient, NetworkChannelCount))
-			throw std::runtime_error("failed to start reactor");
 
-		m_clients.resize(maxClient, nullptr);
+			if (!ConnectWakeupPeer(shard))
+				throw std::runtime_error("failed to connect reactor wakeup host");
+
+			// Producers can't wake the reactor up until the loopback connection is established
+			Nz::Clock clock;
+			bool isWakeupPeerConnected = false;
+			while (!isWakeupPeerConnected || !shard.wakeupHostPeer)
+			{
+				if (clock.GetMilliseconds() >= 1000)
+					throw std::runtime_error("failed to connect reactor wakeup host");
+
+				ServiceWakeupHost(shard);
+
+				Nz::ENetEvent event;
+				if (shard.host.Service(&event, 1) > 0)
+				{
+					if (event.peer == shard.wakeupPeer && event.type == Nz::ENetEventType::OutgoingConnect)
+						isWakeupPeerConnected = true;
+					else if (event.type == Nz::ENetEventType::IncomingConnect)
+						event.peer->DisconnectNow(0); //< reactor is not running yet
+				}
+			}
+
+			shard.clients.resize(maxClient, nullptr);
+			shard.connectionRequestBuffer.resize(BulkDequeueSize);
+			shard.localPeerIds.resize(maxClient + 1, InvalidPeerId);
+			shard.outgoingEventBuffer.resize(BulkDequeueSize);
+			shard.peerSendStates.resize(maxClient);
+			shard.pendingConnections.resize(maxClient);
+		}
 
 		m_running.store(true, std::memory_order_release);
-		m_thread = Nz::Thread(&NetworkReactor::WorkerThread, this);
-		m_thread.SetName("NetworkReactor");
+
+		for (auto& shardPtr : m_shards)
+		{
+			Shard& shard = *shardPtr;
+			shard.thread = Nz::Thread([this, &shard]() { WorkerThread(shard); });
+
+			if (threadCount > 1)
+				shard.thread.SetName("NetworkReactor #" + std::to_string(shard.shardIndex));
+			else
+				shard.thread.SetName("NetworkReactor");
+		}
 	}
 
 	NetworkReactor::~NetworkReactor()
 	{
 		m_running.store(false, std::memory_order_relaxed);
-		m_thread.Join();
+
+		for (auto& shardPtr : m_shards)
+			WakeUp(*shardPtr);
+
+		for (auto& shardPtr : m_shards)
+			shardPtr->thread.Join();
+	}
+
+	std::size_t NetworkReactor::AllocatePeerId(Shard& shard, Nz::ENetPeer* peer)
+	{
+		// Local ids match ENet peer ids unless a redirected peer already uses it
+		std::size_t localPeerId = peer->GetPeerId();
+		if (localPeerId >= shard.clients.size() || shard.clients[localPeerId])
+		{
+			auto it = std::find(shard.clients.begin(), shard.clients.end(), nullptr);
+			assert(it != shard.clients.end());
+
+			localPeerId = std::distance(shard.clients.begin(), it);
+		}
+
+		shard.clients[localPeerId] = peer;
+		shard.localPeerIds[peer->GetPeerId()] = localPeerId;
+
+		return localPeerId;
+	}
+
+	void NetworkReactor::BroadcastData(const std::size_t* peerIds, std::size_t peerCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet)
+	{
+		// Reused between calls to prevent allocations
+		thread_local std::vector<std::vector<std::size_t>> shardPeerIds;
+		shardPeerIds.resize(std::max(shardPeerIds.size(), m_shards.size()));
+
+		// Peers are grouped by shard, each shard gets a single event
+		for (std::size_t i = 0; i < peerCount; ++i)
+		{
+			std::size_t localPeerId;
+			Shard& shard = GetShard(peerIds[i], &localPeerId);
+
+			shardPeerIds[shard.shardIndex].push_back(localPeerId);
+		}
+
+		std::size_t shardCount = std::count_if(shardPeerIds.begin(), shardPeerIds.begin() + m_shards.size(), [](const auto& ids) { return !ids.empty(); });
+		if (shardCount == 0)
+			return;
+
+		// Shards share a single copy of the packet
+		std::unique_ptr<BroadcastPayload> payload;
+		if (!m_broadcastPayloads.try_dequeue(payload))
+			payload = std::make_unique<BroadcastPayload>();
+
+		payload->shardCount.store(shardCount, std::memory_order_relaxed);
+
+		const Nz::UInt8* packetData = packet.GetConstData() + Nz::NetPacket::HeaderSize;
+		std::size_t packetSize = packet.GetDataSize() - Nz::NetPacket::HeaderSize;
+		if (m_packetPool)
+		{
+			payload->packet = m_packetPool->Acquire(packet.GetNetCode());
+			payload->packet.Write(packetData, packetSize);
+		}
+		else
+			payload->packet = Nz::NetPacket(packet.GetNetCode(), packetData, packetSize);
+
+		// Fill peer ids before enqueuing anything, shards may start reading the payload right away
+		for (std::size_t shardIndex = 0; shardIndex < m_shards.size(); ++shardIndex)
+			payload->peerIds.insert(payload->peerIds.end(), shardPeerIds[shardIndex].begin(), shardPeerIds[shardIndex].end());
+
+		BroadcastPayload* sharedPayload = payload.release();
+
+		Nz::UInt64 enqueueTime = Nz::GetElapsedMicroseconds();
+		std::size_t firstPeerIndex = 0;
+		for (std::size_t shardIndex = 0; shardIndex < m_shards.size(); ++shardIndex)
+		{
+			std::size_t shardPeerCount = shardPeerIds[shardIndex].size();
+			if (shardPeerCount == 0)
+				continue;
+
+			shardPeerIds[shardIndex].clear();
+
+			Shard& shard = *m_shards[shardIndex];
+
+			OutgoingEvent outgoingData;
+			auto& broadcastEvent = outgoingData.data.emplace<OutgoingEvent::BroadcastEvent>();
+			broadcastEvent.channelId = channelId;
+			broadcastEvent.enqueueTime = enqueueTime;
+			broadcastEvent.firstPeerIndex = firstPeerIndex;
+			broadcastEvent.flags = flags;
+			broadcastEvent.payload = sharedPayload;
+			broadcastEvent.peerCount = shardPeerCount;
+
+			firstPeerIndex += shardPeerCount;
+
+			shard.outgoingQueue.enqueue(GetProducerToken(shard), std::move(outgoingData));
+			WakeUp(shard);
+		}
+	}
+
+	void NetworkReactor::ReleaseBroadcastPayload(BroadcastPayload* payload, bool isPacketMoved)
+	{
+		// Last shard to use the payload gives it back
+		if (payload->shardCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		if (!isPacketMoved && m_packetPool)
+			m_packetPool->Release(std::move(payload->packet));
+
+		payload->peerIds.clear();
+		m_broadcastPayloads.enqueue(std::unique_ptr<BroadcastPayload>(payload));
+	}
+
+	void NetworkReactor::ClearBacklog(Shard& shard, std::size_t peerId)
+	{
+		if (!shard.backloggedPeers.UnboundedTest(peerId))
+			return;
+
+		for (auto& backlog : shard.peerSendStates[peerId].backlogs)
+		{
+			if (m_packetPool)
+			{
+				for (auto& packetEvent : backlog)
+				{
+					// Shared packets are released through inflightPackets
+					if (!packetEvent.sharedPacket)
+						m_packetPool->Release(std::move(packetEvent.packet));
+				}
+			}
+
+			shard.backlogSize.fetch_sub(backlog.size(), std::memory_order_relaxed);
+			backlog.clear();
+		}
+
+		shard.backloggedPeers.UnboundedReset(peerId);
+	}
+
+	bool NetworkReactor::ConnectWakeupPeer(Shard& shard)
+	{
+		// ENet only returns from Service when it has an event for us, a loopback connection lets producers generate one
+		std::lock_guard<std::mutex> lock(shard.wakeupMutex);
+
+		shard.wakeupHost.Destroy();
+		shard.wakeupHostPeer = nullptr;
+		shard.wakeupPeer = nullptr;
+
+		if (!shard.wakeupHost.Create((m_protocol == Nz::NetProtocol_IPv4) ? Nz::IpAddress::LoopbackIpV4 : Nz::IpAddress::LoopbackIpV6, 1, 1))
+			return false;
+
+		// Handshake completes as both hosts are serviced, see ServiceWakeupHost
+		shard.wakeupPeer = shard.host.Connect(shard.wakeupHost.GetBoundAddress(), 1);
+		return shard.wakeupPeer != nullptr;
 	}
 
 	std::size_t NetworkReactor::ConnectTo(Nz::IpAddress address, Nz::UInt32 data)
 	{
+		// Outgoing connections are always handled by the first shard
+		Shard& shard = *m_shards.front();
+
 		// We will need a few synchronization primitives to block the calling thread until the reactor has treated our request
 		std::condition_variable signal;
 		std::mutex signalMutex;
@@ -51,8 +289,8 @@ namespace bw
 		bool hasReturned = false;
 		request.callback = [&](std::size_t peerId)
 		{
-			// This callback is called from within the reactor
-			newClientId = m_firstId + peerId;
+			// This callback is called from within the reactor, failures must stay invalid for every reactor
+			newClientId = (peerId != InvalidPeerId) ? shard.firstId + peerId : InvalidPeerId;
 			hasReturned = true;
 
 			std::unique_lock<std::mutex> lock(signalMutex);
@@ -61,7 +299,8 @@ namespace bw
 
 		// Lock before enqueuing the request, to prevent notify being called before we actually wait on the signal
 		std::unique_lock<std::mutex> lock(signalMutex);
-		m_connectionRequests.enqueue(request);
+		shard.connectionRequests.enqueue(request);
+		WakeUp(shard);
 
 		// As InvalidClientId is a possible return from the callback, we need another variable to prevent spurious wakeup
 		signal.wait(lock, [&]() { return hasReturned; });
@@ -71,77 +310,313 @@ namespace bw
 
 	void NetworkReactor::DisconnectPeer(std::size_t peerId, Nz::UInt32 data, DisconnectionType type)
 	{
-		assert(peerId >= m_firstId);
+		std::size_t localPeerId;
+		Shard& shard = GetShard(peerId, &localPeerId);
 
 		OutgoingEvent::DisconnectEvent disconnectEvent;
 		disconnectEvent.data = data;
 		disconnectEvent.type = type;
 
 		OutgoingEvent outgoingData;
-		outgoingData.peerId = peerId - m_firstId;
+		outgoingData.peerId = localPeerId;
 		outgoingData.data = std::move(disconnectEvent);
 
-		m_outgoingQueue.enqueue(std::move(outgoingData));
+		shard.outgoingQueue.enqueue(GetProducerToken(shard), std::move(outgoingData));
+		WakeUp(shard);
+	}
+
+	auto NetworkReactor::GetSendLatency() const -> SendLatency
+	{
+		SendLatency sendLatency;
+		sendLatency.maxTime = 0;
+		sendLatency.packetCount = 0;
+
+		Nz::UInt64 latencySum = 0;
+		for (const auto& shardPtr : m_shards)
+		{
+			sendLatency.maxTime = std::max(sendLatency.maxTime, shardPtr->sendLatencyMax.load(std::memory_order_relaxed));
+			sendLatency.packetCount += shardPtr->sentPacketCount.load(std::memory_order_relaxed);
+			latencySum += shardPtr->sendLatencySum.load(std::memory_order_relaxed);
+		}
+
+		sendLatency.averageTime = (sendLatency.packetCount > 0) ? latencySum / sendLatency.packetCount : 0;
+
+		return sendLatency;
+	}
+
+	auto NetworkReactor::GetStats() const -> Stats
+	{
+		Stats stats;
+		stats.backlogSize = 0;
+		stats.incomingQueueSize = 0;
+		stats.outgoingQueueSize = 0;
+		stats.peerCount = 0;
+		stats.sendLatency = GetSendLatency();
+		stats.sendTime = 0;
+		stats.serviceTime = 0;
+
+		for (auto& channelStats : stats.channels)
+		{
+			channelStats.byteCount = 0;
+			channelStats.packetCount = 0;
+		}
+
+		stats.roundTripTimes.fill(0);
+
+		for (const auto& shardPtr : m_shards)
+		{
+			const Shard& shard = *shardPtr;
+
+			stats.backlogSize += shard.backlogSize.load(std::memory_order_relaxed);
+			stats.incomingQueueSize += shard.incomingQueue.size_approx();
+			stats.outgoingQueueSize += shard.outgoingQueue.size_approx();
+			stats.peerCount += shard.peerCount.load(std::memory_order_relaxed);
+			stats.sendTime += shard.sendTime.load(std::memory_order_relaxed);
+			stats.serviceTime += shard.serviceTime.load(std::memory_order_relaxed);
+
+			for (std::size_t i = 0; i < NetworkChannelCount; ++i)
+			{
+				stats.channels[i].byteCount += shard.channelByteCount[i].load(std::memory_order_relaxed);
+				stats.channels[i].packetCount += shard.channelPacketCount[i].load(std::memory_order_relaxed);
+			}
+
+			for (std::size_t i = 0; i < stats.roundTripTimes.size(); ++i)
+				stats.roundTripTimes[i] += shard.roundTripTimes[i].load(std::memory_order_relaxed);
+		}
+
+		return stats;
 	}
 
 	void NetworkReactor::QueryInfo(std::size_t peerId, PeerInfoCallback callback)
 	{
-		assert(peerId >= m_firstId);
 		assert(callback);
 
+		std::size_t localPeerId;
+		Shard& shard = GetShard(peerId, &localPeerId);
+
 		OutgoingEvent outgoingRequest;
-		outgoingRequest.peerId = peerId - m_firstId;
+		outgoingRequest.peerId = localPeerId;
 		auto& queryInfo = outgoingRequest.data.emplace<OutgoingEvent::QueryPeerInfo>();
 		queryInfo.callback = std::move(callback);
 
-		m_outgoingQueue.enqueue(std::move(outgoingRequest));
+		shard.outgoingQueue.enqueue(GetProducerToken(shard), std::move(outgoingRequest));
+		WakeUp(shard);
 	}
 
 	void NetworkReactor::SendData(std::size_t peerId, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, Nz::NetPacket&& packet)
 	{
-		assert(peerId >= m_firstId);
+		std::size_t localPeerId;
+		Shard& shard = GetShard(peerId, &localPeerId);
 
 		OutgoingEvent::PacketEvent packetEvent;
 		packetEvent.channelId = channelId;
 		packetEvent.packet = std::move(packet);
 		packetEvent.flags = flags;
+		packetEvent.enqueueTime = Nz::GetElapsedMicroseconds();
 
 		OutgoingEvent outgoingData;
-		outgoingData.peerId = peerId - m_firstId;
+		outgoingData.peerId = localPeerId;
 		outgoingData.data = std::move(packetEvent);
 
-		m_outgoingQueue.enqueue(std::move(outgoingData));
+		shard.outgoingQueue.enqueue(GetProducerToken(shard), std::move(outgoingData));
+		WakeUp(shard);
+	}
+
+	void NetworkReactor::RecyclePackets(Shard& shard, bool force)
+	{
+		if (!m_packetPool)
+			return;
+
+		auto it = std::remove_if(shard.inflightPackets.begin(), shard.inflightPackets.end(), [&](Nz::ENetPacketRef& enetPacket)
+		{
+			// Only our reference is left, ENet no longer needs this packet
+			if (!force && enetPacket->referenceCount > 1)
+				return false;
+
+			m_packetPool->Release(std::move(enetPacket->data));
+			return true;
+		});
+		shard.inflightPackets.erase(it, shard.inflightPackets.end());
+	}
+
+	void NetworkReactor::SampleRoundTripTimes(Shard& shard)
+	{
+		std::array<std::size_t, RoundTripTimeBounds.size() + 1> buckets;
+		buckets.fill(0);
+
+		for (std::size_t peerId = 0; peerId < shard.clients.size(); ++peerId)
+		{
+			Nz::ENetPeer* peer = shard.clients[peerId];
+			if (!peer || shard.pendingConnections[peerId] || shard.refusedPeers.UnboundedTest(peerId))
+				continue;
+
+			Nz::UInt32 roundTripTime = peer->GetRoundTripTime();
+			auto it = std::lower_bound(RoundTripTimeBounds.begin(), RoundTripTimeBounds.end(), roundTripTime);
+			buckets[std::distance(RoundTripTimeBounds.begin(), it)]++;
+		}
+
+		for (std::size_t i = 0; i < buckets.size(); ++i)
+			shard.roundTripTimes[i].store(buckets[i], std::memory_order_relaxed);
+	}
+
+	void NetworkReactor::SendDataBatch(OutgoingPacket* packets, std::size_t packetCount)
+	{
+		// Reused between calls to prevent allocations
+		thread_local std::vector<OutgoingEvent> outgoingEvents;
+
+		Shard* currentShard = nullptr;
+		auto FlushEvents = [&]
+		{
+			if (outgoingEvents.empty())
+				return;
+
+			currentShard->outgoingQueue.enqueue_bulk(GetProducerToken(*currentShard), std::make_move_iterator(outgoingEvents.begin()), outgoingEvents.size());
+			WakeUp(*currentShard);
+
+			outgoingEvents.clear();
+		};
+
+		Nz::UInt64 enqueueTime = Nz::GetElapsedMicroseconds();
+		for (std::size_t i = 0; i < packetCount; ++i)
+		{
+			OutgoingPacket& packet = packets[i];
+
+			std::size_t localPeerId;
+			Shard& shard = GetShard(packet.peerId, &localPeerId);
+
+			// Packets are enqueued as one block per shard
+			if (&shard != currentShard)
+			{
+				FlushEvents();
+				currentShard = &shard;
+			}
+
+			auto& outgoingData = outgoingEvents.emplace_back();
+			outgoingData.peerId = localPeerId;
+
+			auto& packetEvent = outgoingData.data.emplace<OutgoingEvent::PacketEvent>();
+			packetEvent.channelId = packet.channelId;
+			packetEvent.enqueueTime = enqueueTime;
+			packetEvent.flags = packet.flags;
+			packetEvent.packet = std::move(packet.packet);
+		}
+
+		FlushEvents();
+	}
+
+	moodycamel::ProducerToken& NetworkReactor::GetProducerToken(Shard& shard)
+	{
+		// Producer tokens can't be shared between threads, each thread gets its own for every shard
+		struct TokenCache
+		{
+			Nz::UInt64 reactorId = 0;
+			std::vector<moodycamel::ProducerToken*> tokens;
+		};
+
+		thread_local TokenCache tokenCache;
+		if (tokenCache.reactorId != m_reactorId)
+		{
+			tokenCache.reactorId = m_reactorId;
+			tokenCache.tokens.clear();
+			tokenCache.tokens.resize(m_shards.size(), nullptr);
+		}
+
+		moodycamel::ProducerToken*& token = tokenCache.tokens[shard.shardIndex];
+		if (!token)
+		{
+			std::lock_guard<std::mutex> lock(shard.producerTokenMutex);
+
+			auto it = shard.producerTokens.find(std::this_thread::get_id());
+			if (it == shard.producerTokens.end())
+				it = shard.producerTokens.emplace(std::this_thread::get_id(), std::make_unique<moodycamel::ProducerToken>(shard.outgoingQueue)).first;
+
+			token = it->second.get();
+		}
+
+		return *token;
 	}
 
-	void NetworkReactor::WorkerThread()
+	void NetworkReactor::WorkerThread(Shard& shard)
 	{
-		moodycamel::ConsumerToken connectionToken(m_connectionRequests);
-		moodycamel::ConsumerToken outgoingToken(m_outgoingQueue);
-		moodycamel::ProducerToken incomingToken(m_incomingQueue);
+		moodycamel::ConsumerToken connectionToken(shard.connectionRequests);
+		moodycamel::ConsumerToken outgoingToken(shard.outgoingQueue);
+		moodycamel::ProducerToken incomingToken(shard.incomingQueue);
 
+		Nz::UInt32 serviceTimeout = 0;
 		while (m_running.load(std::memory_order_acquire))
 		{
-			ReceivePackets(incomingToken);
-			SendPackets(incomingToken, outgoingToken);
+			// Consume the wakeup before handling queues, anything enqueued from now will wake us up again
+			if (shard.wakeupPending.exchange(false, std::memory_order_acq_rel))
+				serviceTimeout = 0;
+
+			Nz::ENetEvent event;
+			bool hasReceivedEvents = WaitForActivity(shard, &event, serviceTimeout);
+
+			Nz::UInt64 receiveStartTime = Nz::GetElapsedMicroseconds();
+			if (hasReceivedEvents)
+				ReceivePackets(shard, incomingToken, event);
+
+			Nz::UInt64 sendStartTime = Nz::GetElapsedMicroseconds();
+			SendPackets(shard, incomingToken, outgoingToken);
+			Nz::UInt64 sendEndTime = Nz::GetElapsedMicroseconds();
+
+			shard.serviceTime.fetch_add(sendStartTime - receiveStartTime, std::memory_order_relaxed);
+			shard.sendTime.fetch_add(sendEndTime - sendStartTime, std::memory_order_relaxed);
+
+			RecyclePackets(shard, false);
+
+			if (sendEndTime - shard.lastRoundTripTimeSample >= RoundTripTimeSampleInterval)
+			{
+				SampleRoundTripTimes(shard);
+				shard.lastRoundTripTimeSample = sendEndTime;
+			}
+
+			// Keep the wakeup connection alive however busy we are, and reconnect it as soon as possible
+			if (!shard.wakeupHostPeer || sendEndTime - shard.lastWakeupHostService >= WakeupHostServiceInterval)
+			{
+				ServiceWakeupHost(shard);
+				shard.lastWakeupHostService = sendEndTime;
+			}
+
+			if (sendEndTime - shard.windowStartTime >= SendLatencyWindow)
+			{
+				shard.sendLatencyMax.store(shard.windowLatencyMax, std::memory_order_relaxed);
+				shard.sendLatencySum.store(shard.windowLatencySum, std::memory_order_relaxed);
+				shard.sentPacketCount.store(shard.windowPacketCount, std::memory_order_relaxed);
+
+				shard.windowLatencyMax = 0;
+				shard.windowLatencySum = 0;
+				shard.windowPacketCount = 0;
+				shard.windowStartTime = sendEndTime;
+			}
 
 			// Handle connection requests last to treat disconnection request before connection requests
-			HandleConnectionRequests(connectionToken);
+			HandleConnectionRequests(shard, connectionToken);
+
+			// Keep servicing ENet while it has events for us
+			if (hasReceivedEvents)
+				serviceTimeout = 0;
+			else if (!shard.wakeupHostPeer || shard.backloggedPeers.TestAny())
+				serviceTimeout = BusyServiceTime;
+			else
+				serviceTimeout = IdleServiceTime;
 		}
 
-		EnsureProperDisconnection(incomingToken, outgoingToken);
+		EnsureProperDisconnection(shard, incomingToken, outgoingToken);
+		RecyclePackets(shard, true);
 	}
 
-	void NetworkReactor::EnsureProperDisconnection(const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token)
+	void NetworkReactor::EnsureProperDisconnection(Shard& shard, const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token)
 	{
 		// Prevent someone connecting from now
-		if (Nz::IpAddress listenAddress = m_host.GetBoundAddress(); listenAddress.IsValid() && !listenAddress.IsLoopback())
-			m_host.AllowsIncomingConnections(false);
+		if (Nz::IpAddress listenAddress = shard.host.GetBoundAddress(); listenAddress.IsValid() && !listenAddress.IsLoopback())
+			shard.host.AllowsIncomingConnections(false);
 
 		// Send every pending packet and handle disconnection requests
-		SendPackets(producterToken, token);
+		SendPackets(shard, producterToken, token);
 
 		// Then, force a disconnection for every remaining peer
-		for (Nz::ENetPeer* peer : m_clients)
+		for (Nz::ENetPeer* peer : shard.clients)
 		{
 			if (peer)
 			{
@@ -165,16 +640,15 @@ namespace bw
 		while (c.GetMilliseconds() < 1000)
 		{
 			Nz::ENetEvent event;
-			if (m_host.Service(&event, 1) > 0)
+			if (shard.host.Service(&event, 1) > 0)
 			{
 				switch (event.type)
 				{
 					case Nz::ENetEventType::Disconnect:
-					{
-						Nz::UInt16 peerId = event.peer->GetPeerId();
-						m_clients[peerId] = nullptr;
+						if (event.peer != shard.wakeupPeer)
+							ReleasePeerId(shard, event.peer);
+
 						break;
-					}
 
 					default:
 						// Ignore everything else
@@ -183,167 +657,591 @@ namespace bw
 			}
 
 			// Exit when every client has properly disconnected
-			if (std::all_of(m_clients.begin(), m_clients.end(), [](Nz::ENetPeer* peer) { return peer == nullptr; }))
+			if (std::all_of(shard.clients.begin(), shard.clients.end(), [](Nz::ENetPeer* peer) { return peer == nullptr; }))
 				break;
 		}
 	}
 
-	void NetworkReactor::HandleConnectionRequests(moodycamel::ConsumerToken& token)
-{
-		ConnectionRequest request;
-		while (m_connectionRequests.try_dequeue(token, request))
+	void NetworkReactor::HandleConnectionRequests(Shard& shard, moodycamel::ConsumerToken& token)
+	{
+		std::size_t requestCount;
+		while ((requestCount = shard.connectionRequests.try_dequeue_bulk(token, shard.connectionRequestBuffer.begin(), shard.connectionRequestBuffer.size())) > 0)
 		{
-			if (Nz::ENetPeer* peer = m_host.Connect(request.remoteAddress, NetworkChannelCount, request.data))
+			for (std::size_t i = 0; i < requestCount; ++i)
 			{
-				Nz::UInt16 peerId = peer->GetPeerId();
-				m_clients[peerId] = peer;
+				ConnectionRequest& request = shard.connectionRequestBuffer[i];
+
+				// Let the server know we can be redirected to another shard, connection will only be reported once it accepted us
+				if (Nz::ENetPeer* peer = shard.host.Connect(request.remoteAddress, ReactorChannelCount, request.data | ShardingSupportFlag))
+				{
+					std::size_t peerId = AllocatePeerId(shard, peer);
+
+					auto& pendingConnection = shard.pendingConnections[peerId].emplace();
+					pendingConnection.data = request.data;
+					pendingConnection.remoteAddress = request.remoteAddress;
 
-				request.callback(peerId);
+					request.callback(peerId);
+				}
+				else
+					request.callback(InvalidPeerId);
 			}
-			else
-				request.callback(InvalidPeerId);
 		}
 	}
 
-	void NetworkReactor::ReceivePackets(const moodycamel::ProducerToken& producterToken)
+	bool NetworkReactor::HandleIncomingConnection(Shard& shard, Nz::ENetPeer* peer, Nz::UInt32 data)
 	{
-		Nz::ENetEvent event;
-		if (m_host.Service(&event, 5) > 0)
+		auto RefuseConnection = [&](Nz::UInt32 disconnectionData)
 		{
-			do
+			shard.refusedPeers.UnboundedSet(shard.localPeerIds[peer->GetPeerId()]);
+			peer->Disconnect(disconnectionData);
+			return false;
+		};
+
+		// Peers without sharding support use another channel layout
+		if ((data & (ShardingSupportFlag | RedirectedConnectionFlag)) == 0)
+			return RefuseConnection(0);
+
+		// Only the first shard (the one listening on the public port) redirects peers
+		if ((data & ShardingSupportFlag) && shard.shardIndex == 0 && m_shards.size() > 1)
+		{
+			// Capacity is reserved by the shard the peer ends up on
+			if (m_peerCount.load(std::memory_order_relaxed) >= m_maxPeerCount)
+				return RefuseConnection(0);
+
+			Shard* targetShard = &shard;
+			std::size_t targetPeerCount = shard.peerCount.load(std::memory_order_relaxed);
+			for (auto& shardPtr : m_shards)
 			{
-				switch (event.type)
+				std::size_t peerCount = shardPtr->peerCount.load(std::memory_order_relaxed);
+				if (peerCount < targetPeerCount)
 				{
-					case Nz::ENetEventType::Disconnect:
-					{
-						Nz::UInt16 peerId = event.peer->GetPeerId();
-						m_clients[peerId] = nullptr;
+					targetShard = shardPtr.get();
+					targetPeerCount = peerCount;
+				}
+			}
 
-						IncomingEvent::DisconnectEvent disconnectEvent;
-						disconnectEvent.data = event.data;
+			if (targetShard != &shard)
+				return RefuseConnection(RedirectionFlag | static_cast<Nz::UInt32>(targetShard->shardIndex));
+		}
 
-						IncomingEvent newEvent;
-						newEvent.peerId = m_firstId + peerId;
-						newEvent.data.emplace<IncomingEvent::DisconnectEvent>(std::move(disconnectEvent));
+		// Shards share the same capacity
+		if (m_peerCount.fetch_add(1, std::memory_order_relaxed) >= m_maxPeerCount)
+		{
+			m_peerCount.fetch_sub(1, std::memory_order_relaxed);
+			return RefuseConnection(0);
+		}
 
-						m_incomingQueue.enqueue(producterToken, std::move(newEvent));
-						break;
-					}
+		// Any packet on the control channel notifies the client it has been accepted, redirected clients don't wait for it
+		if (data & ShardingSupportFlag)
+			peer->Send(ControlChannelId, Nz::ENetPacketFlag_Reliable, Nz::NetPacket(0));
 
-					case Nz::ENetEventType::IncomingConnect:
-					case Nz::ENetEventType::OutgoingConnect:
-					{
-						Nz::UInt16 peerId = event.peer->GetPeerId();
-						m_clients[peerId] = event.peer;
+		return true;
+	}
+
+	bool NetworkReactor::HandleOutgoingDisconnection(Shard& shard, std::size_t peerId, Nz::UInt32 data)
+	{
+		PendingConnection pendingConnection = std::move(shard.pendingConnections[peerId].value());
+		shard.pendingConnections[peerId].reset();
+
+		if ((data & RedirectionFlag) == 0)
+			return true;
+
+		// Server asked us to connect to another of its shards, which is listening on a port next to this one
+		Nz::IpAddress shardAddress = pendingConnection.remoteAddress;
+		shardAddress.SetPort(static_cast<Nz::UInt16>(shardAddress.GetPort() + (data & ~RedirectionFlag)));
+
+		Nz::ENetPeer* peer = shard.host.Connect(shardAddress, ReactorChannelCount, pendingConnection.data | RedirectedConnectionFlag);
+		if (!peer)
+			return true;
+
+		// Peer id is exposed to the game, keep it even if ENet gave us another peer
+		shard.clients[peerId] = peer;
+		shard.localPeerIds[peer->GetPeerId()] = peerId;
+		return false;
+	}
+
+	void NetworkReactor::ReceivePackets(Shard& shard, const moodycamel::ProducerToken& producterToken, Nz::ENetEvent& event)
+	{
+		do
+		{
+			// Wakeup packets have done their job by getting us here
+			if (event.peer == shard.wakeupPeer)
+			{
+				// Without the loopback connection we would only wake up on timeouts
+				if (event.type == Nz::ENetEventType::Disconnect)
+					ConnectWakeupPeer(shard);
 
-						IncomingEvent::ConnectEvent connectEvent;
-						connectEvent.data = event.data;
-						connectEvent.outgoingConnection = (event.type == Nz::ENetEventType::OutgoingConnect);
+				continue;
+			}
 
-						IncomingEvent newEvent;
-						newEvent.peerId = m_firstId + peerId;
-						newEvent.data.emplace<IncomingEvent::ConnectEvent>(std::move(connectEvent));
+			switch (event.type)
+			{
+				case Nz::ENetEventType::Disconnect:
+				{
+					std::size_t peerId = ReleasePeerId(shard, event.peer);
+					ClearBacklog(shard, peerId);
 
-						m_incomingQueue.enqueue(producterToken, std::move(newEvent));
+					// Peer was redirected to another shard (or refused) and has never been reported
+					if (shard.refusedPeers.UnboundedTest(peerId))
+					{
+						shard.refusedPeers.UnboundedReset(peerId);
 						break;
 					}
 
-					case Nz::ENetEventType::Receive:
+					if (shard.pendingConnections[peerId])
+					{
+						if (!HandleOutgoingDisconnection(shard, peerId, event.data))
+							break;
+					}
+					else
 					{
-						Nz::UInt16 peerId = event.peer->GetPeerId();
+						m_peerCount.fetch_sub(1, std::memory_order_relaxed);
+						shard.peerCount.fetch_sub(1, std::memory_order_relaxed);
+					}
+
+					IncomingEvent::DisconnectEvent disconnectEvent;
+					disconnectEvent.data = event.data;
+
+					IncomingEvent newEvent;
+					newEvent.peerId = shard.firstId + peerId;
+					newEvent.data.emplace<IncomingEvent::DisconnectEvent>(std::move(disconnectEvent));
+
+					shard.incomingQueue.enqueue(producterToken, std::move(newEvent));
+					break;
+				}
 
-						IncomingEvent::PacketEvent packetEvent;
-						packetEvent.packet = std::move(event.packet->data);
+				case Nz::ENetEventType::IncomingConnect:
+				{
+					std::size_t peerId = AllocatePeerId(shard, event.peer);
+					shard.peerSendStates[peerId].lastRefillTime = 0; //< start with a full budget
+
+					if (HandleIncomingConnection(shard, event.peer, event.data))
+						ReportConnection(shard, producterToken, peerId, false, event.data & ~(ShardingSupportFlag | RedirectedConnectionFlag));
+
+					break;
+				}
+
+				case Nz::ENetEventType::OutgoingConnect:
+				{
+					std::size_t peerId = shard.localPeerIds[event.peer->GetPeerId()];
+					shard.peerSendStates[peerId].lastRefillTime = 0; //< start with a full budget
 
-						IncomingEvent newEvent;
-						newEvent.peerId = m_firstId + peerId;
-						newEvent.data.emplace<IncomingEvent::PacketEvent>(std::move(packetEvent));
+					// Wait for the server to accept (or redirect) us
+					if (!shard.pendingConnections[peerId])
+						ReportConnection(shard, producterToken, peerId, true, event.data);
 
-						m_incomingQueue.enqueue(producterToken, std::move(newEvent));
+					break;
+				}
+
+				case Nz::ENetEventType::Receive:
+				{
+					std::size_t peerId = shard.localPeerIds[event.peer->GetPeerId()];
+
+					if (shard.refusedPeers.UnboundedTest(peerId))
 						break;
+
+					// Servers never send anything to peers they redirect, receiving something means we've been accepted
+					if (auto& pendingConnection = shard.pendingConnections[peerId])
+					{
+						ReportConnection(shard, producterToken, peerId, true, pendingConnection->data);
+						pendingConnection.reset();
 					}
 
-					default:
+					if (event.channelId == ControlChannelId)
 						break;
+
+					IncomingEvent::PacketEvent packetEvent;
+					packetEvent.packet = std::move(event.packet->data);
+
+					IncomingEvent newEvent;
+					newEvent.peerId = shard.firstId + peerId;
+					newEvent.data.emplace<IncomingEvent::PacketEvent>(std::move(packetEvent));
+
+					shard.incomingQueue.enqueue(producterToken, std::move(newEvent));
+					break;
 				}
+
+				default:
+					break;
 			}
-			while (m_host.CheckEvents(&event));
 		}
+		while (shard.host.CheckEvents(&event));
+	}
+
+	void NetworkReactor::ReportConnection(Shard& shard, const moodycamel::ProducerToken& producterToken, std::size_t peerId, bool outgoingConnection, Nz::UInt32 data)
+	{
+		// Incoming peers were already counted when accepted
+		if (outgoingConnection)
+			m_peerCount.fetch_add(1, std::memory_order_relaxed);
+
+		shard.peerCount.fetch_add(1, std::memory_order_relaxed);
+
+		IncomingEvent::ConnectEvent connectEvent;
+		connectEvent.data = data;
+		connectEvent.outgoingConnection = outgoingConnection;
+
+		IncomingEvent newEvent;
+		newEvent.peerId = shard.firstId + peerId;
+		newEvent.data.emplace<IncomingEvent::ConnectEvent>(std::move(connectEvent));
+
+		shard.incomingQueue.enqueue(producterToken, std::move(newEvent));
 	}
 
-	void NetworkReactor::SendPackets(const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token)
+	std::size_t NetworkReactor::ReleasePeerId(Shard& shard, Nz::ENetPeer* peer)
 	{
-		OutgoingEvent outEvent;
-		while (m_outgoingQueue.try_dequeue(token, outEvent))
+		std::size_t& localPeerId = shard.localPeerIds[peer->GetPeerId()];
+		assert(localPeerId != InvalidPeerId);
+
+		std::size_t peerId = localPeerId;
+		shard.clients[peerId] = nullptr;
+		localPeerId = InvalidPeerId;
+
+		return peerId;
+	}
+
+	void NetworkReactor::SendPackets(Shard& shard, const moodycamel::ProducerToken& producterToken, moodycamel::ConsumerToken& token)
+	{
+		Nz::UInt64 firstEnqueueTime = std::numeric_limits<Nz::UInt64>::max();
+		Nz::UInt64 enqueueTimeSum = 0;
+		Nz::UInt64 sentPacketCount = 0;
+
+		Nz::UInt64 now = Nz::GetElapsedMicroseconds();
+		Nz::UInt32 bandwidthBudget = m_peerBandwidthBudget.load(std::memory_order_relaxed);
+
+		auto RefillBudget = [&](PeerSendState& sendState)
+		{
+			if (bandwidthBudget == 0)
+				return;
+
+			Nz::Int64 maxBytes = static_cast<Nz::Int64>(bandwidthBudget * BandwidthBurstTime / 1'000'000);
+			if (sendState.lastRefillTime != 0)
+			{
+				Nz::Int64 refill = static_cast<Nz::Int64>(bandwidthBudget * (now - sendState.lastRefillTime) / 1'000'000);
+				sendState.availableBytes = std::min(sendState.availableBytes + refill, maxBytes);
+			}
+			else
+				sendState.availableBytes = maxBytes;
+
+			sendState.lastRefillTime = now;
+		};
+
+		auto SendPacket = [&](std::size_t peerId, OutgoingEvent::PacketEvent& packetEvent)
+		{
+			Nz::ENetPeer* peer = shard.clients[peerId];
+			assert(peer);
+
+			std::size_t packetSize = (packetEvent.sharedPacket) ? packetEvent.sharedPacket->data.GetDataSize() : packetEvent.packet.GetDataSize();
+
+			// Bytes count even when budget is exceeded, so that large packets are still sent eventually
+			if (bandwidthBudget > 0)
+				shard.peerSendStates[peerId].availableBytes -= static_cast<Nz::Int64>(packetSize);
+
+			Nz::UInt8 enetChannelId = packetEvent.channelId;
+			if ((packetEvent.flags & Nz::ENetPacketFlag_Reliable) == 0)
+				enetChannelId += RealtimeChannelOffset;
+
+			if (packetEvent.sharedPacket)
+				peer->Send(enetChannelId, packetEvent.sharedPacket);
+			else if (m_packetPool)
+			{
+				// Keep a reference on the packet to recycle it afterwards
+				Nz::ENetPacketRef enetPacket = shard.host.AllocatePacket(packetEvent.flags, std::move(packetEvent.packet));
+				peer->Send(enetChannelId, enetPacket);
+
+				shard.inflightPackets.emplace_back(std::move(enetPacket));
+			}
+			else
+				peer->Send(enetChannelId, packetEvent.flags, std::move(packetEvent.packet));
+
+			if (packetEvent.channelId < NetworkChannelCount)
+			{
+				shard.channelByteCount[packetEvent.channelId].fetch_add(packetSize, std::memory_order_relaxed);
+				shard.channelPacketCount[packetEvent.channelId].fetch_add(1, std::memory_order_relaxed);
+			}
+
+			firstEnqueueTime = std::min(firstEnqueueTime, packetEvent.enqueueTime);
+			enqueueTimeSum += packetEvent.enqueueTime;
+			sentPacketCount++;
+		};
+
+		auto FlushBacklog = [&](std::size_t peerId, bool ignoreBudget)
 		{
-			std::visit([&](auto&& arg) {
-				using T = std::decay_t<decltype(arg)>;
-				if constexpr (std::is_same_v<T, OutgoingEvent::DisconnectEvent>)
+			PeerSendState& sendState = shard.peerSendStates[peerId];
+			RefillBudget(sendState);
+
+			bool isEmpty = true;
+			for (auto& backlog : sendState.backlogs) //< by priority
+			{
+				while (!backlog.empty() && (ignoreBudget || bandwidthBudget == 0 || sendState.availableBytes > 0))
 				{
-					if (Nz::ENetPeer* peer = m_clients[outEvent.peerId])
+					SendPacket(peerId, backlog.front());
+					backlog.pop_front();
+
+					shard.backlogSize.fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				if (!backlog.empty())
+					isEmpty = false;
+			}
+
+			if (isEmpty)
+				shard.backloggedPeers.UnboundedReset(peerId);
+		};
+
+		auto HandlePacket = [&](std::size_t peerId, OutgoingEvent::PacketEvent& packetEvent)
+		{
+			SendPriority priority = SendPriority::Realtime;
+			if (packetEvent.flags & Nz::ENetPacketFlag_Reliable)
+			{
+				assert(packetEvent.channelId < m_channelPriorities.size());
+				priority = m_channelPriorities[packetEvent.channelId].load(std::memory_order_relaxed);
+			}
+
+			PeerSendState& sendState = shard.peerSendStates[peerId];
+			RefillBudget(sendState);
+
+			// Packets of a priority class are deferred as long as older packets of that class are waiting
+			auto& backlog = sendState.backlogs[static_cast<std::size_t>(priority)];
+			if (priority == SendPriority::Realtime || bandwidthBudget == 0 || (backlog.empty() && sendState.availableBytes > 0))
+				SendPacket(peerId, packetEvent);
+			else
+			{
+				backlog.emplace_back(std::move(packetEvent));
+				shard.backlogSize.fetch_add(1, std::memory_order_relaxed);
+				shard.backloggedPeers.UnboundedSet(peerId);
+			}
+		};
+
+		// Budget may have been removed while packets were deferred, they have to be sent before any newer packet
+		if (bandwidthBudget == 0)
+		{
+			for (std::size_t peerId = shard.backloggedPeers.FindFirst(); peerId != shard.backloggedPeers.npos; peerId = shard.backloggedPeers.FindNext(peerId))
+				FlushBacklog(peerId, true);
+		}
+
+		std::size_t eventCount;
+		while ((eventCount = shard.outgoingQueue.try_dequeue_bulk(token, shard.outgoingEventBuffer.begin(), shard.outgoingEventBuffer.size())) > 0)
+		{
+			for (std::size_t i = 0; i < eventCount; ++i)
+			{
+				OutgoingEvent& outEvent = shard.outgoingEventBuffer[i];
+
+				std::visit([&](auto&& arg) {
+					using T = std::decay_t<decltype(arg)>;
+					if constexpr (std::is_same_v<T, OutgoingEvent::BroadcastEvent>)
+					{
+						BroadcastPayload& payload = *arg.payload;
+
+						// ENet packets belong to a host, the last shard takes the payload packet and the others copy it
+						bool isLastShard = (payload.shardCount.load(std::memory_order_acquire) == 1);
+
+						Nz::NetPacket packet;
+						if (isLastShard)
+							packet = std::move(payload.packet);
+						else
+						{
+							const Nz::UInt8* packetData = payload.packet.GetConstData() + Nz::NetPacket::HeaderSize;
+							std::size_t packetSize = payload.packet.GetDataSize() - Nz::NetPacket::HeaderSize;
+							if (m_packetPool)
+							{
+								packet = m_packetPool->Acquire(payload.packet.GetNetCode());
+								packet.Write(packetData, packetSize);
+							}
+							else
+								packet = Nz::NetPacket(payload.packet.GetNetCode(), packetData, packetSize);
+						}
+
+						// Every peer references the same ENet packet
+						Nz::ENetPacketRef sharedPacket = shard.host.AllocatePacket(arg.flags, std::move(packet));
+
+						for (std::size_t i = 0; i < arg.peerCount; ++i)
+						{
+							std::size_t peerId = payload.peerIds[arg.firstPeerIndex + i];
+							if (!shard.clients[peerId])
+								continue;
+
+							OutgoingEvent::PacketEvent packetEvent;
+							packetEvent.channelId = arg.channelId;
+							packetEvent.enqueueTime = arg.enqueueTime;
+							packetEvent.flags = arg.flags;
+							packetEvent.sharedPacket = sharedPacket;
+
+							HandlePacket(peerId, packetEvent);
+						}
+
+						if (m_packetPool)
+							shard.inflightPackets.emplace_back(std::move(sharedPacket));
+
+						ReleaseBroadcastPayload(arg.payload, isLastShard);
+					}
+					else if constexpr (std::is_same_v<T, OutgoingEvent::DisconnectEvent>)
 					{
-						switch (arg.type)
+						if (Nz::ENetPeer* peer = shard.clients[outEvent.peerId])
 						{
-							case DisconnectionType::Kick:
+							switch (arg.type)
 							{
-								peer->DisconnectNow(arg.data);
+								case DisconnectionType::Kick:
+								{
+									peer->DisconnectNow(arg.data);
 
-								// DisconnectNow does not generate Disconnect event
-								m_clients[outEvent.peerId] = nullptr;
+									// DisconnectNow does not generate Disconnect event
+									ReleasePeerId(shard, peer);
+									ClearBacklog(shard, outEvent.peerId);
 
-								IncomingEvent newEvent;
-								newEvent.peerId = m_firstId + outEvent.peerId;
+									if (shard.pendingConnections[outEvent.peerId])
+										shard.pendingConnections[outEvent.peerId].reset();
+									else
+									{
+										m_peerCount.fetch_sub(1, std::memory_order_relaxed);
+										shard.peerCount.fetch_sub(1, std::memory_order_relaxed);
+									}
 
-								auto& disconnectEvent = newEvent.data.emplace<IncomingEvent::DisconnectEvent>();
-								disconnectEvent.data = 0;
+									IncomingEvent newEvent;
+									newEvent.peerId = shard.firstId + outEvent.peerId;
 
-								m_incomingQueue.enqueue(producterToken, std::move(newEvent));
-								break;
-							}
+									auto& disconnectEvent = newEvent.data.emplace<IncomingEvent::DisconnectEvent>();
+									disconnectEvent.data = 0;
 
-							case DisconnectionType::Later:
-								peer->DisconnectLater(arg.data);
-								break;
+									shard.incomingQueue.enqueue(producterToken, std::move(newEvent));
+									break;
+								}
 
-							case DisconnectionType::Normal:
-								peer->Disconnect(arg.data);
-								break;
+								case DisconnectionType::Later:
+									// Deferred packets were sent before the disconnection request
+									FlushBacklog(outEvent.peerId, true);
+									peer->DisconnectLater(arg.data);
+									break;
 
-							default:
-								assert(!"Unknown disconnection type");
-								break;
+								case DisconnectionType::Normal:
+									FlushBacklog(outEvent.peerId, true);
+									peer->Disconnect(arg.data);
+									break;
+
+								default:
+									assert(!"Unknown disconnection type");
+									break;
+							}
 						}
 					}
-				}
-				else if constexpr (std::is_same_v<T, OutgoingEvent::PacketEvent>)
-				{
-					if (Nz::ENetPeer* peer = m_clients[outEvent.peerId])
-						peer->Send(arg.channelId, arg.flags, std::move(arg.packet));
-				}
-				else if constexpr (std::is_same_v<T, OutgoingEvent::QueryPeerInfo>)
-				{
-					if (Nz::ENetPeer* peer = m_clients[outEvent.peerId])
+					else if constexpr (std::is_same_v<T, OutgoingEvent::PacketEvent>)
 					{
-						IncomingEvent newEvent;
-						newEvent.peerId = m_firstId + outEvent.peerId;
-
-						auto& peerInfo = newEvent.data.emplace<IncomingEvent::PeerInfoResponse>();
-						peerInfo.callback = std::move(arg.callback);
-						peerInfo.peerInfo.timeSinceLastReceive = m_host.GetServiceTime() - peer->GetLastReceiveTime();
-						peerInfo.peerInfo.ping = peer->GetRoundTripTime();
-						peerInfo.peerInfo.totalByteReceived = peer->GetTotalByteReceived();
-						peerInfo.peerInfo.totalByteSent = peer->GetTotalByteSent();
-						peerInfo.peerInfo.totalPacketLost = peer->GetTotalPacketLost();
-						peerInfo.peerInfo.totalPacketReceived = peer->GetTotalPacketReceived();
-						peerInfo.peerInfo.totalPacketSent = peer->GetTotalPacketSent();
-
-						m_incomingQueue.enqueue(producterToken, std::move(newEvent));
+						if (shard.clients[outEvent.peerId])
+							HandlePacket(outEvent.peerId, arg);
+						else if (m_packetPool)
+							m_packetPool->Release(std::move(arg.packet));
+					}
+					else if constexpr (std::is_same_v<T, OutgoingEvent::QueryPeerInfo>)
+					{
+						if (Nz::ENetPeer* peer = shard.clients[outEvent.peerId])
+						{
+							IncomingEvent newEvent;
+							newEvent.peerId = shard.firstId + outEvent.peerId;
+
+							auto& peerInfo = newEvent.data.emplace<IncomingEvent::PeerInfoResponse>();
+							peerInfo.callback = std::move(arg.callback);
+							peerInfo.peerInfo.timeSinceLastReceive = shard.host.GetServiceTime() - peer->GetLastReceiveTime();
+							peerInfo.peerInfo.ping = peer->GetRoundTripTime();
+							peerInfo.peerInfo.totalByteReceived = peer->GetTotalByteReceived();
+							peerInfo.peerInfo.totalByteSent = peer->GetTotalByteSent();
+							peerInfo.peerInfo.totalPacketLost = peer->GetTotalPacketLost();
+							peerInfo.peerInfo.totalPacketReceived = peer->GetTotalPacketReceived();
+							peerInfo.peerInfo.totalPacketSent = peer->GetTotalPacketSent();
+
+							shard.incomingQueue.enqueue(producterToken, std::move(newEvent));
+						}
 					}
+					else
+						static_assert(AlwaysFalse<T>::value, "non-exhaustive visitor");
+
+				}, outEvent.data);
+			}
+		}
+
+		// Send deferred packets as budget comes back, highest priorities first
+		for (std::size_t peerId = shard.backloggedPeers.FindFirst(); peerId != shard.backloggedPeers.npos; peerId = shard.backloggedPeers.FindNext(peerId))
+			FlushBacklog(peerId, false);
+
+		if (sentPacketCount > 0)
+		{
+			// Push packets to the socket right away instead of waiting for the next service
+			shard.host.Flush();
+
+			Nz::UInt64 flushTime = Nz::GetElapsedMicroseconds();
+
+			shard.windowLatencyMax = std::max(shard.windowLatencyMax, flushTime - firstEnqueueTime);
+			shard.windowLatencySum += sentPacketCount * flushTime - enqueueTimeSum;
+			shard.windowPacketCount += sentPacketCount;
+		}
+	}
+
+	void NetworkReactor::SetChannelPriority(Nz::UInt8 channelId, SendPriority priority)
+	{
+		assert(channelId < m_channelPriorities.size());
+		m_channelPriorities[channelId].store(priority, std::memory_order_relaxed);
+	}
+
+	void NetworkReactor::SetPeerBandwidthBudget(Nz::UInt32 bytesPerSecond)
+	{
+		m_peerBandwidthBudget.store(bytesPerSecond, std::memory_order_relaxed);
+	}
+
+	void NetworkReactor::ServiceWakeupHost(Shard& shard)
+	{
+		// Connection may have been lost and failed to be reestablished
+		if (!shard.wakeupPeer && !ConnectWakeupPeer(shard))
+			return;
+
+		// Handles the handshake and acknowledges host pings, the wakeup connection would time out otherwise
+		std::lock_guard<std::mutex> lock(shard.wakeupMutex);
+
+		Nz::ENetEvent event;
+		if (shard.wakeupHost.Service(&event, 0) > 0)
+		{
+			do
+			{
+				switch (event.type)
+				{
+					case Nz::ENetEventType::Disconnect:
+						shard.wakeupHostPeer = nullptr;
+						break;
+
+					case Nz::ENetEventType::IncomingConnect:
+						shard.wakeupHostPeer = event.peer;
+						break;
+
+					default:
+						break;
 				}
-				else
-					static_assert(AlwaysFalse<T>::value, "non-exhaustive visitor");
+			}
+			while (shard.wakeupHost.CheckEvents(&event));
+		}
+	}
+
+	bool NetworkReactor::WaitForActivity(Shard& shard, Nz::ENetEvent* event, Nz::UInt32 timeout)
+	{
+		// Only account for the time spent servicing ENet, not for the time spent waiting for activity
+		Nz::UInt64 serviceStartTime = Nz::GetElapsedMicroseconds();
+		bool hasReceivedEvents = (shard.host.Service(event, 0) > 0);
+		shard.serviceTime.fetch_add(Nz::GetElapsedMicroseconds() - serviceStartTime, std::memory_order_relaxed);
+
+		if (hasReceivedEvents || timeout == 0)
+			return hasReceivedEvents;
 
-			}, outEvent.data);
+		// Blocks until a peer (or a producer, through the wakeup connection) sends us something
+		return shard.host.Service(event, timeout) > 0;
+	}
+
+	void NetworkReactor::WakeUp(Shard& shard)
+	{
+		// Only the first producer has to signal the reactor, until it consumes the wakeup
+		if (!shard.wakeupPending.exchange(true, std::memory_order_acq_rel))
+		{
+			std::lock_guard<std::mutex> lock(shard.wakeupMutex);
+			if (shard.wakeupHostPeer)
+			{
+				shard.wakeupHostPeer->Send(0, Nz::ENetPacketFlag_Unsequenced, Nz::NetPacket(0));
+				shard.wakeupHost.Flush();
+			}
 		}
 	}
 }
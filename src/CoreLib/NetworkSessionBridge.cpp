@@ -41,4 +41,24 @@ namespace bw
 		packet.FlushBits();
 		m_reactor.SendData(m_peerId, channelId, flags, std::move(packet));
 	}
+
+	void NetworkSessionBridge::SendPacketBatch(OutgoingPacket* packets, std::size_t packetCount)
+	{
+		// Reused between calls to prevent allocations
+		thread_local std::vector<NetworkReactor::OutgoingPacket> reactorPackets;
+		reactorPackets.resize(packetCount);
+
+		for (std::size_t i = 0; i < packetCount; ++i)
+		{
+			packets[i].packet.FlushBits();
+
+			auto& reactorPacket = reactorPackets[i];
+			reactorPacket.channelId = packets[i].channelId;
+			reactorPacket.flags = packets[i].flags;
+			reactorPacket.packet = std::move(packets[i].packet);
+			reactorPacket.peerId = m_peerId;
+		}
+
+		m_reactor.SendDataBatch(reactorPackets.data(), packetCount);
+	}
 }
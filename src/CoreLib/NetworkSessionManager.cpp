@@ -11,14 +11,32 @@
 
 namespace bw
 {
-	NetworkSessionManager::NetworkSessionManager(MatchSessions* owner, Nz::UInt16 port, std::size_t maxClient) :
+	NetworkSessionManager::NetworkSessionManager(MatchSessions* owner, Nz::UInt16 port, std::size_t maxClient, std::size_t threadCount) :
 	SessionManager(owner),
-	m_reactor(0, Nz::NetProtocol_Any, port, maxClient)
+	m_reactor(0, Nz::NetProtocol_Any, port, maxClient, threadCount, &owner->GetMatch().GetPacketPool())
 	{
 	}
 
 	NetworkSessionManager::~NetworkSessionManager() = default;
 
+	void NetworkSessionManager::BroadcastPacket(MatchClientSession* const* sessions, std::size_t sessionCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet)
+	{
+		m_broadcastPeerIds.clear();
+		for (std::size_t i = 0; i < sessionCount; ++i)
+		{
+			// Sessions of this manager are always backed by a NetworkSessionBridge
+			const NetworkSessionBridge& bridge = static_cast<const NetworkSessionBridge&>(sessions[i]->GetSessionBridge());
+			m_broadcastPeerIds.push_back(bridge.GetPeerId());
+		}
+
+		m_reactor.BroadcastData(m_broadcastPeerIds.data(), m_broadcastPeerIds.size(), channelId, flags, packet);
+	}
+
+	const NetworkReactor* NetworkSessionManager::GetNetworkReactor() const
+	{
+		return &m_reactor;
+	}
+
 	void NetworkSessionManager::Poll()
 	{
 		m_reactor.Poll([&](bool outgoing, std::size_t peerId, Nz::UInt32 data) { HandlePeerConnection(outgoing, peerId, data); },
@@ -32,7 +50,7 @@ namespace bw
 
 		std::shared_ptr<NetworkSessionBridge> clientBridge = std::make_shared<NetworkSessionBridge>(m_reactor, peerId);
 
-		MatchClientSession* session = GetOwner()->CreateSession(std::move(clientBridge));
+		MatchClientSession* session = GetOwner()->CreateSession(this, std::move(clientBridge));
 
 		if (peerId >= m_peerIdToSession.size())
 			m_peerIdToSession.resize(peerId + 1);
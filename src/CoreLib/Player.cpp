@@ -28,6 +28,7 @@
 #include <CoreLib/Components/ScriptComponent.hpp>
 #include <CoreLib/Components/WeaponComponent.hpp>
 #include <CoreLib/Scripting/ServerGamemode.hpp>
+#include <CoreLib/Systems/NetworkSyncSystem.hpp>
 
 namespace bw
 {
@@ -307,6 +308,9 @@ namespace bw
 		m_match.GetGamemode()->ExecuteCallback<GamemodeEvent::PlayerNameUpdate>(CreateHandle(), newName);
 		m_name = std::move(newName);
 
+		if (m_playerEntity)
+			m_playerEntity->GetWorld()->GetSystem<NetworkSyncSystem>().NotifyNameUpdate(m_playerEntity);
+
 		Packets::PlayerNameUpdate nameUpdatePacket;
 		nameUpdatePacket.newName = m_name;
 		nameUpdatePacket.playerIndex = Nz::UInt16(m_playerIndex);
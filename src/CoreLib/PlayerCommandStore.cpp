@@ -26,6 +26,7 @@ namespace bw
 		IncomingCommand(PlayerSelectWeapon);
 		IncomingCommand(Ready);
 		IncomingCommand(ScriptPacket);
+		IncomingCommand(UpdateCameraRect);
 		IncomingCommand(UpdatePlayerName);
 
 		// Outgoing commands
@@ -49,9 +50,11 @@ namespace bw
 		OutgoingCommand(EntityWeapon,                 Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(HealthUpdate,                 Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(InputTimingCorrection,        Nz::ENetPacketFlag_Unsequenced, 0);
+		OutgoingCommand(LayerActivated,               Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(MatchData,                    Nz::ENetPacketFlag_Reliable,    0);
 		OutgoingCommand(MatchState,                   0,                              1);
 		OutgoingCommand(NetworkStrings,               Nz::ENetPacketFlag_Reliable,    0);
+		OutgoingCommand(PacketFrame,                  Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(PlayerJoined,                 Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(PlayerLayer,                  Nz::ENetPacketFlag_Reliable,    1);
 		OutgoingCommand(PlayerLeaving,                Nz::ENetPacketFlag_Reliable,    1);
@@ -9,42 +9,121 @@
 #include <Nazara/Math/Vector4.hpp>
 #include <CoreLib/Utils.hpp>
 #include <cassert>
+#include <climits>
+#include <cmath>
 
 namespace bw
 {
 	namespace Packets
 	{
-		std::size_t EstimateSize(const MatchState& matchState)
+		namespace
 		{
-			std::size_t size = 0;
-			
-			size += sizeof(MatchState::lastInputTick);
-			size += sizeof(MatchState::stateTick);
-
-			size += sizeof(Nz::UInt8); // layer count
-			size += (sizeof(MatchState::Layer::layerIndex) + sizeof(MatchState::Layer::entityCount)) * matchState.layers.size();
+			template<typename T>
+			Nz::UInt32 SerializeLayers(PacketSerializer& serializer, std::vector<T>& layers)
+			{
+				Nz::UInt32 entityCount = 0;
 
-			// entity property bit size (2 bits per entity), rounded up
-			size += (matchState.entities.size() * 2 + 7) / 8;
+				serializer.SerializeArraySize(layers);
+				for (auto& layer : layers)
+				{
+					serializer &= layer.layerIndex;
+					serializer &= layer.entityCount;
 
-			size += (sizeof(MatchState::Entity::id) + sizeof(MatchState::Entity::position) + sizeof(MatchState::Entity::rotation)) * matchState.entities.size();
+					entityCount += layer.entityCount;
+				}
 
-			std::size_t playerEntity = 0;
-			std::size_t physicalEntity = 0;
+				return entityCount;
+			}
 
-			for (auto& entity : matchState.entities)
+			void SerializeInputs(PacketSerializer& serializer, std::vector<std::optional<PlayerInputData>>& inputs)
 			{
-				if (entity.playerMovement)
-					playerEntity++;
+				for (auto& input : inputs)
+				{
+					bool hasInput;
+					if (serializer.IsWriting())
+						hasInput = input.has_value();
 
-				if (entity.physicsProperties)
-					physicalEntity++;
+					serializer &= hasInput;
+
+					if (!serializer.IsWriting() && hasInput)
+						input.emplace();
+				}
+
+				for (auto& input : inputs)
+				{
+					if (!input.has_value())
+						continue;
+
+					Serialize(serializer, *input);
+				}
 			}
+		}
+
+		void AddEntitySize(MatchStateEntitiesSize& entitiesSize, const MatchState::Entity& entity)
+		{
+			// Mirrors Serialize(PacketSerializer&, MatchState&)
+			bool hasBaseline = (entity.baselineAge != 0);
+			bool hasPhysicsProps = entity.physicsProperties.has_value();
+
+			entitiesSize.flagCount += 3;
+			if (hasBaseline)
+				entitiesSize.flagCount += (hasPhysicsProps) ? 3 : 2;
+
+			if (entity.playerMovement)
+				entitiesSize.flagCount++;
+
+			entitiesSize.idSize += SerializedSize(entity.id);
+
+			if (hasBaseline)
+				entitiesSize.stateBitCount += MatchState::BaselineAgeBitCount;
+
+			if (!hasBaseline || entity.positionChanged)
+				entitiesSize.stateBitCount += 2 * MatchState::PositionQuantization.bitCount;
+
+			if (!hasBaseline || entity.rotationChanged)
+				entitiesSize.stateBitCount += MatchState::RotationQuantization.bitCount;
+
+			if (hasPhysicsProps && (!hasBaseline || entity.physicsChanged))
+				entitiesSize.stateBitCount += MatchState::AngularVelocityQuantization.bitCount + 2 * MatchState::LinearVelocityQuantization.bitCount;
+		}
+
+		std::size_t ComputeSize(const MatchState& packet, const MatchStateEntitiesSize& entitiesSize)
+		{
+			// Header and layers are small enough to be computed again
+			PacketSerializer serializer;
+			serializer &= static_cast<Nz::UInt8>(MatchState::Type);
+			serializer &= packet.lastInputTick;
+			serializer &= packet.stateTick;
+
+			serializer.SerializeArraySize(packet.layers);
+			for (const auto& layer : packet.layers)
+			{
+				serializer &= layer.layerIndex;
+				serializer &= layer.entityCount;
+			}
+
+			// Entity flags are packed by eight, states are bit-packed
+			return serializer.GetComputedSize() + (entitiesSize.flagCount + CHAR_BIT - 1) / CHAR_BIT + entitiesSize.idSize + (entitiesSize.stateBitCount + CHAR_BIT - 1) / CHAR_BIT;
+		}
 
-			size += (playerEntity + 7) / 8; // one bit per player entity, rounded up
-			size += (sizeof(MatchState::PhysicsProperties::angularVelocity) + sizeof(MatchState::PhysicsProperties::linearVelocity)) * physicalEntity;
+		MatchState::EntityState QuantizeState(const MatchState::Entity& entity)
+		{
+			MatchState::EntityState state;
+			state.position[0] = MatchState::PositionQuantization.Quantize(entity.position.x);
+			state.position[1] = MatchState::PositionQuantization.Quantize(entity.position.y);
+			state.rotation = MatchState::RotationQuantization.Quantize(std::remainder(entity.rotation.value, float(2.0 * M_PI)));
+
+			if (entity.physicsProperties)
+			{
+				auto& physicsProperties = entity.physicsProperties.value();
+
+				auto& physicsState = state.physics.emplace();
+				physicsState[0] = MatchState::AngularVelocityQuantization.Quantize(physicsProperties.angularVelocity.value);
+				physicsState[1] = MatchState::LinearVelocityQuantization.Quantize(physicsProperties.linearVelocity.x);
+				physicsState[2] = MatchState::LinearVelocityQuantization.Quantize(physicsProperties.linearVelocity.y);
+			}
 
-			return size;
+			return state;
 		}
 
 		void Serialize(PacketSerializer& serializer, Auth& data)
@@ -118,29 +197,18 @@ namespace bw
 
 		void Serialize(PacketSerializer& serializer, CreateEntities& data)
 		{
-			serializer &= data.stateTick;
-
-			Nz::UInt32 entityCount = 0;
-
-			serializer.SerializeArraySize(data.layers);
-			for (auto& layer : data.layers)
-			{
-				serializer &= layer.layerIndex;
-				serializer &= layer.entityCount;
-
-				entityCount += layer.entityCount;
-			}
+			Nz::UInt32 entityCount = SerializeHeader(serializer, data);
 
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
-			{
-				serializer &= entity.id;
-				Serialize(serializer, entity.data);
-			}
+				SerializeRecord(serializer, entity);
 		}
 
 		void Serialize(PacketSerializer& serializer, ControlEntity& data)
@@ -169,7 +237,10 @@ namespace bw
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
 			{
@@ -190,24 +261,23 @@ namespace bw
 
 		void Serialize(PacketSerializer& serializer, DownloadClientScriptResponse& data)
 		{
-			serializer.SerializeArraySize(data.fileContent);
-			if (serializer.IsWriting())
-				serializer.Write(data.fileContent.data(), data.fileContent.size());
-			else
-				serializer.Read(data.fileContent.data(), data.fileContent.size());
+			serializer &= data.fileContent;
 		}
 
 		void Serialize(PacketSerializer& serializer, EnableLayer& data)
 		{
-			serializer &= data.stateTick;
-			serializer &= data.layerIndex;
+			Nz::UInt32 entityCount = SerializeHeader(serializer, data);
 
-			serializer.SerializeArraySize(data.layerEntities);
-			for (auto& entity : data.layerEntities)
+			if (serializer.IsWriting())
+				assert(data.layerEntities.size() == entityCount);
+			else
 			{
-				serializer &= entity.id;
-				Serialize(serializer, entity.data);
+				serializer.CheckArraySize(entityCount);
+				data.layerEntities.resize(entityCount);
 			}
+
+			for (auto& entity : data.layerEntities)
+				SerializeRecord(serializer, entity);
 		}
 
 		void Serialize(PacketSerializer& serializer, EntitiesAnimation& data)
@@ -228,7 +298,10 @@ namespace bw
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
 			{
@@ -255,7 +328,10 @@ namespace bw
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
 			{
@@ -265,82 +341,40 @@ namespace bw
 
 		void Serialize(PacketSerializer& serializer, EntitiesInputs& data)
 		{
-			serializer &= data.stateTick;
-
-			Nz::UInt32 entityCount = 0;
-
-			serializer.SerializeArraySize(data.layers);
-			for (auto& layer : data.layers)
-			{
-				serializer &= layer.layerIndex;
-				serializer &= layer.entityCount;
-
-				entityCount += layer.entityCount;
-			}
+			Nz::UInt32 entityCount = SerializeHeader(serializer, data);
 
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
-			{
-				serializer &= entity.id;
-				Serialize(serializer, entity.inputs);
-			}
+				SerializeRecord(serializer, entity);
 		}
 
 		void Serialize(PacketSerializer& serializer, EntitiesScale& data)
 		{
-			Nz::UInt32 entityCount = 0;
-
-			serializer.SerializeArraySize(data.layers);
-			for (auto& layer : data.layers)
-			{
-				serializer &= layer.layerIndex;
-				serializer &= layer.entityCount;
-
-				entityCount += layer.entityCount;
-			}
+			Nz::UInt32 entityCount = SerializeHeader(serializer, data);
 
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
-			{
-				serializer &= entity.id;
-				serializer &= entity.newScale;
-			}
+				SerializeRecord(serializer, entity);
 		}
 
 		void Serialize(PacketSerializer& serializer, EntityPhysics& data)
 		{
-			Serialize(serializer, data.entityId);
-			serializer &= data.stateTick;
-			serializer &= data.asleep;
-			serializer &= data.mass;
-			serializer &= data.momentOfInertia;
-
-			bool hasPlayerMovement;
-			if (serializer.IsWriting())
-				hasPlayerMovement = data.playerMovement.has_value();
-
-			serializer &= hasPlayerMovement;
-			if (!serializer.IsWriting())
-			{
-				if (hasPlayerMovement)
-					data.playerMovement.emplace();
-			}
-
-			if (data.playerMovement.has_value())
-			{
-				auto& playerMovement = data.playerMovement.value();
-				serializer &= playerMovement.jumpHeight;
-				serializer &= playerMovement.jumpHeightBoost;
-				serializer &= playerMovement.movementSpeed;
-			}
+			SerializeHeader(serializer, data);
+			SerializeRecord(serializer, data);
 		}
 
 		void Serialize(PacketSerializer& serializer, EntityWeapon& data)
@@ -352,29 +386,18 @@ namespace bw
 
 		void Serialize(PacketSerializer& serializer, HealthUpdate& data)
 		{
-			serializer &= data.stateTick;
-
-			Nz::UInt32 entityCount = 0;
-
-			serializer.SerializeArraySize(data.layers);
-			for (auto& layer : data.layers)
-			{
-				serializer &= layer.layerIndex;
-				serializer &= layer.entityCount;
-
-				entityCount += layer.entityCount;
-			}
+			Nz::UInt32 entityCount = SerializeHeader(serializer, data);
 
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
-			{
-				serializer &= entity.id;
-				serializer &= entity.currentHealth;
-			}
+				SerializeRecord(serializer, entity);
 		}
 
 		void Serialize(PacketSerializer& serializer, InputTimingCorrection& data)
@@ -383,6 +406,12 @@ namespace bw
 			serializer &= data.tickError;
 		}
 
+		void Serialize(PacketSerializer& serializer, LayerActivated& data)
+		{
+			serializer &= data.stateTick;
+			serializer &= data.layerIndex;
+		}
+
 		void Serialize(PacketSerializer& serializer, MatchData& data)
 		{
 			serializer &= data.currentTick;
@@ -429,8 +458,6 @@ namespace bw
 
 		void Serialize(PacketSerializer& serializer, MatchState& data)
 		{
-			// Don't forget to update EstimateSize(const MatchState&)
-
 			serializer &= data.lastInputTick;
 			serializer &= data.stateTick;
 
@@ -448,20 +475,26 @@ namespace bw
 			if (serializer.IsWriting())
 				assert(data.entities.size() == entityCount);
 			else
+			{
+				serializer.CheckArraySize(entityCount);
 				data.entities.resize(entityCount);
+			}
 
 			for (auto& entity : data.entities)
 			{
+				bool hasBaseline;
 				bool hasMovementData;
 				bool hasPhysicsProps;
 				if (serializer.IsWriting())
 				{
+					hasBaseline = (entity.baselineAge != 0);
 					hasMovementData = entity.playerMovement.has_value();
 					hasPhysicsProps = entity.physicsProperties.has_value();
 				}
 
 				serializer &= hasMovementData;
 				serializer &= hasPhysicsProps;
+				serializer &= hasBaseline;
 
 				if (!serializer.IsWriting())
 				{
@@ -470,6 +503,18 @@ namespace bw
 
 					if (hasPhysicsProps)
 						entity.physicsProperties.emplace();
+
+					// Actual age is read with the states, it only needs to be non-zero until then
+					entity.baselineAge = (hasBaseline) ? 1 : 0;
+				}
+
+				if (hasBaseline)
+				{
+					serializer &= entity.positionChanged;
+					serializer &= entity.rotationChanged;
+
+					if (hasPhysicsProps)
+						serializer &= entity.physicsChanged;
 				}
 
 				if (entity.playerMovement)
@@ -480,18 +525,49 @@ namespace bw
 			}
 
 			for (auto& entity : data.entities)
-			{
 				serializer &= entity.id;
-				serializer &= entity.position;
-				serializer &= entity.rotation;
 
-				if (entity.physicsProperties)
+			auto SerializeAngle = [&](Nz::RadianAnglef& angle, const FixedPointQuantization& quantization)
+			{
+				float value;
+				if (serializer.IsWriting())
+					value = std::remainder(angle.value, float(2.0 * M_PI)); //< [-pi, pi]
+
+				serializer.SerializeQuantized(value, quantization);
+
+				if (!serializer.IsWriting())
+					angle.value = value;
+			};
+
+			for (auto& entity : data.entities)
+			{
+				// Fields left unchanged since the baseline state are elided
+				bool hasBaseline = (entity.baselineAge != 0);
+				if (hasBaseline)
+				{
+					assert(entity.baselineAge <= MatchState::MaxBaselineAge);
+					serializer.SerializeBits(entity.baselineAge, MatchState::BaselineAgeBitCount);
+				}
+
+				if (!hasBaseline || entity.positionChanged)
+				{
+					serializer.SerializeQuantized(entity.position.x, MatchState::PositionQuantization);
+					serializer.SerializeQuantized(entity.position.y, MatchState::PositionQuantization);
+				}
+
+				if (!hasBaseline || entity.rotationChanged)
+					SerializeAngle(entity.rotation, MatchState::RotationQuantization);
+
+				if (entity.physicsProperties && (!hasBaseline || entity.physicsChanged))
 				{
 					auto& physicsProperties = entity.physicsProperties.value();
-					serializer &= physicsProperties.angularVelocity;
-					serializer &= physicsProperties.linearVelocity;
+					serializer.SerializeQuantized(physicsProperties.angularVelocity.value, MatchState::AngularVelocityQuantization);
+					serializer.SerializeQuantized(physicsProperties.linearVelocity.x, MatchState::LinearVelocityQuantization);
+					serializer.SerializeQuantized(physicsProperties.linearVelocity.y, MatchState::LinearVelocityQuantization);
 				}
 			}
+
+			serializer.FlushBits();
 		}
 
 		void Serialize(PacketSerializer& serializer, NetworkStrings& data)
@@ -503,6 +579,10 @@ namespace bw
 				serializer &= string;
 		}
 
+		void Serialize(PacketSerializer& /*serializer*/, PacketFrame& /*data*/)
+		{
+		}
+
 		void Serialize(PacketSerializer& serializer, PlayerChat& data)
 		{
 			serializer &= data.localIndex;
@@ -556,26 +636,34 @@ namespace bw
 			serializer &= data.estimatedServerTick;
 			serializer &= data.inputTick;
 
-			serializer.SerializeArraySize(data.inputs);
+			bool hasStateAck;
+			if (serializer.IsWriting())
+				hasStateAck = data.lastStateTick.has_value();
 
-			for (auto& input : data.inputs)
-			{
-				bool hasInput;
-				if (serializer.IsWriting())
-					hasInput = input.has_value();
+			serializer &= hasStateAck;
 
-				serializer &= hasInput;
+			if (hasStateAck)
+			{
+				if (!serializer.IsWriting())
+					data.lastStateTick.emplace();
 
-				if (!serializer.IsWriting() && hasInput)
-					input.emplace();
+				serializer &= data.lastStateTick.value();
+				serializer &= data.previousStateBits;
 			}
 
-			for (auto& input : data.inputs)
+			serializer.SerializeArraySize(data.inputs);
+			SerializeInputs(serializer, data.inputs);
+
+			// Previous inputs have the same player count
+			serializer.SerializeArraySize(data.previousInputs);
+			for (auto& previousInputs : data.previousInputs)
 			{
-				if (!input.has_value())
-					continue;
+				serializer &= previousInputs.tickDelta;
 
-				Serialize(serializer, *input);
+				if (!serializer.IsWriting())
+					previousInputs.inputs.resize(data.inputs.size());
+
+				SerializeInputs(serializer, previousInputs.inputs);
 			}
 		}
 
@@ -600,12 +688,13 @@ namespace bw
 		void Serialize(PacketSerializer& serializer, ScriptPacket& data)
 		{
 			serializer &= data.nameIndex;
-			
-			serializer.SerializeArraySize(data.content);
-			if (serializer.IsWriting())
-				serializer.Write(data.content.data(), data.content.size());
-			else
-				serializer.Read(data.content.data(), data.content.size());
+			serializer &= data.content;
+		}
+
+		void Serialize(PacketSerializer& serializer, UpdateCameraRect& data)
+		{
+			serializer &= data.position;
+			serializer &= data.size;
 		}
 
 		void Serialize(PacketSerializer& serializer, UpdatePlayerName& data)
@@ -614,6 +703,103 @@ namespace bw
 			serializer &= data.newName;
 		}
 
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, CreateEntities& data)
+		{
+			serializer &= data.stateTick;
+
+			return SerializeLayers(serializer, data.layers);
+		}
+
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EnableLayer& data)
+		{
+			serializer &= data.stateTick;
+			serializer &= data.layerIndex;
+			serializer &= data.entityCount;
+
+			return data.entityCount;
+		}
+
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EntitiesInputs& data)
+		{
+			serializer &= data.stateTick;
+
+			return SerializeLayers(serializer, data.layers);
+		}
+
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, EntitiesScale& data)
+		{
+			return SerializeLayers(serializer, data.layers);
+		}
+
+		void SerializeHeader(PacketSerializer& serializer, EntityPhysics& data)
+		{
+			Serialize(serializer, data.entityId);
+			serializer &= data.stateTick;
+		}
+
+		Nz::UInt32 SerializeHeader(PacketSerializer& serializer, HealthUpdate& data)
+		{
+			serializer &= data.stateTick;
+
+			return SerializeLayers(serializer, data.layers);
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, CreateEntities::Entity& data)
+		{
+			serializer &= data.id;
+			Serialize(serializer, data.data);
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, EnableLayer::Entity& data)
+		{
+			serializer &= data.id;
+			Serialize(serializer, data.data);
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, EntitiesInputs::Entity& data)
+		{
+			serializer &= data.id;
+			Serialize(serializer, data.inputs);
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, EntitiesScale::Entity& data)
+		{
+			serializer &= data.id;
+			serializer &= data.newScale;
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, EntityPhysics& data)
+		{
+			serializer &= data.asleep;
+			serializer &= data.mass;
+			serializer &= data.momentOfInertia;
+
+			bool hasPlayerMovement;
+			if (serializer.IsWriting())
+				hasPlayerMovement = data.playerMovement.has_value();
+
+			serializer &= hasPlayerMovement;
+			if (!serializer.IsWriting())
+			{
+				if (hasPlayerMovement)
+					data.playerMovement.emplace();
+			}
+
+			if (data.playerMovement.has_value())
+			{
+				auto& playerMovement = data.playerMovement.value();
+				serializer &= playerMovement.jumpHeight;
+				serializer &= playerMovement.jumpHeightBoost;
+				serializer &= playerMovement.movementSpeed;
+			}
+		}
+
+		void SerializeRecord(PacketSerializer& serializer, HealthUpdate::Entity& data)
+		{
+			serializer &= data.id;
+			serializer &= data.currentHealth;
+		}
+
 		void Serialize(PacketSerializer& serializer, PlayerInputData& input)
 		{
 			serializer &= input.isAttacking;
@@ -785,6 +971,7 @@ namespace bw
 					{
 						CompressedUnsigned<Nz::UInt32> size;
 						serializer &= size;
+						serializer.CheckArraySize(size);
 
 						auto& elements = data.value.emplace<PropertyArrayValue<Property>>(size);
 						for (auto& element : elements)
@@ -149,7 +149,10 @@ namespace bw
 
 			entity->GetComponent<Ndk::NodeComponent>().SetParent(parent, true);
 			if (entity->HasComponent<NetworkSyncComponent>())
+			{
 				entity->GetComponent<NetworkSyncComponent>().UpdateParent(parent);
+				entity->GetWorld()->GetSystem<NetworkSyncSystem>().NotifyParentUpdate(entity);
+			}
 		});
 	}
 
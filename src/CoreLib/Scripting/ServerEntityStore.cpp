@@ -77,6 +77,8 @@ namespace bw
 				entity->AddComponent<NetworkSyncComponent>(entityClass->fullName, parent);
 			else
 				entity->AddComponent<NetworkSyncComponent>(entityClass->fullName);
+
+			entity->GetComponent<NetworkSyncComponent>().UpdatePriority(entityClass->networkPriority);
 		}
 
 		if (playerControlled)
@@ -122,5 +124,6 @@ namespace bw
 
 		element.isNetworked = elementTable.get_or("IsNetworked", false);
 		element.maxHealth = elementTable.get_or("MaxHealth", Nz::UInt16(0));
+		element.networkPriority = elementTable.get_or("NetworkPriority", NetworkSyncComponent::DefaultPriority);
 	}
 }
@@ -300,6 +300,54 @@ namespace bw
 	{
 		SharedScriptingLibrary::RegisterNetworkLibrary(context, library);
 
+		library["GetStats"] = LuaFunction([&](sol::this_state L) -> sol::table
+		{
+			sol::state_view lua(L);
+
+			sol::table reactorTable = lua.create_table();
+
+			std::size_t index = 1;
+			GetMatch().GetSessions().ForEachNetworkReactor([&](const NetworkReactor& reactor)
+			{
+				NetworkReactor::Stats stats = reactor.GetStats();
+
+				sol::table channelTable = lua.create_table();
+				for (std::size_t i = 0; i < stats.channels.size(); ++i)
+				{
+					channelTable[i + 1] = lua.create_table_with(
+						"ByteCount", stats.channels[i].byteCount,
+						"PacketCount", stats.channels[i].packetCount);
+				}
+
+				// Round-trip times are indexed by their bucket upper bound (in milliseconds), the last bucket being indexed by math.huge
+				sol::table roundTripTable = lua.create_table();
+				for (std::size_t i = 0; i < stats.roundTripTimes.size(); ++i)
+				{
+					if (i < NetworkReactor::RoundTripTimeBounds.size())
+						roundTripTable[NetworkReactor::RoundTripTimeBounds[i]] = stats.roundTripTimes[i];
+					else
+						roundTripTable[std::numeric_limits<double>::infinity()] = stats.roundTripTimes[i];
+				}
+
+				sol::table statsTable = lua.create_table();
+				statsTable["BacklogSize"] = stats.backlogSize;
+				statsTable["Channels"] = channelTable;
+				statsTable["IncomingQueueSize"] = stats.incomingQueueSize;
+				statsTable["OutgoingQueueSize"] = stats.outgoingQueueSize;
+				statsTable["PeerCount"] = stats.peerCount;
+				statsTable["RoundTripTimes"] = roundTripTable;
+				statsTable["SendLatencyAverage"] = stats.sendLatency.averageTime;
+				statsTable["SendLatencyMax"] = stats.sendLatency.maxTime;
+				statsTable["SendTime"] = stats.sendTime;
+				statsTable["SentPacketCount"] = stats.sendLatency.packetCount;
+				statsTable["ServiceTime"] = stats.serviceTime;
+
+				reactorTable[index++] = statsTable;
+			});
+
+			return reactorTable;
+		});
+
 		library["RegisterPacket"] = LuaFunction([&](std::string packetName)
 		{
 			GetMatch().RegisterNetworkString(std::move(packetName));
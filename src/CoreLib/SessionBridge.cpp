@@ -28,4 +28,10 @@ namespace bw
 
 		OnIncomingPacket(packet);
 	}
+
+	void SessionBridge::SendPacketBatch(OutgoingPacket* packets, std::size_t packetCount)
+	{
+		for (std::size_t i = 0; i < packetCount; ++i)
+			SendPacket(packets[i].channelId, packets[i].flags, std::move(packets[i].packet));
+	}
 }
@@ -3,8 +3,34 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/SessionManager.hpp>
+#include <CoreLib/Match.hpp>
+#include <CoreLib/MatchClientSession.hpp>
+#include <CoreLib/MatchSessions.hpp>
+#include <CoreLib/NetPacketPool.hpp>
 
 namespace bw
 {
 	SessionManager::~SessionManager() = default;
+
+	void SessionManager::BroadcastPacket(MatchClientSession* const* sessions, std::size_t sessionCount, Nz::UInt8 channelId, Nz::ENetPacketFlags flags, const Nz::NetPacket& packet)
+	{
+		NetPacketPool& packetPool = m_owner->GetMatch().GetPacketPool();
+
+		const Nz::UInt8* payload = packet.GetConstData() + Nz::NetPacket::HeaderSize;
+		std::size_t payloadSize = packet.GetDataSize() - Nz::NetPacket::HeaderSize;
+
+		// Every session consumes its own packet, only copy the serialized bytes
+		for (std::size_t i = 0; i < sessionCount; ++i)
+		{
+			Nz::NetPacket sessionPacket = packetPool.Acquire(packet.GetNetCode());
+			sessionPacket.Write(payload, payloadSize);
+
+			sessions[i]->SendPacket(channelId, flags, std::move(sessionPacket));
+		}
+	}
+
+	const NetworkReactor* SessionManager::GetNetworkReactor() const
+	{
+		return nullptr;
+	}
 }
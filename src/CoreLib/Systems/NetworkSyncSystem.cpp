@@ -3,6 +3,7 @@
 // For conditions of distribution and use, see copyright notice in LICENSE
 
 #include <CoreLib/Systems/NetworkSyncSystem.hpp>
+#include <Nazara/Math/Algorithm.hpp>
 #include <NDK/Components.hpp>
 #include <CoreLib/Match.hpp>
 #include <CoreLib/TerrainLayer.hpp>
@@ -12,47 +13,54 @@
 #include <CoreLib/Components/PlayerControlledComponent.hpp>
 #include <CoreLib/Components/PlayerMovementComponent.hpp>
 #include <CoreLib/Components/ScriptComponent.hpp>
+#include <CoreLib/Protocol/Packets.hpp>
 #include <CoreLib/Utils.hpp>
+#include <algorithm>
 
 namespace bw
 {
 	NetworkSyncSystem::NetworkSyncSystem(TerrainLayer& layer) :
-	m_layer(layer)
+	m_rootGrid(RootGridCellSize),
+	m_layer(layer),
+	m_journalStart(0)
 	{
 		Requires<NetworkSyncComponent, Ndk::NodeComponent>();
 		SetMaximumUpdateRate(30.f);
 		SetUpdateOrder(100); //< Execute after every other system
 	}
 
-	void NetworkSyncSystem::CreateEntities(const std::function<void(const EntityCreation* entityCreation, std::size_t entityCount)>& callback) const
+	void NetworkSyncSystem::ClearJournal()
 	{
-		m_creationEvents.clear();
-
-		for (const Ndk::EntityHandle& entity : GetEntities())
-		{
-			EntityCreation& creationEvent = m_creationEvents.emplace_back();
-			BuildEvent(creationEvent, entity);
-		}
-
-		callback(m_creationEvents.data(), m_creationEvents.size());
+		m_journalStart += m_journal.size();
+
+		m_journal.clear();
+		m_journalCreations.clear();
+		m_journalDeaths.clear();
+		m_journalDestructions.clear();
+		m_journalInvalidations.clear();
+		m_journalPlayAnimations.clear();
 	}
 
 	void NetworkSyncSystem::DeleteEntities(const std::function<void(const EntityDestruction* entityDestruction, std::size_t entityCount)>& callback) const
 	{
-		m_destructionEvents.clear();
+		// Reused between calls to prevent allocations
+		thread_local std::vector<EntityDestruction> destructionEvents;
+		destructionEvents.clear();
 
 		for (const Ndk::EntityHandle& entity : GetEntities())
 		{
-			EntityDestruction& destructionEvent = m_destructionEvents.emplace_back();
+			EntityDestruction& destructionEvent = destructionEvents.emplace_back();
 			BuildEvent(destructionEvent, entity);
 		}
 
-		callback(m_destructionEvents.data(), m_destructionEvents.size());
+		callback(destructionEvents.data(), destructionEvents.size());
 	}
 
 	void NetworkSyncSystem::MoveEntities(const std::function<void(const EntityMovement* entityMovement, std::size_t entityCount)>& callback) const
 	{
-		m_movementEvents.clear();
+		// Reused between calls to prevent allocations
+		thread_local std::vector<EntityMovement> movementEvents;
+		movementEvents.clear();
 
 		for (const Ndk::EntityHandle& entity : m_physicsEntities)
 		{
@@ -60,10 +68,27 @@ namespace bw
 			if (entityPhys.IsSleeping())
 				continue;
 
-			BuildEvent(m_movementEvents.emplace_back(), entity);
+			BuildEvent(movementEvents.emplace_back(), entity);
 		}
 
-		callback(m_movementEvents.data(), m_movementEvents.size());
+		callback(movementEvents.data(), movementEvents.size());
+	}
+
+	void NetworkSyncSystem::NotifyNameUpdate(const Ndk::EntityHandle& entity)
+	{
+		m_snapshotUpdateEntities.Insert(entity);
+	}
+
+	void NetworkSyncSystem::NotifyParentUpdate(const Ndk::EntityHandle& entity)
+	{
+		m_snapshotUpdateEntities.Insert(entity);
+
+		// Entities not registered yet get their hierarchy when they are
+		if (!HasEntity(entity))
+			return;
+
+		RemoveFromHierarchy(entity->GetId());
+		AddToHierarchy(entity);
 	}
 
 	void NetworkSyncSystem::NotifyPhysicsUpdate(const Ndk::EntityHandle& entity)
@@ -75,6 +100,52 @@ namespace bw
 	void NetworkSyncSystem::NotifyScaleUpdate(const Ndk::EntityHandle& entity)
 	{
 		m_scaleUpdateEntities.Insert(entity);
+		m_snapshotUpdateEntities.Insert(entity);
+	}
+
+	void NetworkSyncSystem::RefreshSnapshots()
+	{
+		for (const Ndk::EntityHandle& entity : m_snapshotUpdateEntities)
+		{
+			EntitySnapshot& snapshot = m_entitySnapshots.Insert(entity->GetId(), EntitySnapshot());
+			BuildEvent(snapshot.creation, entity);
+
+			if (HasVolatileState(entity))
+				continue;
+
+			// Encoded once and copied as-is in the creation packet of every client
+			snapshot.record.Encode(1, [&](PacketSerializer& serializer, std::size_t /*recordIndex*/)
+			{
+				Packets::CreateEntities::Entity record;
+				record.id = static_cast<Nz::UInt32>(entity->GetId());
+				BuildEntityData(snapshot.creation, record.data);
+
+				Packets::SerializeRecord(serializer, record);
+			});
+		}
+		m_snapshotUpdateEntities.Clear();
+	}
+
+	void NetworkSyncSystem::WriteCreationRecord(Nz::ByteStream& stream, Ndk::EntityId entityId) const
+	{
+		const EntitySnapshot& snapshot = m_entitySnapshots.Get(entityId);
+		if (snapshot.record.GetRecordCount() > 0)
+		{
+			snapshot.record.WriteRecord(stream, 0);
+			return;
+		}
+
+		// Only the state changing every tick has to be retrieved from the entity
+		Packets::CreateEntities::Entity record;
+		record.id = static_cast<Nz::UInt32>(entityId);
+		BuildEntityData(snapshot.creation, record.data);
+		BuildEntityState(record.data, GetWorld().GetEntity(entityId));
+
+		PacketSerializer serializer(stream, true);
+		Packets::SerializeRecord(serializer, record);
+		serializer.FlushBits();
+
+		stream.FlushBits();
 	}
 
 	void NetworkSyncSystem::BuildEvent(EntityCreation& creationEvent, Ndk::Entity* entity) const
@@ -215,6 +286,7 @@ namespace bw
 	void NetworkSyncSystem::BuildEvent(EntityMovement& movementEvent, Ndk::Entity* entity) const
 	{
 		movementEvent.entityId = entity->GetId();
+		movementEvent.priority = entity->GetComponent<NetworkSyncComponent>().GetPriority();
 
 		if (entity->HasComponent<Ndk::PhysicsComponent2D>())
 		{
@@ -245,12 +317,145 @@ namespace bw
 		}
 	}
 
+	void NetworkSyncSystem::BuildEntityData(const EntityCreation& creationEvent, Packets::Helper::EntityData& entityData) const
+	{
+		const NetworkStringStore& networkStringStore = m_layer.GetMatch().GetNetworkStringStore();
+
+		assert(creationEvent.uniqueId > 0);
+
+		entityData.entityClass = networkStringStore.CheckStringIndex(creationEvent.entityClass);
+		entityData.uniqueId = static_cast<Nz::UInt64>(creationEvent.uniqueId);
+		entityData.position = creationEvent.position;
+		entityData.rotation = creationEvent.rotation;
+
+		if (!Nz::NumberEquals(creationEvent.scale, 1.f))
+			entityData.scale = creationEvent.scale;
+
+		if (creationEvent.inputs.has_value())
+			entityData.inputs = creationEvent.inputs.value();
+
+		if (creationEvent.parent.has_value())
+			entityData.parentId = creationEvent.parent.value();
+
+		if (creationEvent.healthProperties.has_value())
+		{
+			entityData.health.emplace();
+			entityData.health->currentHealth = creationEvent.healthProperties->currentHealth;
+			entityData.health->maxHealth = creationEvent.healthProperties->maxHealth;
+		}
+
+		if (!creationEvent.name.empty())
+			entityData.name = creationEvent.name;
+
+		if (creationEvent.playerMovement.has_value())
+		{
+			entityData.playerMovement.emplace();
+			entityData.playerMovement->isFacingRight = creationEvent.playerMovement->isFacingRight;
+		}
+
+		if (creationEvent.physicsProperties.has_value())
+		{
+			const auto& physicsProperties = *creationEvent.physicsProperties;
+
+			entityData.physicsProperties.emplace();
+			entityData.physicsProperties->angularVelocity = physicsProperties.angularVelocity;
+			entityData.physicsProperties->linearVelocity = physicsProperties.linearVelocity;
+			entityData.physicsProperties->isAsleep = physicsProperties.isSleeping;
+			entityData.physicsProperties->mass = physicsProperties.mass;
+			entityData.physicsProperties->momentOfInertia = physicsProperties.momentOfInertia;
+		}
+
+		for (auto&& [propertyName, propertyValue] : creationEvent.properties)
+		{
+			auto& propertyData = entityData.properties.emplace_back();
+			propertyData.name = networkStringStore.CheckStringIndex(propertyName);
+			propertyData.value = propertyValue;
+		}
+	}
+
+	void NetworkSyncSystem::BuildEntityState(Packets::Helper::EntityData& entityData, Ndk::Entity* entity) const
+	{
+		if (entity->HasComponent<InputComponent>())
+			entityData.inputs = entity->GetComponent<InputComponent>().GetInputs();
+
+		if (entity->HasComponent<Ndk::PhysicsComponent2D>())
+		{
+			auto& entityPhys = entity->GetComponent<Ndk::PhysicsComponent2D>();
+			entityData.position = entityPhys.GetPosition();
+			entityData.rotation = entityPhys.GetRotation();
+
+			entityData.physicsProperties.emplace();
+			entityData.physicsProperties->angularVelocity = entityPhys.GetAngularVelocity();
+			entityData.physicsProperties->linearVelocity = entityPhys.GetVelocity();
+			entityData.physicsProperties->isAsleep = entityPhys.IsSleeping();
+			entityData.physicsProperties->mass = entityPhys.GetMass();
+			entityData.physicsProperties->momentOfInertia = entityPhys.GetMomentOfInertia();
+		}
+		else
+		{
+			auto& entityNode = entity->GetComponent<Ndk::NodeComponent>();
+			entityData.position = Nz::Vector2f(entityNode.GetPosition(Nz::CoordSys_Local));
+			entityData.rotation = AngleFromQuaternion(entityNode.GetRotation(Nz::CoordSys_Local)); //< Erk
+		}
+
+		if (entity->HasComponent<PlayerMovementComponent>())
+		{
+			entityData.playerMovement.emplace();
+			entityData.playerMovement->isFacingRight = entity->GetComponent<PlayerMovementComponent>().IsFacingRight();
+		}
+	}
+
+	Nz::Vector2f NetworkSyncSystem::GetEntityPosition(Ndk::Entity* entity)
+	{
+		if (entity->HasComponent<Ndk::PhysicsComponent2D>())
+			return entity->GetComponent<Ndk::PhysicsComponent2D>().GetPosition();
+		else
+			return Nz::Vector2f(entity->GetComponent<Ndk::NodeComponent>().GetPosition(Nz::CoordSys_Global));
+	}
+
+	bool NetworkSyncSystem::HasVolatileState(Ndk::Entity* entity)
+	{
+		// Those components change the entity state every tick without notifying the system
+		return entity->HasComponent<Ndk::PhysicsComponent2D>() || entity->HasComponent<InputComponent>() || entity->HasComponent<PlayerMovementComponent>();
+	}
+
+	void NetworkSyncSystem::AddToHierarchy(Ndk::Entity* entity)
+	{
+		if (const Ndk::EntityHandle& parent = entity->GetComponent<NetworkSyncComponent>().GetParent())
+		{
+			m_entityParents[entity->GetId()] = parent->GetId();
+			m_entityChildren[parent->GetId()].push_back(entity->GetId());
+		}
+		else
+			m_rootGrid.Insert(entity->GetId(), GetEntityPosition(entity));
+	}
+
+	void NetworkSyncSystem::RemoveFromHierarchy(Ndk::EntityId entityId)
+	{
+		// Only detaches the entity from its parent (or the root grid), its own children stay attached to it
+		if (auto parentIt = m_entityParents.find(entityId); parentIt != m_entityParents.end())
+		{
+			auto siblingsIt = m_entityChildren.find(parentIt->second);
+			assert(siblingsIt != m_entityChildren.end());
+
+			auto& siblings = siblingsIt.value();
+			siblings.erase(std::find(siblings.begin(), siblings.end(), entityId));
+			if (siblings.empty())
+				m_entityChildren.erase(siblingsIt);
+
+			m_entityParents.erase(parentIt);
+		}
+		else if (m_rootGrid.GetPosition(entityId))
+			m_rootGrid.Remove(entityId);
+	}
+
 	void NetworkSyncSystem::OnEntityAdded(Ndk::Entity* entity)
 	{
-		EntityCreation creationEvent;
-		BuildEvent(creationEvent, entity);
+		// Register entity hierarchy before signaling its creation, as listeners may query it
+		AddToHierarchy(entity);
 
-		OnEntityCreated(this, creationEvent);
+		BuildEvent(m_journalCreations.emplace_back(), entity);
+		PushJournalEntry(JournalEventType::Creation, m_journalCreations.size() - 1);
 
 		assert(m_entitySlots.find(entity->GetId()) == m_entitySlots.end());
 		auto& slots = m_entitySlots.emplace(entity->GetId(), EntitySlots()).first.value();
@@ -262,10 +467,17 @@ namespace bw
 			m_staticEntities.Insert(entity);
 			slots.onInvalidated.Connect(entity->GetComponent<NetworkSyncComponent>().OnInvalidated, [&](NetworkSyncComponent* netSync)
 			{
-				EntityMovement movementEvent;
-				BuildEvent(movementEvent, netSync->GetEntity());
+				Ndk::Entity* staticEntity = netSync->GetEntity();
+
+				EntityMovement& movementEvent = m_journalInvalidations.emplace_back();
+				BuildEvent(movementEvent, staticEntity);
 
-				OnEntityInvalidated(this, movementEvent);
+				m_snapshotUpdateEntities.Insert(staticEntity);
+
+				if (m_entityParents.find(staticEntity->GetId()) == m_entityParents.end())
+					m_rootGrid.Move(staticEntity->GetId(), movementEvent.position);
+
+				PushJournalEntry(JournalEventType::Invalidation, m_journalInvalidations.size() - 1);
 			});
 		}
 
@@ -273,12 +485,12 @@ namespace bw
 		{
 			slots.onAnimationStart.Connect(entity->GetComponent<AnimationComponent>().OnAnimationStart, [&](AnimationComponent* anim)
 			{
-				EntityPlayAnimation event;
+				EntityPlayAnimation& event = m_journalPlayAnimations.emplace_back();
 				event.animId = anim->GetAnimId();
 				event.entityId = anim->GetEntity()->GetId();
 				event.startTime = anim->GetStartTime();
 
-				OnEntityPlayAnimation(this, event);
+				PushJournalEntry(JournalEventType::PlayAnimation, m_journalPlayAnimations.size() - 1);
 			});
 		}
 
@@ -288,15 +500,14 @@ namespace bw
 
 			slots.onDied.Connect(entityHealth.OnDied, [&](const HealthComponent* health, const Ndk::EntityHandle& /*attacker*/)
 			{
-				EntityDeath deathEvent;
-				BuildEvent(deathEvent, health->GetEntity());
-
-				OnEntityDeath(this, deathEvent);
+				BuildEvent(m_journalDeaths.emplace_back(), health->GetEntity());
+				PushJournalEntry(JournalEventType::Death, m_journalDeaths.size() - 1);
 			});
 
 			slots.onHealthChange.Connect(entityHealth.OnHealthChange, [&](HealthComponent* health, Nz::UInt16 /*newHealth*/, const Ndk::EntityHandle& /*dealer*/)
 			{
 				m_healthUpdateEntities.Insert(health->GetEntity());
+				m_snapshotUpdateEntities.Insert(health->GetEntity());
 			});
 		}
 
@@ -315,31 +526,67 @@ namespace bw
 			slots.onNewWeaponSelection.Connect(entityWeaponWielder.OnNewWeaponSelection, [&](WeaponWielderComponent* wielder, std::size_t /*newWeaponIndex*/)
 			{
 				m_weaponUpdateEntities.Insert(wielder->GetEntity());
+				m_snapshotUpdateEntities.Insert(wielder->GetEntity());
 			});
 		}
 	}
 
 	void NetworkSyncSystem::OnEntityRemoved(Ndk::Entity* entity)
 	{
-		EntityDestruction destructionEvent;
-		BuildEvent(destructionEvent, entity);
-
-		OnEntityDeleted(this, destructionEvent);
+		BuildEvent(m_journalDestructions.emplace_back(), entity);
+		PushJournalEntry(JournalEventType::Destruction, m_journalDestructions.size() - 1);
 
 		m_healthUpdateEntities.Remove(entity);
 		m_inputUpdateEntities.Remove(entity);
 		m_physicsEntities.Remove(entity);
 		m_physicsUpdateEntities.Remove(entity);
+		m_snapshotUpdateEntities.Remove(entity);
 		m_staticEntities.Remove(entity);
 		m_weaponUpdateEntities.Remove(entity);
 
+		m_entitySnapshots.Erase(entity->GetId());
+
 		auto it = m_entitySlots.find(entity->GetId());
 		assert(it != m_entitySlots.end());
 		m_entitySlots.erase(it);
+
+		Ndk::EntityId entityId = entity->GetId();
+		RemoveFromHierarchy(entityId);
+
+		// Remaining children become roots
+		if (auto childrenIt = m_entityChildren.find(entityId); childrenIt != m_entityChildren.end())
+		{
+			Ndk::World& world = GetWorld();
+			for (Ndk::EntityId childId : childrenIt->second)
+			{
+				m_entityParents.erase(childId);
+
+				// Children may be in the process of being destroyed along their parent
+				if (world.IsEntityIdValid(childId))
+					m_rootGrid.Insert(childId, GetEntityPosition(world.GetEntity(childId)));
+			}
+
+			m_entityChildren.erase(childrenIt);
+		}
+	}
+
+	void NetworkSyncSystem::OnEntityValidation(Ndk::Entity* entity, bool /*justAdded*/)
+	{
+		// Also triggered when components are added or removed, which may change the creation state
+		m_snapshotUpdateEntities.Insert(entity);
 	}
 
 	void NetworkSyncSystem::OnUpdate(float /*elapsedTime*/)
 	{
+		for (const Ndk::EntityHandle& entity : m_physicsEntities)
+		{
+			auto& entityPhys = entity->GetComponent<Ndk::PhysicsComponent2D>();
+			if (entityPhys.IsSleeping() || m_entityParents.find(entity->GetId()) != m_entityParents.end())
+				continue;
+
+			m_rootGrid.Move(entity->GetId(), entityPhys.GetPosition());
+		}
+
 		if (!m_healthUpdateEntities.empty())
 		{
 			m_healthEvents.clear();
@@ -352,7 +599,19 @@ namespace bw
 			}
 			m_healthUpdateEntities.Clear();
 
-			OnEntitiesHealthUpdate(this, m_healthEvents.data(), m_healthEvents.size());
+			// Records are encoded once for every client session, following event order
+			m_healthRecords.Encode(m_healthEvents.size(), [&](PacketSerializer& serializer, std::size_t eventIndex)
+			{
+				const EntityHealth& healthEvent = m_healthEvents[eventIndex];
+
+				Packets::HealthUpdate::Entity record;
+				record.id = static_cast<Nz::UInt32>(healthEvent.entityId);
+				record.currentHealth = healthEvent.currentHealth;
+
+				Packets::SerializeRecord(serializer, record);
+			});
+
+			PushJournalEntry(JournalEventType::HealthUpdate, 0, m_healthEvents.size());
 		}
 
 		if (!m_inputUpdateEntities.empty())
@@ -368,7 +627,18 @@ namespace bw
 
 			m_inputUpdateEntities.Clear();
 
-			OnEntitiesInputUpdate(this, m_inputEvents.data(), m_inputEvents.size());
+			m_inputRecords.Encode(m_inputEvents.size(), [&](PacketSerializer& serializer, std::size_t eventIndex)
+			{
+				const EntityInputs& inputEvent = m_inputEvents[eventIndex];
+
+				Packets::EntitiesInputs::Entity record;
+				record.id = static_cast<Nz::UInt32>(inputEvent.entityId);
+				record.inputs = inputEvent.inputs;
+
+				Packets::SerializeRecord(serializer, record);
+			});
+
+			PushJournalEntry(JournalEventType::InputUpdate, 0, m_inputEvents.size());
 		}
 
 		if (!m_physicsUpdateEntities.empty())
@@ -398,7 +668,27 @@ namespace bw
 
 			m_physicsUpdateEntities.Clear();
 
-			OnEntitiesPhysicsUpdate(this, m_physicsEvent.data(), m_physicsEvent.size());
+			m_physicsRecords.Encode(m_physicsEvent.size(), [&](PacketSerializer& serializer, std::size_t eventIndex)
+			{
+				const EntityPhysics& physicsEvent = m_physicsEvent[eventIndex];
+
+				Packets::EntityPhysics record;
+				record.asleep = physicsEvent.isAsleep;
+				record.mass = physicsEvent.mass;
+				record.momentOfInertia = physicsEvent.momentOfInertia;
+
+				if (physicsEvent.playerMovement)
+				{
+					auto& recordMovement = record.playerMovement.emplace();
+					recordMovement.jumpHeight = physicsEvent.playerMovement->jumpHeight;
+					recordMovement.jumpHeightBoost = physicsEvent.playerMovement->jumpHeightBoost;
+					recordMovement.movementSpeed = physicsEvent.playerMovement->movementSpeed;
+				}
+
+				Packets::SerializeRecord(serializer, record);
+			});
+
+			PushJournalEntry(JournalEventType::PhysicsUpdate, 0, m_physicsEvent.size());
 		}
 
 		if (!m_scaleUpdateEntities.empty())
@@ -416,7 +706,18 @@ namespace bw
 
 			m_scaleUpdateEntities.Clear();
 
-			OnEntitiesScaleUpdate(this, m_scaleEvent.data(), m_scaleEvent.size());
+			m_scaleRecords.Encode(m_scaleEvent.size(), [&](PacketSerializer& serializer, std::size_t eventIndex)
+			{
+				const EntityScale& scaleEvent = m_scaleEvent[eventIndex];
+
+				Packets::EntitiesScale::Entity record;
+				record.id = static_cast<Nz::UInt32>(scaleEvent.entityId);
+				record.newScale = scaleEvent.newScale;
+
+				Packets::SerializeRecord(serializer, record);
+			});
+
+			PushJournalEntry(JournalEventType::ScaleUpdate, 0, m_scaleEvent.size());
 		}
 
 		if (!m_weaponUpdateEntities.empty())
@@ -438,7 +739,7 @@ namespace bw
 
 			m_weaponUpdateEntities.Clear();
 
-			OnEntitiesWeaponUpdate(this, m_weaponEvents.data(), m_weaponEvents.size());
+			PushJournalEntry(JournalEventType::WeaponUpdate, 0, m_weaponEvents.size());
 		}
 	}
 
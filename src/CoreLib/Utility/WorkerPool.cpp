@@ -0,0 +1,122 @@
+// Copyright (C) 2020 Jérôme Leclercq
+// This file is part of the "Burgwar" project
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include <CoreLib/Utility/WorkerPool.hpp>
+#include <string>
+
+namespace bw
+{
+	WorkerPool::WorkerPool(std::size_t workerCount) :
+	m_nextIndex(0),
+	m_activeWorkerCount(0),
+	m_jobSize(0),
+	m_job(nullptr),
+	m_jobGeneration(0),
+	m_running(true)
+	{
+		m_workers.reserve(workerCount);
+		for (std::size_t i = 0; i < workerCount; ++i)
+		{
+			Nz::Thread& worker = m_workers.emplace_back([this]() { WorkerThread(); });
+			worker.SetName("WorkerPool #" + std::to_string(i));
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_running = false;
+		}
+		m_jobSignal.notify_all();
+
+		for (Nz::Thread& worker : m_workers)
+			worker.Join();
+	}
+
+	void WorkerPool::ForEach(std::size_t count, const std::function<void(std::size_t index)>& func)
+	{
+		if (count == 0)
+			return;
+
+		if (m_workers.empty() || count == 1)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+				func(i);
+
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_activeWorkerCount = m_workers.size();
+			m_exception = nullptr;
+			m_job = &func;
+			m_jobSize = count;
+			m_nextIndex.store(0, std::memory_order_relaxed);
+			m_jobGeneration++;
+		}
+		m_jobSignal.notify_all();
+
+		// Calling thread takes its share of the work instead of sleeping
+		ProcessJob();
+
+		std::exception_ptr exception;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_doneSignal.wait(lock, [&] { return m_activeWorkerCount == 0; });
+
+			m_job = nullptr;
+			exception = std::move(m_exception);
+		}
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+
+	void WorkerPool::ProcessJob()
+	{
+		for (;;)
+		{
+			std::size_t index = m_nextIndex.fetch_add(1, std::memory_order_relaxed);
+			if (index >= m_jobSize)
+				break;
+
+			try
+			{
+				(*m_job)(index);
+			}
+			catch (...)
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (!m_exception)
+					m_exception = std::current_exception();
+			}
+		}
+	}
+
+	void WorkerPool::WorkerThread()
+	{
+		Nz::UInt64 lastGeneration = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_jobSignal.wait(lock, [&] { return !m_running || m_jobGeneration != lastGeneration; });
+				if (!m_running)
+					return;
+
+				lastGeneration = m_jobGeneration;
+			}
+
+			ProcessJob();
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (--m_activeWorkerCount == 0)
+					m_doneSignal.notify_one();
+			}
+		}
+	}
+}
@@ -23,10 +23,17 @@ namespace bw
 		matchSettings.map = Map::LoadFromBinary(m_configFile.GetStringValue("GameSettings.MapFile"));
 		matchSettings.maxPlayerCount = 64;
 		matchSettings.name = "local";
+		matchSettings.sessionThreadCount = m_configFile.GetIntegerValue<std::size_t>("ServerSettings.SessionThreadCount");
 		matchSettings.tickDuration = 1.f / m_configFile.GetFloatValue<float>("GameSettings.TickRate");
 
 		m_match = std::make_unique<Match>(*this, std::move(matchSettings), std::move(gamemodeSettings));
-		m_match->GetSessions().CreateSessionManager<NetworkSessionManager>(Nz::UInt16(14768), 64);
+		std::size_t networkThreadCount = m_configFile.GetIntegerValue<std::size_t>("ServerSettings.NetworkThreadCount");
+
+		NetworkSessionManager* sessionManager = m_match->GetSessions().CreateSessionManager<NetworkSessionManager>(Nz::UInt16(14768), 64, networkThreadCount);
+		sessionManager->GetReactor().SetPeerBandwidthBudget(m_configFile.GetIntegerValue<Nz::UInt32>("ServerSettings.PeerBandwidthBudget"));
+
+		if (m_configFile.GetBoolValue("Debug.SendServerState"))
+			m_match->InitDebugGhosts();
 	}
 
 	int ServerApp::Run()
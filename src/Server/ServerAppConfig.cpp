@@ -12,5 +12,8 @@ namespace bw
 	{
 		RegisterStringOption("GameSettings.Gamemode");
 		RegisterStringOption("GameSettings.MapFile");
+		RegisterIntegerOption("ServerSettings.NetworkThreadCount", 1, 16, 1);
+		RegisterIntegerOption("ServerSettings.PeerBandwidthBudget", 0, 0xFFFFFFFF, 0);
+		RegisterIntegerOption("ServerSettings.SessionThreadCount", 1, 16, 1);
 	}
 }
@@ -95,6 +95,14 @@ target("BurgWar")
 	add_files("src/Client/**.cpp")
 	add_packages("concurrentqueue", "fmt", "nlohmann_json", "nazara")
 
+target("BurgWarBots")
+	set_kind("binary")
+
+	add_deps("Main", "ClientLib", "CoreLib")
+	add_headerfiles("src/Bots/**.hpp", "src/Bots/**.inl")
+	add_files("src/Bots/**.cpp")
+	add_packages("concurrentqueue", "fmt", "nlohmann_json", "nazara")
+
 target("BurgWarServer")
 	set_kind("binary")
 